@@ -0,0 +1,249 @@
+/**
+ * LibAmbient - Benchmark of the reduction kernels and the capture pipeline.
+ *
+ * Usage: libambient_bench [frames] [bitmapWidth bitmapHeight]
+ *
+ * The kernels are measured against synthetic buffers at common screen sizes,
+ * the end-to-end latency of ambient_get_hue() is measured per capture backend
+ * (using a context of the primary monitor, which is what getAmbientScreenHue() forwards to).
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "libambient.hpp"
+#include "reduce.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+typedef std::chrono::steady_clock bench_clock;
+
+// Minimum time each kernel is repeated for
+#define KERNEL_MIN_DURATION_MS  250
+
+struct bench_resolution
+{
+    const char* name;
+    int         width, height;
+};
+
+static const bench_resolution g_resolutions[] =
+{
+    { "720p",   1280,   720 },
+    { "1080p",  1920,   1080 },
+    { "4K",     3840,   2160 }
+};
+
+static double elapsed_ms(bench_clock::time_point start, bench_clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Keeps the compiler from discarding the results of a kernel
+static volatile unsigned long long g_sink;
+
+/**
+ * Repeats the specified kernel for at least KERNEL_MIN_DURATION_MS
+ * and returns the average time of a single run in milliseconds.
+ */
+template<typename Kernel>
+static double time_kernel(Kernel kernel)
+{
+    kernel(); // Warm up the caches
+
+    int runs = 0;
+    bench_clock::time_point start = bench_clock::now(), end;
+    do
+    {
+        kernel();
+        runs++;
+        end = bench_clock::now();
+    } while (elapsed_ms(start, end) < KERNEL_MIN_DURATION_MS);
+    return elapsed_ms(start, end) / runs;
+}
+
+static void print_kernel(const char* kernel, const char* variant, const bench_resolution* res, double ms)
+{
+    double pixels = (double) res->width * res->height;
+    printf("  %-14s %-7s %-6s %9.3f ms %9.1f Mpx/s\n", kernel, variant, res->name, ms, pixels / ms / 1000.0);
+}
+
+static void bench_average(const char* variant, sum_channels_fn kernel,
+                          const bench_resolution* res, const std::vector<COLOR>& pixels)
+{
+    double ms = time_kernel([&]()
+    {
+        unsigned long long sums[3] = { 0, 0, 0 };
+        kernel(pixels.data(), (int) pixels.size(), sums);
+        g_sink = sums[0] + sums[1] + sums[2];
+    });
+    print_kernel("average", variant, res, ms);
+}
+
+/**
+ * Same as bench_average for the kernels summing through a lookup table (sum_linear, sum_oklab).
+ */
+template<typename Entry>
+static void bench_lut_average(const char* kernelName, const char* variant,
+                              void (*kernel)(const COLOR*, int, const Entry*, unsigned long long*),
+                              const std::vector<Entry>& lut, const bench_resolution* res,
+                              const std::vector<COLOR>& pixels)
+{
+    double ms = time_kernel([&]()
+    {
+        unsigned long long sums[3] = { 0, 0, 0 };
+        kernel(pixels.data(), (int) pixels.size(), lut.data(), sums);
+        g_sink = sums[0] + sums[1] + sums[2];
+    });
+    print_kernel(kernelName, variant, res, ms);
+}
+
+/**
+ * Tone maps a half float frame (see tonemap_half).
+ */
+static void bench_tonemap(const char* variant, tonemap_half_fn kernel, const tone_curve* curve,
+                          const std::vector<unsigned char>& lut, const bench_resolution* res,
+                          const std::vector<unsigned short>& pixels, std::vector<COLOR>& dest)
+{
+    double ms = time_kernel([&]()
+    {
+        kernel(pixels.data(), (int) dest.size(), curve, lut.data(), dest.data());
+        g_sink = dest[0];
+    });
+    print_kernel("tonemap", variant, res, ms);
+}
+
+static void bench_kernels()
+{
+    printf("Kernels (SIMD level %d)\n", (int) reduce_simd_level());
+
+    // Random colors defeat any shortcut taken for uniform content
+    std::vector<unsigned short> lut(HUE_LUT_SIZE);
+    for (int i = 0; i < HUE_LUT_SIZE; i++)
+        lut[i] = HUE_LUT_ENTRY(rand() % HUE_RANGE, rand() % (HUE_LUT_MAX_WEIGHT + 1));
+
+    // Only the size of the tables matters for the perceptual kernels
+    std::vector<unsigned int> linearLut(LINEAR_LUT_SIZE);
+    for (unsigned int& entry : linearLut)
+        entry = (unsigned int) (rand() % (LINEAR_LUT_SCALE + 1));
+    std::vector<unsigned short> oklabLut(OKLAB_LUT_SIZE * 4);
+    for (unsigned short& entry : oklabLut)
+        entry = (unsigned short) (rand() % OKLAB_LUT_SCALE);
+    std::vector<unsigned char> srgbLut(SRGB_LUT_SIZE + 3);
+    for (unsigned char& entry : srgbLut)
+        entry = (unsigned char) rand();
+
+    // Extended Reinhard at 200 nits paper white, the most expensive curve
+    tone_curve curve = { 0.4f, 1.0f / 25.0f, 1.0f, 0.0f, 1.0f, 1.0f };
+
+    for (const bench_resolution& res : g_resolutions)
+    {
+        std::vector<COLOR> pixels((size_t) res.width * res.height);
+        for (COLOR& pixel : pixels)
+            pixel = ((COLOR) rand() << 16) ^ (COLOR) rand();
+
+        bench_average("scalar", sum_channels_scalar, &res, pixels);
+#ifdef AMBIENT_X86
+        if (reduce_simd_level() >= SIMD_SSE2)
+            bench_average("sse2", sum_channels_sse2, &res, pixels);
+        if (reduce_simd_level() >= SIMD_AVX2)
+            bench_average("avx2", sum_channels_avx2, &res, pixels);
+#endif
+
+        bench_lut_average("linear", "scalar", sum_linear_scalar, linearLut, &res, pixels);
+        bench_lut_average("oklab", "scalar", sum_oklab_scalar, oklabLut, &res, pixels);
+#ifdef AMBIENT_X86
+        if (reduce_simd_level() >= SIMD_AVX2)
+        {
+            bench_lut_average("linear", "avx2", sum_linear_avx2, linearLut, &res, pixels);
+            bench_lut_average("oklab", "avx2", sum_oklab_avx2, oklabLut, &res, pixels);
+        }
+#endif
+
+        // Finite half floats of up to 8.0
+        std::vector<unsigned short> halves(pixels.size() * 4);
+        for (unsigned short& half : halves)
+            half = (unsigned short) (rand() % 0x4800);
+        std::vector<COLOR> toneMapped(pixels.size());
+        bench_tonemap("scalar", tonemap_half_scalar, &curve, srgbLut, &res, halves, toneMapped);
+#ifdef AMBIENT_X86
+        if (reduce_simd_level() >= SIMD_AVX2)
+            bench_tonemap("f16c", tonemap_half_f16c, &curve, srgbLut, &res, halves, toneMapped);
+#endif
+
+        std::vector<unsigned int> hues(HUE_RANGE);
+        double ms = time_kernel([&]()
+        {
+            std::fill(hues.begin(), hues.end(), 0);
+            accumulate_hues(pixels.data(), (int) pixels.size(), lut.data(), hues.data());
+            g_sink = hues[0];
+        });
+        print_kernel("histogram", "lut", &res, ms);
+    }
+}
+
+static void bench_backend(const char* name, CAPTURE_BACKEND backend, int pipelineDepth, int frames,
+                          int bitmapWidth, int bitmapHeight)
+{
+    ambient_config config = {};
+    config.bitmapWidth      = bitmapWidth;
+    config.bitmapHeight     = bitmapHeight;
+    config.backend          = backend;
+    config.sampling         = SAMPLING_RESAMPLE;
+    config.pipelineDepth    = pipelineDepth;
+    ambient_context* context = ambient_create(0, &config);
+    if (!context || ambient_get_backend(context) != backend)
+    {
+        printf("  %-6s not available\n", name);
+        ambient_destroy(context);
+        return;
+    }
+
+    ambient_get_hue(context); // The first frame includes the setup of the pipeline
+
+    std::vector<double> latencies(frames);
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < frames; i++)
+    {
+        bench_clock::time_point frameStart = bench_clock::now();
+        ambient_get_hue(context);
+        latencies[i] = elapsed_ms(frameStart, bench_clock::now());
+    }
+    double total = elapsed_ms(start, bench_clock::now());
+    ambient_destroy(context);
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("  %-6s %dx%d: p50 %7.3f ms, p99 %7.3f ms, %7.1f fps\n", name, bitmapWidth, bitmapHeight,
+        latencies[frames / 2], latencies[frames * 99 / 100], frames * 1000.0 / total);
+}
+
+int main(int argc, char** argv)
+{
+    // The bitmap size is either passed completely or not at all
+    int frames          = argc > 1 ? atoi(argv[1]) : 500;
+    int bitmapWidth     = argc > 3 ? atoi(argv[2]) : 64;
+    int bitmapHeight    = argc > 3 ? atoi(argv[3]) : 36;
+    if (argc == 3 || argc > 4 || frames <= 0 || bitmapWidth <= 0 || bitmapHeight <= 0)
+    {
+        printf("Usage: libambient_bench [frames] [bitmapWidth bitmapHeight]\n");
+        return 1;
+    }
+
+    reduce_initialize();
+    bench_kernels();
+
+    printf("End-to-end ambient_get_hue() over %d frames (/2: pipeline depth 2)\n", frames);
+#ifdef _WIN32
+    bench_backend("GDI",    BACKEND_GDI,  1, frames, bitmapWidth, bitmapHeight);
+    bench_backend("GDI/2",  BACKEND_GDI,  2, frames, bitmapWidth, bitmapHeight);
+    bench_backend("DXGI",   BACKEND_DXGI, 1, frames, bitmapWidth, bitmapHeight);
+    bench_backend("DXGI/2", BACKEND_DXGI, 2, frames, bitmapWidth, bitmapHeight);
+#else
+    bench_backend("X11",    BACKEND_X11,  1, frames, bitmapWidth, bitmapHeight);
+    bench_backend("X11/2",  BACKEND_X11,  2, frames, bitmapWidth, bitmapHeight);
+#endif
+    return 0;
+}
@@ -0,0 +1,76 @@
+/**
+ * LibAmbient - Adaptive resolution driven by a latency budget.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "budget.hpp"
+#include <math.h>
+
+// Frames to measure after a resize before the next decision,
+// which also gives the new buffers time to settle into the caches
+#define BUDGET_SETTLE_FRAMES    30
+
+// Weight of a new frame in the moving average
+#define BUDGET_SMOOTHING        0.1f
+
+// The bitmap only grows while the average stays below this share of the budget,
+// so a size close to the budget does not flip back and forth
+#define BUDGET_GROW_THRESHOLD   0.6f
+
+// Share of the budget a resize aims for, between the grow threshold and the budget itself
+#define BUDGET_TARGET           0.8f
+
+// Limits of a single resize step (per axis)
+#define BUDGET_MIN_SCALE        0.5f
+#define BUDGET_MAX_SCALE        1.25f
+
+/**
+ * Sets the budget of a frame, 0 or less disables the controller.
+ * The measurements start over.
+ */
+void budget_configure(latency_budget* budget, float budgetMs)
+{
+    budget->budgetMs = budgetMs > 0 ? budgetMs : 0;
+    budget_reset(budget);
+}
+
+/**
+ * Discards all measurements, e.g. after the bitmap size changed.
+ */
+void budget_reset(latency_budget* budget)
+{
+    budget->averageMs   = 0;
+    budget->frames      = 0;
+}
+
+/**
+ * Adds the time of a frame to the average.
+ * 
+ * @param frameMs The time spent capturing and reducing the frame
+ * 
+ * @return The factor to scale both axes of the bitmap by, 1 to keep the current size
+ */
+float budget_update(latency_budget* budget, float frameMs)
+{
+    if (budget->budgetMs <= 0 || frameMs <= 0)
+        return 1;
+
+    budget->averageMs = budget->frames == 0
+        ? frameMs
+        : budget->averageMs + (frameMs - budget->averageMs) * BUDGET_SMOOTHING;
+    if (++budget->frames < BUDGET_SETTLE_FRAMES)
+        return 1;
+
+    float ratio = budget->budgetMs / budget->averageMs;
+    if (ratio >= 1 && ratio * BUDGET_GROW_THRESHOLD < 1)
+        return 1;
+
+    // Aim below the budget, so the noise of the next measurements does not trigger another resize
+    float scale = sqrtf(ratio * BUDGET_TARGET);
+    if (scale < BUDGET_MIN_SCALE) scale = BUDGET_MIN_SCALE;
+    if (scale > BUDGET_MAX_SCALE) scale = BUDGET_MAX_SCALE;
+    budget_reset(budget);
+    return scale;
+}
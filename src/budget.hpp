@@ -0,0 +1,28 @@
+/**
+ * LibAmbient - Adaptive resolution driven by a latency budget.
+ *
+ * The time spent capturing and reducing each frame is averaged and compared
+ * to the budget of the caller. Once the average settled clearly above or
+ * below the budget, the controller asks for a smaller or larger bitmap.
+ * The cost of a frame is roughly proportional to its pixels, so the
+ * requested scale is the square root of the ratio between budget and cost.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_BUDGET_H
+#define LIB_AMBIENT_BUDGET_H
+
+struct latency_budget
+{
+    float   budgetMs;       // Target time of a frame, 0 disables the controller
+    float   averageMs;      // Moving average of the measured frames
+    int     frames;         // Frames measured since the last resize
+};
+
+void    budget_configure(latency_budget* budget, float budgetMs);
+void    budget_reset(latency_budget* budget);
+float   budget_update(latency_budget* budget, float frameMs);
+
+#endif
@@ -0,0 +1,73 @@
+/**
+ * LibAmbient - Definitions shared by all capture backends.
+ *
+ * A context talks to its backend through a capture_interface,
+ * only creating the backend depends on which one it is.
+ * The monitors are enumerated by the native backend of the platform
+ * (GDI on Windows, X11 elsewhere).
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_CAPTURE_H
+#define LIB_AMBIENT_CAPTURE_H
+
+#include "platform.hpp"
+
+// Result of a single capture call
+enum capture_result
+{
+    CAPTURE_OK,         // The destination buffer contains a new frame
+    CAPTURE_UNCHANGED,  // No new frame, the destination buffer was left untouched
+    CAPTURE_FAILED      // Capturing failed, the destination buffer was left untouched
+};
+
+// Points in time (see stats_now) at which a backend finished the steps of a capture.
+// A step which did not happen (e.g. an unchanged frame) leaves its timestamp untouched.
+struct capture_timestamps
+{
+    long long   started;    // The capture started, set by the caller of the backend
+    long long   copied;     // The screen was copied (and downscaled)
+    long long   readBack;   // The pixels were read into the destination buffer
+    long long   dequeued;   // The reduction started, which only differs from readBack if pipelined
+};
+
+// Operations of a capture backend, each of them receives the state of the backend (e.g. a gdi_capture)
+struct capture_interface
+{
+    // Captures a frame into dest, which holds bitmapWidth * bitmapHeight pixels.
+    // The backend marks the rows which possibly changed in dirtyRows.
+    capture_result  (*capture_frame)(void* state, COLORREF* dest, unsigned char* dirtyRows,
+                                     capture_timestamps* timestamps);
+
+    // Changes the captured area and the size of the downscaled image.
+    // If this fails, the backend is restored by reconfiguring it to the previous sizes.
+    bool            (*reconfigure)(void* state, int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight);
+    void            (*uninitialize)(void* state);
+
+    // Optional, waits for the next vertical blank of the captured monitor
+    bool            (*wait_for_vblank)(void* state);
+
+    // Optional, makes captures wait up to the specified time for a new frame (0 polls).
+    // Returns false if the backend can not wait for frames.
+    bool            (*set_frame_timeout)(void* state, unsigned int timeoutMs);
+
+    // Set if the dirty rows are exact, otherwise every dirty row is compared to the previous frame
+    bool            exactDirtyRows;
+};
+
+// Position and size of a monitor on the virtual desktop
+struct monitor_info
+{
+    void*   handle;     // HMONITOR on Windows, NULL where monitors have no handle
+    int     x, y;
+    int     width, height;
+};
+
+int     monitor_count();
+bool    monitor_find(int monitorIndex, monitor_info* dest);
+bool    monitor_update(int monitorIndex, monitor_info* monitor);
+bool    monitor_fullscreen(const monitor_info* monitor);
+
+#endif
@@ -0,0 +1,738 @@
+/**
+ * LibAmbient - DXGI Desktop Duplication capture backend.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "libambient.hpp"
+#include "capture_dxgi.hpp"
+#include "stats.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <d3dcompiler.h>
+#include <dxgi1_6.h>
+
+#define SAFE_RELEASE(p) if (p) { (p)->Release(); (p) = NULL; }
+
+// Time to wait for the very first frame after (re-)creating the duplication.
+// Subsequent frames are polled without waiting.
+#define DXGI_FIRST_FRAME_TIMEOUT_MS 100
+
+// Amount of rows around a dirty rectangle which are marked as dirty as well,
+// as the filter footprint of the downscale covers neighbouring rows.
+#define DXGI_DIRTY_ROW_MARGIN 2
+
+// Peak brightness assumed for HDR displays which do not report theirs
+#define DXGI_DEFAULT_PEAK_NITS 1000.0f
+
+// Draws a single triangle covering the whole target and samples the
+// mip mapped desktop texture. The derivatives of the texture coordinates
+// select the mip level matching the downscale ratio, which gives a box-like
+// filter similar to GDI's HALFTONE mode.
+static const char g_downscaleShader[] =
+    "Texture2D<float4> g_source  : register(t0);                        \n"
+    "SamplerState      g_sampler : register(s0);                        \n"
+    "struct VSOut { float4 pos : SV_Position; float2 uv : TEXCOORD0; }; \n"
+    "VSOut vs_main(uint id : SV_VertexID)                               \n"
+    "{                                                                  \n"
+    "    VSOut o;                                                       \n"
+    "    o.uv  = float2((id << 1) & 2, id & 2);                         \n"
+    "    o.pos = float4(o.uv * float2(2, -2) + float2(-1, 1), 0, 1);    \n"
+    "    return o;                                                      \n"
+    "}                                                                  \n"
+    "float4 ps_main(VSOut i) : SV_Target                                \n"
+    "{                                                                  \n"
+    "    return g_source.Sample(g_sampler, i.uv);                       \n"
+    "}                                                                  \n";
+
+static ID3DBlob* compile_shader(const char* entryPoint, const char* target)
+{
+    ID3DBlob* code   = NULL;
+    ID3DBlob* errors = NULL;
+    HRESULT hr = D3DCompile(g_downscaleShader, sizeof(g_downscaleShader) - 1, NULL, NULL, NULL,
+        entryPoint, target, D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &code, &errors);
+    if (FAILED(hr))
+    {
+        dbgErr(errors ? (const char*) errors->GetBufferPointer() : "Failed to compile shader");
+        SAFE_RELEASE(code);
+    }
+    SAFE_RELEASE(errors);
+    return code;
+}
+
+/**
+ * Looks up the output showing the specified monitor and creates
+ * a device on the adapter the output is attached to.
+ */
+static bool create_device(dxgi_capture* dxgi, HMONITOR monitor)
+{
+    IDXGIFactory1* factory = NULL;
+    if (FAILED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void**) &factory)))
+        return false;
+
+    IDXGIAdapter1*  adapter = NULL;
+    IDXGIOutput*    output  = NULL;
+    for (UINT a = 0; !output && factory->EnumAdapters1(a, &adapter) != DXGI_ERROR_NOT_FOUND; a++)
+    {
+        IDXGIOutput* candidate = NULL;
+        for (UINT o = 0; adapter->EnumOutputs(o, &candidate) != DXGI_ERROR_NOT_FOUND; o++)
+        {
+            DXGI_OUTPUT_DESC desc;
+            if (SUCCEEDED(candidate->GetDesc(&desc)) && desc.Monitor == monitor)
+            {
+                output = candidate;
+                break;
+            }
+            candidate->Release();
+        }
+        if (!output) SAFE_RELEASE(adapter);
+    }
+    factory->Release();
+
+    if (!output)
+    {
+        dbgErr("==> DXGI: Output not found");
+        return false;
+    }
+
+    HRESULT hr = output->QueryInterface(__uuidof(IDXGIOutput1), (void**) &dxgi->output);
+    output->Release();
+    if (SUCCEEDED(hr))
+    {
+        // An explicit adapter requires the unknown driver type
+        hr = D3D11CreateDevice(adapter, D3D_DRIVER_TYPE_UNKNOWN, NULL, 0, NULL, 0,
+            D3D11_SDK_VERSION, &dxgi->device, NULL, &dxgi->context);
+    }
+    adapter->Release();
+    return SUCCEEDED(hr);
+}
+
+/**
+ * Returns the brightness of SDR content on the display showing the specified output in nits,
+ * as set by the user in the HDR settings, or 0 if it is not known.
+ */
+static float query_sdr_white_level(const DXGI_OUTPUT_DESC* output)
+{
+    UINT32 pathCount = 0, modeCount = 0;
+    if (GetDisplayConfigBufferSizes(QDC_ONLY_ACTIVE_PATHS, &pathCount, &modeCount) != ERROR_SUCCESS)
+        return 0;
+
+    DISPLAYCONFIG_PATH_INFO* paths = (DISPLAYCONFIG_PATH_INFO*) malloc(pathCount * sizeof(DISPLAYCONFIG_PATH_INFO));
+    DISPLAYCONFIG_MODE_INFO* modes = (DISPLAYCONFIG_MODE_INFO*) malloc(modeCount * sizeof(DISPLAYCONFIG_MODE_INFO));
+    float nits = 0;
+    if (paths && modes
+        && QueryDisplayConfig(QDC_ONLY_ACTIVE_PATHS, &pathCount, paths, &modeCount, modes, NULL) == ERROR_SUCCESS)
+    {
+        // The path whose source is the GDI device of the output leads to the monitor
+        for (UINT32 i = 0; i < pathCount && nits == 0; i++)
+        {
+            DISPLAYCONFIG_SOURCE_DEVICE_NAME source = { };
+            source.header.type      = DISPLAYCONFIG_DEVICE_INFO_GET_SOURCE_NAME;
+            source.header.size      = sizeof(source);
+            source.header.adapterId = paths[i].sourceInfo.adapterId;
+            source.header.id        = paths[i].sourceInfo.id;
+            if (DisplayConfigGetDeviceInfo(&source.header) != ERROR_SUCCESS
+                || wcscmp(source.viewGdiDeviceName, output->DeviceName) != 0)
+                continue;
+
+            // The level is given in thousandths of 80 nits
+            DISPLAYCONFIG_SDR_WHITE_LEVEL white = { };
+            white.header.type       = DISPLAYCONFIG_DEVICE_INFO_GET_SDR_WHITE_LEVEL;
+            white.header.size       = sizeof(white);
+            white.header.adapterId  = paths[i].targetInfo.adapterId;
+            white.header.id         = paths[i].targetInfo.id;
+            if (DisplayConfigGetDeviceInfo(&white.header) == ERROR_SUCCESS)
+                nits = white.SDRWhiteLevel * SCRGB_WHITE_NITS / 1000.0f;
+        }
+    }
+    free(paths);
+    free(modes);
+    return nits;
+}
+
+/**
+ * Looks up the SDR white level and the peak brightness of the duplicated display.
+ */
+static void query_display_luminance(dxgi_capture* dxgi)
+{
+    dxgi->displayWhiteNits  = SCRGB_WHITE_NITS;
+    dxgi->displayPeakNits   = DXGI_DEFAULT_PEAK_NITS;
+
+    // Windows 10 1703 and later
+    IDXGIOutput6* output6 = NULL;
+    if (FAILED(dxgi->output->QueryInterface(__uuidof(IDXGIOutput6), (void**) &output6)))
+        return;
+
+    DXGI_OUTPUT_DESC1 desc;
+    if (SUCCEEDED(output6->GetDesc1(&desc)))
+    {
+        float white = query_sdr_white_level((const DXGI_OUTPUT_DESC*) &desc);
+        if (white > 0)
+            dxgi->displayWhiteNits  = white;
+        if (desc.MaxLuminance > 0)
+            dxgi->displayPeakNits   = desc.MaxLuminance;
+    }
+    output6->Release();
+}
+
+/**
+ * Builds the tone curve from the parameters, or the luminance of the display where they are 0.
+ */
+static void update_tone_curve(dxgi_capture* dxgi)
+{
+    float paperWhite    = dxgi->paperWhiteNits > 0 ? dxgi->paperWhiteNits : dxgi->displayWhiteNits;
+    float peak          = dxgi->peakNits > 0 ? dxgi->peakNits : dxgi->displayPeakNits;
+    tone_curve_configure(&dxgi->curve, dxgi->toneMap, paperWhite, peak);
+}
+
+static bool create_duplication(dxgi_capture* dxgi)
+{
+    bool duplicated = false;
+    if (dxgi->hdr)
+    {
+        // HDR displays are duplicated as half floats, all others keep 8 bits.
+        // Requires Windows 10 1703 and a process which is per monitor DPI aware.
+        static const DXGI_FORMAT formats[] = { DXGI_FORMAT_R16G16B16A16_FLOAT, DXGI_FORMAT_B8G8R8A8_UNORM };
+        IDXGIOutput5* output5 = NULL;
+        if (SUCCEEDED(dxgi->output->QueryInterface(__uuidof(IDXGIOutput5), (void**) &output5)))
+        {
+            duplicated = SUCCEEDED(output5->DuplicateOutput1(dxgi->device, 0,
+                sizeof(formats) / sizeof(formats[0]), formats, &dxgi->duplication));
+            output5->Release();
+        }
+    }
+    if (!duplicated && FAILED(dxgi->output->DuplicateOutput(dxgi->device, &dxgi->duplication)))
+    {
+        dbgErr("==> DXGI: Failed to duplicate output");
+        return false;
+    }
+
+    DXGI_OUTDUPL_DESC desc;
+    dxgi->duplication->GetDesc(&desc);
+    dxgi->screenWidth   = desc.ModeDesc.Width;
+    dxgi->screenHeight  = desc.ModeDesc.Height;
+    dxgi->format        = duplicated && desc.ModeDesc.Format == DXGI_FORMAT_R16G16B16A16_FLOAT
+                          ? DXGI_FORMAT_R16G16B16A16_FLOAT : DXGI_FORMAT_B8G8R8A8_UNORM;
+    dxgi->hasFrame      = false;
+
+    // The user may have changed the SDR brightness while the duplication was lost
+    if (dxgi->format == DXGI_FORMAT_R16G16B16A16_FLOAT)
+    {
+        query_display_luminance(dxgi);
+        update_tone_curve(dxgi);
+    }
+    return true;
+}
+
+static bool create_resources(dxgi_capture* dxgi)
+{
+    D3D11_TEXTURE2D_DESC desc = { 0 };
+    desc.Width              = dxgi->screenWidth;
+    desc.Height             = dxgi->screenHeight;
+    desc.MipLevels          = 0; // Full mip chain
+    desc.ArraySize          = 1;
+    desc.Format             = dxgi->format;
+    desc.SampleDesc.Count   = 1;
+
+    if (dxgi->grid)
+    {
+        // The frame is copied straight into a full resolution staging texture
+        desc.MipLevels      = 1;
+        desc.Usage          = D3D11_USAGE_STAGING;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        return SUCCEEDED(dxgi->device->CreateTexture2D(&desc, NULL, &dxgi->stagingTexture));
+    }
+
+    if (dxgi->gpuFrames)
+    {
+        // The frame is only read by shaders
+        desc.MipLevels      = 1;
+        desc.Usage          = D3D11_USAGE_DEFAULT;
+        desc.BindFlags      = D3D11_BIND_SHADER_RESOURCE;
+        return SUCCEEDED(dxgi->device->CreateTexture2D(&desc, NULL, &dxgi->mipTexture))
+            && SUCCEEDED(dxgi->device->CreateShaderResourceView(dxgi->mipTexture, NULL, &dxgi->mipView));
+    }
+
+    desc.Usage              = D3D11_USAGE_DEFAULT;
+    desc.BindFlags          = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+    desc.MiscFlags          = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+    if (FAILED(dxgi->device->CreateTexture2D(&desc, NULL, &dxgi->mipTexture)))
+        return false;
+    if (FAILED(dxgi->device->CreateShaderResourceView(dxgi->mipTexture, NULL, &dxgi->mipView)))
+        return false;
+
+    desc.Width      = dxgi->bitmapWidth;
+    desc.Height     = dxgi->bitmapHeight;
+    desc.MipLevels  = 1;
+    desc.BindFlags  = D3D11_BIND_RENDER_TARGET;
+    desc.MiscFlags  = 0;
+    if (FAILED(dxgi->device->CreateTexture2D(&desc, NULL, &dxgi->targetTexture)))
+        return false;
+    if (FAILED(dxgi->device->CreateRenderTargetView(dxgi->targetTexture, NULL, &dxgi->targetView)))
+        return false;
+
+    desc.Usage          = D3D11_USAGE_STAGING;
+    desc.BindFlags      = 0;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    if (FAILED(dxgi->device->CreateTexture2D(&desc, NULL, &dxgi->stagingTexture)))
+        return false;
+
+    D3D11_SAMPLER_DESC samplerDesc = { };
+    samplerDesc.Filter          = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+    samplerDesc.AddressU        = D3D11_TEXTURE_ADDRESS_CLAMP;
+    samplerDesc.AddressV        = D3D11_TEXTURE_ADDRESS_CLAMP;
+    samplerDesc.AddressW        = D3D11_TEXTURE_ADDRESS_CLAMP;
+    samplerDesc.ComparisonFunc  = D3D11_COMPARISON_NEVER;
+    samplerDesc.MaxLOD          = D3D11_FLOAT32_MAX;
+    if (FAILED(dxgi->device->CreateSamplerState(&samplerDesc, &dxgi->sampler)))
+        return false;
+
+    ID3DBlob* vsCode = compile_shader("vs_main", "vs_5_0");
+    ID3DBlob* psCode = compile_shader("ps_main", "ps_5_0");
+    bool success = vsCode && psCode
+        && SUCCEEDED(dxgi->device->CreateVertexShader(vsCode->GetBufferPointer(),
+            vsCode->GetBufferSize(), NULL, &dxgi->vertexShader))
+        && SUCCEEDED(dxgi->device->CreatePixelShader(psCode->GetBufferPointer(),
+            psCode->GetBufferSize(), NULL, &dxgi->pixelShader));
+    SAFE_RELEASE(vsCode);
+    SAFE_RELEASE(psCode);
+    return success;
+}
+
+static void release_resources(dxgi_capture* dxgi)
+{
+    SAFE_RELEASE(dxgi->sampler);
+    SAFE_RELEASE(dxgi->pixelShader);
+    SAFE_RELEASE(dxgi->vertexShader);
+    SAFE_RELEASE(dxgi->stagingTexture);
+    SAFE_RELEASE(dxgi->targetView);
+    SAFE_RELEASE(dxgi->targetTexture);
+    SAFE_RELEASE(dxgi->mipView);
+    SAFE_RELEASE(dxgi->mipTexture);
+}
+
+/**
+ * Marks the rows of the downscaled image covered by the specified screen rectangle.
+ */
+static void mark_dirty_rows(dxgi_capture* dxgi, const RECT* rect, unsigned char* dirtyRows)
+{
+    int top     = rect->top * dxgi->bitmapHeight / dxgi->screenHeight - DXGI_DIRTY_ROW_MARGIN;
+    int bottom  = (rect->bottom * dxgi->bitmapHeight + dxgi->screenHeight - 1) / dxgi->screenHeight
+                  + DXGI_DIRTY_ROW_MARGIN;
+    if (top < 0)                    top = 0;
+    if (bottom > dxgi->bitmapHeight) bottom = dxgi->bitmapHeight;
+    if (bottom > top)
+        memset(dirtyRows + top, 1, bottom - top);
+}
+
+/**
+ * Translates the move and dirty rectangles of the acquired frame into dirty rows.
+ * Must be called before the frame is released.
+ */
+static void collect_dirty_rows(dxgi_capture* dxgi, const DXGI_OUTDUPL_FRAME_INFO* frameInfo,
+                               unsigned char* dirtyRows)
+{
+    if (!dxgi->hasFrame || frameInfo->TotalMetadataBufferSize == 0)
+    {
+        memset(dirtyRows, 1, dxgi->bitmapHeight);
+        return;
+    }
+
+    if (dxgi->metadataSize < frameInfo->TotalMetadataBufferSize)
+    {
+        free(dxgi->metadata);
+        dxgi->metadataSize  = frameInfo->TotalMetadataBufferSize;
+        dxgi->metadata      = (BYTE*) malloc(dxgi->metadataSize);
+    }
+
+    memset(dirtyRows, 0, dxgi->bitmapHeight);
+
+    UINT size = 0;
+    if (FAILED(dxgi->duplication->GetFrameMoveRects(dxgi->metadataSize,
+        (DXGI_OUTDUPL_MOVE_RECT*) dxgi->metadata, &size)))
+    {
+        memset(dirtyRows, 1, dxgi->bitmapHeight);
+        return;
+    }
+    const DXGI_OUTDUPL_MOVE_RECT* moveRects = (const DXGI_OUTDUPL_MOVE_RECT*) dxgi->metadata;
+    for (UINT i = 0; i < size / sizeof(DXGI_OUTDUPL_MOVE_RECT); i++)
+        mark_dirty_rows(dxgi, &moveRects[i].DestinationRect, dirtyRows);
+
+    if (FAILED(dxgi->duplication->GetFrameDirtyRects(dxgi->metadataSize, (RECT*) dxgi->metadata, &size)))
+    {
+        memset(dirtyRows, 1, dxgi->bitmapHeight);
+        return;
+    }
+    const RECT* dirtyRects = (const RECT*) dxgi->metadata;
+    for (UINT i = 0; i < size / sizeof(RECT); i++)
+        mark_dirty_rows(dxgi, &dirtyRects[i], dirtyRows);
+}
+
+/**
+ * Downscales the frame in the mip texture into the target and copies it to the staging texture.
+ */
+static void downscale(dxgi_capture* dxgi)
+{
+    dxgi->context->GenerateMips(dxgi->mipView);
+
+    D3D11_VIEWPORT viewport = { 0 };
+    viewport.Width      = (FLOAT) dxgi->bitmapWidth;
+    viewport.Height     = (FLOAT) dxgi->bitmapHeight;
+    viewport.MaxDepth   = 1.0f;
+    dxgi->context->OMSetRenderTargets(1, &dxgi->targetView, NULL);
+    dxgi->context->RSSetViewports(1, &viewport);
+    dxgi->context->IASetInputLayout(NULL);
+    dxgi->context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    dxgi->context->VSSetShader(dxgi->vertexShader, NULL, 0);
+    dxgi->context->PSSetShader(dxgi->pixelShader, NULL, 0);
+    dxgi->context->PSSetShaderResources(0, 1, &dxgi->mipView);
+    dxgi->context->PSSetSamplers(0, 1, &dxgi->sampler);
+    dxgi->context->Draw(3, 0);
+
+    ID3D11ShaderResourceView* nullView = NULL;
+    dxgi->context->PSSetShaderResources(0, 1, &nullView);
+    dxgi->context->OMSetRenderTargets(0, NULL, NULL);
+
+    // Read back the small target only
+    dxgi->context->CopyResource(dxgi->stagingTexture, dxgi->targetTexture);
+}
+
+/**
+ * Reads the frame from the staging texture into the specified buffer,
+ * sampling it with a grid or copying the downscaled image.
+ * Half float frames are tone mapped on the way.
+ */
+static bool read_back(dxgi_capture* dxgi, COLORREF* dest)
+{
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (FAILED(dxgi->context->Map(dxgi->stagingTexture, 0, D3D11_MAP_READ, 0, &mapped)))
+        return false;
+
+    const BYTE* src = (const BYTE*) mapped.pData;
+    bool halfFloats = dxgi->format == DXGI_FORMAT_R16G16B16A16_FLOAT;
+    bool success    = true;
+    if (dxgi->grid && halfFloats)
+    {
+        size_t count = (size_t) dxgi->bitmapWidth * dxgi->bitmapHeight;
+        if (dxgi->halfCapacity < count)
+        {
+            free(dxgi->halfSamples);
+            dxgi->halfSamples   = (rgba_half*) malloc(count * sizeof(rgba_half));
+            dxgi->halfCapacity  = dxgi->halfSamples ? count : 0;
+        }
+        success = dxgi->halfSamples != NULL;
+        if (success)
+        {
+            sample_grid_gather_half(dxgi->grid, src, mapped.RowPitch, dxgi->halfSamples);
+            tonemap_surface(&dxgi->curve, (const BYTE*) dxgi->halfSamples, (int) (dxgi->bitmapWidth * sizeof(rgba_half)),
+                dxgi->bitmapWidth, dxgi->bitmapHeight, (COLOR*) dest);
+        }
+    }
+    else if (dxgi->grid)
+    {
+        dxgi->gather(dxgi->grid, src, mapped.RowPitch, (COLOR*) dest);
+    }
+    else if (halfFloats)
+    {
+        tonemap_surface(&dxgi->curve, src, mapped.RowPitch, dxgi->bitmapWidth, dxgi->bitmapHeight, (COLOR*) dest);
+    }
+    else
+    {
+        for (int y = 0; y < dxgi->bitmapHeight; y++)
+            memcpy(dest + y * dxgi->bitmapWidth, src + y * mapped.RowPitch, dxgi->bitmapWidth * sizeof(COLORREF));
+    }
+
+    dxgi->context->Unmap(dxgi->stagingTexture, 0);
+    return success;
+}
+
+/**
+ * Tone maps the last frame again after the tone curve changed,
+ * as a static desktop does not deliver a new one.
+ */
+static capture_result retone_frame(dxgi_capture* dxgi, COLORREF* dest, unsigned char* dirtyRows,
+                                   capture_timestamps* timestamps)
+{
+    timestamps->copied = stats_now();
+    if (!read_back(dxgi, dest))
+        return CAPTURE_FAILED;
+    timestamps->readBack = stats_now();
+    if (dirtyRows)
+        memset(dirtyRows, 1, dxgi->bitmapHeight);
+    dxgi->retone = false;
+    return CAPTURE_OK;
+}
+
+/**
+ * Initializes the duplication of the output showing the specified monitor.
+ *
+ * @param dxgi The capture state to initialize
+ * @param monitor The monitor to capture
+ * @param bitmapWidth The width of the downscaled image which is read back
+ * @param bitmapHeight The height of the downscaled image which is read back
+ * @param grid Optional, samples the native resolution image instead of downscaling it.
+ *             Its size replaces bitmapWidth and bitmapHeight, it must outlive the capture state.
+ * @param gpuFrames Keeps the frames on the GPU (see mipView) instead of reading them back
+ * @param hdr Duplicates HDR displays as half floats, which are tone mapped (see dxgi_set_tone_map).
+ *            Not supported together with gpuFrames.
+ *
+ * @return false if the desktop duplication is not available (e.g. prior to Windows 8
+ *         or inside a remote session). The state is released in that case.
+ */
+bool dxgi_initialize(dxgi_capture* dxgi, HMONITOR monitor, int bitmapWidth, int bitmapHeight,
+                     const sample_grid* grid, bool gpuFrames, bool hdr)
+{
+    memset(dxgi, 0, sizeof(*dxgi));
+    dxgi->bitmapWidth   = grid ? grid->width  : bitmapWidth;
+    dxgi->bitmapHeight  = grid ? grid->height : bitmapHeight;
+    dxgi->grid          = grid;
+    dxgi->gather        = grid ? sample_grid_kernel(grid, PIXEL_BGRA8) : NULL;
+    dxgi->gpuFrames     = gpuFrames && !grid;
+    dxgi->hdr           = hdr && !dxgi->gpuFrames;
+
+    if (!create_device(dxgi, monitor) || !create_duplication(dxgi))
+    {
+        dxgi_uninitialize(dxgi);
+        return false;
+    }
+
+    // The samples are read straight from the frame, which has the size of the display mode
+    if (grid && (grid->surfaceWidth > dxgi->screenWidth || grid->surfaceHeight > dxgi->screenHeight))
+    {
+        dbgErr("==> DXGI: Sample grid exceeds the display mode");
+        dxgi_uninitialize(dxgi);
+        return false;
+    }
+
+    if (!create_resources(dxgi))
+    {
+        dxgi_uninitialize(dxgi);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Releases all resources held by the specified capture state.
+ */
+void dxgi_uninitialize(dxgi_capture* dxgi)
+{
+    release_resources(dxgi);
+    free(dxgi->metadata);
+    dxgi->metadata      = NULL;
+    dxgi->metadataSize  = 0;
+    free(dxgi->halfSamples);
+    dxgi->halfSamples   = NULL;
+    dxgi->halfCapacity  = 0;
+    SAFE_RELEASE(dxgi->duplication);
+    SAFE_RELEASE(dxgi->output);
+    SAFE_RELEASE(dxgi->context);
+    SAFE_RELEASE(dxgi->device);
+}
+
+/**
+ * Changes the size of the downscaled image which is read back.
+ * With a sample grid, this only takes over the size of the grid,
+ * which the caller laid out again, as the frame is read at native resolution.
+ * The next frame is reported as completely dirty.
+ *
+ * @return false if the resources could not be recreated, capturing fails until the next resize
+ */
+bool dxgi_resize(dxgi_capture* dxgi, int bitmapWidth, int bitmapHeight)
+{
+    if (dxgi->gpuFrames)
+        return false;
+    if (dxgi->grid)
+    {
+        dxgi->bitmapWidth   = bitmapWidth;
+        dxgi->bitmapHeight  = bitmapHeight;
+        dxgi->hasFrame      = false;
+        return true;
+    }
+
+    release_resources(dxgi);
+    dxgi->bitmapWidth   = bitmapWidth;
+    dxgi->bitmapHeight  = bitmapHeight;
+    dxgi->hasFrame      = false;
+    return create_resources(dxgi);
+}
+
+/**
+ * Changes the tone curve half float frames are mapped into the SDR range with.
+ * The last frame is tone mapped again by the next capture, even if the desktop did not change.
+ *
+ * @param paperWhiteNits The brightness of SDR white, 0 for the SDR content brightness set for the display
+ * @param peakNits The brightness TONE_MAP_REINHARD maps to SDR white, 0 for the peak brightness of the display
+ *
+ * @return true if the frames are half floats, otherwise the curve has no effect
+ */
+bool dxgi_set_tone_map(dxgi_capture* dxgi, TONE_MAP mode, float paperWhiteNits, float peakNits)
+{
+    dxgi->toneMap           = mode;
+    dxgi->paperWhiteNits    = paperWhiteNits;
+    dxgi->peakNits          = peakNits;
+    update_tone_curve(dxgi);
+
+    bool halfFloats = dxgi->format == DXGI_FORMAT_R16G16B16A16_FLOAT;
+    dxgi->retone = halfFloats && dxgi->hasFrame;
+    return halfFloats;
+}
+
+/**
+ * Blocks until the next vertical blank of the duplicated output.
+ *
+ * @return false if the output does not support waiting
+ */
+bool dxgi_wait_for_vblank(dxgi_capture* dxgi)
+{
+    return dxgi->output && SUCCEEDED(dxgi->output->WaitForVBlank());
+}
+
+/**
+ * Downscales (or samples) the most recent desktop image into the specified buffer,
+ * which must hold bitmapWidth * bitmapHeight pixels. If the frames stay on the GPU,
+ * the image is only copied to mipView and dest is not used.
+ *
+ * If the desktop did not change since the last call (or only the mouse pointer moved),
+ * the buffer is left untouched and CAPTURE_UNCHANGED is returned,
+ * unless the last half float frame has to be tone mapped again.
+ *
+ * @param dirtyRows Optional, receives a flag for each row of the buffer
+ *                  telling whether the row may have changed since the last frame.
+ * @param timestamps Receives the time each step of the capture finished.
+ *                   The GPU work is only submitted before readBack, so its time counts as readback.
+ */
+capture_result dxgi_capture_frame(dxgi_capture* dxgi, COLORREF* dest, unsigned char* dirtyRows,
+                                  capture_timestamps* timestamps)
+{
+    if (!dxgi->duplication)
+    {
+        // The duplication was lost (mode change, secure desktop, ...), try to recover.
+        // A changed resolution or HDR being switched on or off requires new textures as well.
+        int oldWidth = dxgi->screenWidth, oldHeight = dxgi->screenHeight;
+        DXGI_FORMAT oldFormat = dxgi->format;
+        if (!create_duplication(dxgi))
+            return CAPTURE_FAILED;
+        bool released = !dxgi->mipTexture && !dxgi->stagingTexture;
+        if (released || oldWidth != dxgi->screenWidth || oldHeight != dxgi->screenHeight
+            || oldFormat != dxgi->format)
+        {
+            // The sample grid was laid out for the old resolution, until the caller lays it out again.
+            // The resources are released, so they are created once the grid fits.
+            if (dxgi->grid && (dxgi->grid->surfaceWidth > dxgi->screenWidth
+                || dxgi->grid->surfaceHeight > dxgi->screenHeight))
+            {
+                release_resources(dxgi);
+                SAFE_RELEASE(dxgi->duplication);
+                return CAPTURE_FAILED;
+            }
+            release_resources(dxgi);
+            if (!create_resources(dxgi))
+            {
+                SAFE_RELEASE(dxgi->duplication);
+                return CAPTURE_FAILED;
+            }
+        }
+    }
+
+    DXGI_OUTDUPL_FRAME_INFO frameInfo;
+    IDXGIResource* resource = NULL;
+    HRESULT hr = dxgi->duplication->AcquireNextFrame(
+        dxgi->hasFrame ? dxgi->frameTimeoutMs : DXGI_FIRST_FRAME_TIMEOUT_MS, &frameInfo, &resource);
+    if (hr == DXGI_ERROR_WAIT_TIMEOUT)
+    {
+        if (dxgi->hasFrame && dxgi->retone)
+            return retone_frame(dxgi, dest, dirtyRows, timestamps);
+        return dxgi->hasFrame ? CAPTURE_UNCHANGED : CAPTURE_FAILED;
+    }
+    if (hr == DXGI_ERROR_ACCESS_LOST)
+    {
+        SAFE_RELEASE(dxgi->duplication);
+        return CAPTURE_FAILED;
+    }
+    if (FAILED(hr))
+        return CAPTURE_FAILED;
+
+    // A frame without a present time only carries a pointer update
+    if (dxgi->hasFrame && frameInfo.LastPresentTime.QuadPart == 0)
+    {
+        resource->Release();
+        dxgi->duplication->ReleaseFrame();
+        return dxgi->retone ? retone_frame(dxgi, dest, dirtyRows, timestamps) : CAPTURE_UNCHANGED;
+    }
+
+    if (dirtyRows && !dxgi->gpuFrames)
+    {
+        collect_dirty_rows(dxgi, &frameInfo, dirtyRows);
+
+        // The rows which did not change were tone mapped with the previous curve
+        if (dxgi->retone)
+            memset(dirtyRows, 1, dxgi->bitmapHeight);
+    }
+
+    // Copy the frame to our own texture, so it can be released as early as possible
+    ID3D11Texture2D* frameTexture = NULL;
+    hr = resource->QueryInterface(__uuidof(ID3D11Texture2D), (void**) &frameTexture);
+    resource->Release();
+    if (SUCCEEDED(hr))
+    {
+        dxgi->context->CopySubresourceRegion(dxgi->grid ? dxgi->stagingTexture : dxgi->mipTexture,
+            0, 0, 0, 0, frameTexture, 0, NULL);
+        frameTexture->Release();
+    }
+    dxgi->duplication->ReleaseFrame();
+    if (FAILED(hr))
+        return CAPTURE_FAILED;
+
+    timestamps->copied = stats_now();
+
+    if (dxgi->gpuFrames)
+    {
+        dxgi->hasFrame = true;
+        return CAPTURE_OK;
+    }
+
+    // The sampled frame is in the staging texture already, all others are downscaled on the GPU
+    if (!dxgi->grid)
+        downscale(dxgi);
+
+    if (!read_back(dxgi, dest))
+        return CAPTURE_FAILED;
+    timestamps->readBack = stats_now();
+    dxgi->hasFrame  = true;
+    dxgi->retone    = false;
+    return CAPTURE_OK;
+}
+
+
+static capture_result capture(void* state, COLORREF* dest, unsigned char* dirtyRows, capture_timestamps* timestamps)
+{
+    return dxgi_capture_frame((dxgi_capture*) state, dest, dirtyRows, timestamps);
+}
+
+// The whole output is duplicated, so only the bitmap size applies
+static bool reconfigure(void* state, int, int, int bitmapWidth, int bitmapHeight)
+{
+    return dxgi_resize((dxgi_capture*) state, bitmapWidth, bitmapHeight);
+}
+
+static void uninitialize(void* state)
+{
+    dxgi_uninitialize((dxgi_capture*) state);
+}
+
+static bool wait_for_vblank(void* state)
+{
+    return dxgi_wait_for_vblank((dxgi_capture*) state);
+}
+
+static bool set_frame_timeout(void* state, unsigned int timeoutMs)
+{
+    ((dxgi_capture*) state)->frameTimeoutMs = timeoutMs;
+    return true;
+}
+
+// The dirty rectangles of the duplication tell exactly which rows changed
+const capture_interface dxgi_interface = { capture, reconfigure, uninitialize, wait_for_vblank, set_frame_timeout, true };
@@ -0,0 +1,90 @@
+/**
+ * LibAmbient - DXGI Desktop Duplication capture backend.
+ *
+ * The desktop image is acquired as a GPU texture, downscaled on the GPU
+ * (mip chain + trilinear resample) and only the small target bitmap
+ * is read back to system memory. With a sample grid the full resolution
+ * image is read back instead and sampled on the CPU.
+ * HDR displays can be duplicated as half floats, which are tone mapped
+ * right after the readback.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_CAPTURE_DXGI_H
+#define LIB_AMBIENT_CAPTURE_DXGI_H
+
+#include <Windows.h>
+#include <d3d11.h>
+#include <dxgi1_2.h>
+#include "capture.hpp"
+#include "sampling.hpp"
+#include "tonemap.hpp"
+
+// State of a duplicated output.
+struct dxgi_capture
+{
+    ID3D11Device*               device;
+    ID3D11DeviceContext*        context;
+    IDXGIOutput1*               output;
+    IDXGIOutputDuplication*     duplication;
+
+    // Full resolution copy of the desktop with a complete mip chain.
+    // If the frames stay on the GPU, it only has a single level and nothing is read back.
+    ID3D11Texture2D*            mipTexture;
+    ID3D11ShaderResourceView*   mipView;
+    bool                        gpuFrames;
+
+    // Downscaled render target and its CPU readable copy
+    ID3D11Texture2D*            targetTexture;
+    ID3D11RenderTargetView*     targetView;
+    ID3D11Texture2D*            stagingTexture;
+
+    ID3D11VertexShader*         vertexShader;
+    ID3D11PixelShader*          pixelShader;
+    ID3D11SamplerState*         sampler;
+
+    // Set if the native resolution image is sampled instead of downscaled.
+    // The staging texture has the size of the screen in that case.
+    const sample_grid*          grid;
+    sample_gather_fn            gather;
+
+    // Format of the frames and textures, half floats if an HDR display is duplicated with hdr set
+    bool                        hdr;
+    DXGI_FORMAT                 format;
+    rgba_half*                  halfSamples;    // Samples of a half float frame before they are tone mapped
+    size_t                      halfCapacity;
+
+    // Tone mapping of half float frames (see dxgi_set_tone_map).
+    // The parameters which are 0 are taken from the display, which is queried with every duplication.
+    TONE_MAP                    toneMap;
+    float                       paperWhiteNits, peakNits;
+    float                       displayWhiteNits, displayPeakNits;
+    tone_curve                  curve;
+    bool                        retone;         // The curve changed, so the last frame is tone mapped again
+
+    // Buffer receiving the move and dirty rectangles of a frame
+    BYTE*   metadata;
+    UINT    metadataSize;
+
+    int     screenWidth, screenHeight;
+    int     bitmapWidth, bitmapHeight;
+    bool    hasFrame;
+
+    // Time to wait for a new frame once the first one arrived, 0 polls without waiting
+    UINT    frameTimeoutMs;
+};
+
+extern const capture_interface dxgi_interface;
+
+bool            dxgi_initialize(dxgi_capture* dxgi, HMONITOR monitor, int bitmapWidth, int bitmapHeight,
+                                const sample_grid* grid, bool gpuFrames, bool hdr);
+void            dxgi_uninitialize(dxgi_capture* dxgi);
+bool            dxgi_resize(dxgi_capture* dxgi, int bitmapWidth, int bitmapHeight);
+bool            dxgi_set_tone_map(dxgi_capture* dxgi, TONE_MAP mode, float paperWhiteNits, float peakNits);
+bool            dxgi_wait_for_vblank(dxgi_capture* dxgi);
+capture_result  dxgi_capture_frame(dxgi_capture* dxgi, COLORREF* dest, unsigned char* dirtyRows,
+                                   capture_timestamps* timestamps);
+
+#endif
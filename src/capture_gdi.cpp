@@ -0,0 +1,367 @@
+/**
+ * LibAmbient - GDI capture backend.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "libambient.hpp"
+#include "capture_gdi.hpp"
+#include "stats.hpp"
+#include <shellapi.h>
+#include <stdio.h>
+#include <string.h>
+
+// Used to enumerate the monitors with EnumDisplayMonitors
+struct monitor_list
+{
+    HMONITOR    monitors[32];
+    int         count;
+};
+
+static BOOL CALLBACK enum_monitor(HMONITOR monitor, HDC, LPRECT, LPARAM param)
+{
+    monitor_list* list = (monitor_list*) param;
+    if (list->count == sizeof(list->monitors) / sizeof(list->monitors[0]))
+        return FALSE;
+
+    // The primary monitor always comes first
+    MONITORINFO info = { sizeof(MONITORINFO) };
+    GetMonitorInfo(monitor, &info);
+    if (info.dwFlags & MONITORINFOF_PRIMARY)
+    {
+        memmove(list->monitors + 1, list->monitors, list->count * sizeof(HMONITOR));
+        list->monitors[0] = monitor;
+    }
+    else
+    {
+        list->monitors[list->count] = monitor;
+    }
+    list->count++;
+    return TRUE;
+}
+
+static void set_monitor_rect(monitor_info* dest, const RECT* rect)
+{
+    dest->x         = rect->left;
+    dest->y         = rect->top;
+    dest->width     = rect->right - rect->left;
+    dest->height    = rect->bottom - rect->top;
+}
+
+/**
+ * Returns the amount of monitors attached to the desktop.
+ */
+int monitor_count()
+{
+    monitor_list list = { { 0 }, 0 };
+    EnumDisplayMonitors(NULL, NULL, enum_monitor, (LPARAM) &list);
+    return list.count;
+}
+
+/**
+ * Looks up the monitor with the specified index, where 0 is the primary monitor.
+ *
+ * @param dest Receives the HMONITOR and the area of the monitor on the virtual desktop
+ *
+ * @return false if there is no such monitor
+ */
+bool monitor_find(int monitorIndex, monitor_info* dest)
+{
+    monitor_list list = { { 0 }, 0 };
+    EnumDisplayMonitors(NULL, NULL, enum_monitor, (LPARAM) &list);
+    if (monitorIndex < 0 || monitorIndex >= list.count)
+        return false;
+
+    MONITORINFO info = { sizeof(MONITORINFO) };
+    GetMonitorInfo(list.monitors[monitorIndex], &info);
+    dest->handle = list.monitors[monitorIndex];
+    set_monitor_rect(dest, &info.rcMonitor);
+    return true;
+}
+
+/**
+ * Updates the area of a monitor found with monitor_find, which is cheap enough for every frame.
+ * The handle is gone if the monitors were rearranged, it is looked up again by its index in that case.
+ *
+ * @return false if the monitor does not exist anymore
+ */
+bool monitor_update(int monitorIndex, monitor_info* monitor)
+{
+    MONITORINFO info = { sizeof(MONITORINFO) };
+    if (!GetMonitorInfo((HMONITOR) monitor->handle, &info))
+        return monitor_find(monitorIndex, monitor);
+
+    set_monitor_rect(monitor, &info.rcMonitor);
+    return true;
+}
+
+/**
+ * Determines whether a fullscreen exclusive Direct3D application is in the foreground of a monitor,
+ * which GDI capture would make drop frames.
+ */
+bool monitor_fullscreen(const monitor_info* monitor)
+{
+    // The notification state is the same for all monitors, only the one of the foreground window is affected
+    QUERY_USER_NOTIFICATION_STATE state;
+    if (FAILED(SHQueryUserNotificationState(&state)) || state != QUNS_RUNNING_D3D_FULL_SCREEN)
+        return false;
+
+    HWND foreground = GetForegroundWindow();
+    return foreground && MonitorFromWindow(foreground, MONITOR_DEFAULTTONULL) == (HMONITOR) monitor->handle;
+}
+
+// A bitmap header followed by the color masks of BI_BITFIELDS
+struct dib_info
+{
+    BITMAPINFOHEADER    header;
+    DWORD               masks[3];
+};
+
+/**
+ * Creates the blit target, a top-down DIB section whose bits can be read in place.
+ * The downscaled image is always 32 bit, as HALFTONE averages in 24 bit color anyway.
+ */
+static HBITMAP create_dib_section(gdi_capture* gdi, int width, int height, pixel_format format, void** bits)
+{
+    dib_info dibInfo;
+    memset(&dibInfo, 0, sizeof(dibInfo));
+    dibInfo.header.biSize           = sizeof(BITMAPINFOHEADER);
+    dibInfo.header.biWidth          = width;
+    dibInfo.header.biHeight         = -height; // Top-down
+    dibInfo.header.biPlanes         = 1;
+    dibInfo.header.biBitCount       = (WORD) (pixel_format_bytes(format) * 8);
+    dibInfo.header.biCompression    = BI_RGB;
+    if (format == PIXEL_RGB565)
+    {
+        dibInfo.header.biCompression    = BI_BITFIELDS;
+        dibInfo.masks[0]                = 0xf800;
+        dibInfo.masks[1]                = 0x07e0;
+        dibInfo.masks[2]                = 0x001f;
+    }
+    return CreateDIBSection(gdi->hScreenDC, (const BITMAPINFO*) &dibInfo, DIB_RGB_COLORS, bits, NULL, 0);
+}
+
+/**
+ * Returns the distance between two rows of a DIB section, which are aligned to 4 bytes.
+ */
+static int dib_pitch(int width, pixel_format format)
+{
+    return (width * pixel_format_bytes(format) + 3) & ~3;
+}
+
+/**
+ * Returns the format of a native resolution copy matching the depth of the display.
+ * Palette based displays are copied into 32 bits.
+ */
+static pixel_format native_format(gdi_capture* gdi)
+{
+    switch (GetDeviceCaps(gdi->hScreenDC, BITSPIXEL))
+    {
+    case 16:    return PIXEL_RGB565;
+    case 24:    return PIXEL_BGR8;
+    default:    return PIXEL_BGRA8;
+    }
+}
+
+/**
+ * Prepares capturing the specified monitor.
+ *
+ * @param screenWidth The width of the area to capture, starting at the top left corner of the monitor
+ * @param screenHeight The height of the area to capture
+ * @param bitmapWidth The width of the downscaled image
+ * @param bitmapHeight The height of the downscaled image
+ * @param grid Optional, samples the native resolution image instead of downscaling it.
+ *             Its size replaces bitmapWidth and bitmapHeight, it must outlive the capture state.
+ */
+bool gdi_initialize(gdi_capture* gdi, HMONITOR monitor, int screenWidth, int screenHeight,
+                    int bitmapWidth, int bitmapHeight, const sample_grid* grid)
+{
+    memset(gdi, 0, sizeof(*gdi));
+    gdi->screenWidth    = screenWidth;
+    gdi->screenHeight   = screenHeight;
+    gdi->bitmapWidth    = grid ? grid->width  : bitmapWidth;
+    gdi->bitmapHeight   = grid ? grid->height : bitmapHeight;
+    gdi->grid           = grid;
+
+    // A DC of the display device has its origin at the top left corner of the monitor
+    MONITORINFOEX info;
+    info.cbSize = sizeof(MONITORINFOEX);
+    if (!GetMonitorInfo(monitor, &info))
+        return false;
+
+    gdi->hScreenDC = CreateDC(NULL, info.szDevice, NULL, NULL);
+    gdi->hMemoryDC = CreateCompatibleDC(gdi->hScreenDC);
+    if (!gdi->hScreenDC || !gdi->hMemoryDC)
+    {
+        gdi_uninitialize(gdi);
+        return false;
+    }
+
+    // With a sample grid the DIB section holds the native resolution screen, otherwise the downscaled one
+    void* bits = NULL;
+    gdi->nativeFormat   = grid ? native_format(gdi) : PIXEL_BGRA8;
+    gdi->dibWidth       = grid ? screenWidth  : gdi->bitmapWidth;
+    gdi->dibHeight      = grid ? screenHeight : gdi->bitmapHeight;
+    gdi->hBitmap        = create_dib_section(gdi, gdi->dibWidth, gdi->dibHeight, gdi->nativeFormat, &bits);
+    if (!gdi->hBitmap)
+    {
+        gdi_uninitialize(gdi);
+        return false;
+    }
+    if (grid)
+    {
+        gdi->nativeBits     = (const BYTE*) bits;
+        gdi->nativePitch    = dib_pitch(gdi->dibWidth, gdi->nativeFormat);
+        gdi->gather         = sample_grid_kernel(grid, gdi->nativeFormat);
+    }
+    else
+    {
+        gdi->pixels         = (COLORREF*) bits;
+    }
+
+    // The bitmap stays selected, as it is never accessed through GetDIBits
+    gdi->hOldBitmap = (HBITMAP) SelectObject(gdi->hMemoryDC, gdi->hBitmap);
+
+    // Specify the resize mode.
+    // HALFTONE requires the brush origin to be reset afterwards.
+    ::SetStretchBltMode(gdi->hMemoryDC, HALFTONE);
+    ::SetBrushOrgEx(gdi->hMemoryDC, 0, 0, NULL);
+    return true;
+}
+
+/**
+ * Changes the captured area and the size of the downscaled image.
+ * The DIB section is only replaced if its size changes, which also replaces gdi->pixels
+ * (or gdi->nativeBits), so display mode changes do not churn GDI objects.
+ *
+ * @param bitmapWidth The width of the downscaled image, or of the sample grid
+ *                    which the caller already laid out for the new area
+ *
+ * @return false if the new bitmap could not be created, the old state is kept in that case
+ */
+bool gdi_reconfigure(gdi_capture* gdi, int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight)
+{
+    // With a sample grid the DIB section holds the native resolution screen
+    int width   = gdi->grid ? screenWidth  : bitmapWidth;
+    int height  = gdi->grid ? screenHeight : bitmapHeight;
+    if (width != gdi->dibWidth || height != gdi->dibHeight)
+    {
+        void* bits = NULL;
+        HBITMAP hBitmap = create_dib_section(gdi, width, height, gdi->nativeFormat, &bits);
+        if (!hBitmap)
+            return false;
+
+        SelectObject(gdi->hMemoryDC, hBitmap);
+        DeleteObject(gdi->hBitmap);
+        gdi->hBitmap    = hBitmap;
+        gdi->dibWidth   = width;
+        gdi->dibHeight  = height;
+        if (gdi->grid)
+        {
+            gdi->nativeBits     = (const BYTE*) bits;
+            gdi->nativePitch    = dib_pitch(width, gdi->nativeFormat);
+        }
+        else
+        {
+            gdi->pixels         = (COLORREF*) bits;
+        }
+    }
+
+    gdi->screenWidth    = screenWidth;
+    gdi->screenHeight   = screenHeight;
+    gdi->bitmapWidth    = bitmapWidth;
+    gdi->bitmapHeight   = bitmapHeight;
+    return true;
+}
+
+/**
+ * Releases all GDI objects of the specified capture state.
+ */
+void gdi_uninitialize(gdi_capture* gdi)
+{
+    if (gdi->hOldBitmap) SelectObject(gdi->hMemoryDC, gdi->hOldBitmap);
+    if (gdi->hBitmap)    DeleteObject(gdi->hBitmap);
+    if (gdi->hMemoryDC)  DeleteDC(gdi->hMemoryDC);
+    if (gdi->hScreenDC)  DeleteDC(gdi->hScreenDC);
+    gdi->hOldBitmap = NULL;
+    gdi->hBitmap    = NULL;
+    gdi->hMemoryDC  = NULL;
+    gdi->hScreenDC  = NULL;
+    gdi->nativeBits = NULL;
+    gdi->pixels     = NULL;
+}
+
+/**
+ * Copies the screen at native resolution and reads the samples of the grid.
+ */
+static capture_result capture_samples(gdi_capture* gdi, COLORREF* dest, capture_timestamps* timestamps)
+{
+    if (!BitBlt(gdi->hMemoryDC, 0, 0, gdi->screenWidth, gdi->screenHeight, gdi->hScreenDC, 0, 0, SRCCOPY))
+        return CAPTURE_FAILED;
+
+    // Make sure the blit finished before reading the bits of the DIB section
+    GdiFlush();
+    timestamps->copied = stats_now();
+    gdi->gather(gdi->grid, gdi->nativeBits, gdi->nativePitch, (COLOR*) dest);
+    timestamps->readBack = stats_now();
+    return CAPTURE_OK;
+}
+
+/**
+ * Takes a downscaled (or sampled) screenshot and stores it inside the specified buffer,
+ * which must hold bitmapWidth * bitmapHeight pixels.
+ *
+ * Without a sample grid the screenshot is drawn straight into gdi->pixels.
+ * Passing that buffer as destination avoids copying the pixels altogether.
+ *
+ * @param dirtyRows Optional, GDI does not know which rows changed,
+ *                  so every row is flagged as dirty.
+ * @param timestamps Receives the time each step of the capture finished
+ */
+capture_result gdi_capture_frame(gdi_capture* gdi, COLORREF* dest, unsigned char* dirtyRows,
+                                 capture_timestamps* timestamps)
+{
+    if (gdi->grid)
+    {
+        capture_result result = capture_samples(gdi, dest, timestamps);
+        if (result == CAPTURE_OK && dirtyRows)
+            memset(dirtyRows, 1, gdi->bitmapHeight);
+        return result;
+    }
+
+    // Copy and resize the image into the DIB section
+    if (!StretchBlt(gdi->hMemoryDC, 0, 0, gdi->bitmapWidth, gdi->bitmapHeight, gdi->hScreenDC,
+        0, 0, gdi->screenWidth, gdi->screenHeight, SRCCOPY))
+        return CAPTURE_FAILED;
+
+    // Make sure the blit finished before the bits are read
+    GdiFlush();
+    timestamps->copied = stats_now();
+
+    if (dest != gdi->pixels)
+        memcpy(dest, gdi->pixels, gdi->bitmapWidth * gdi->bitmapHeight * sizeof(COLORREF));
+    timestamps->readBack = stats_now();
+
+    if (dirtyRows)
+        memset(dirtyRows, 1, gdi->bitmapHeight);
+    return CAPTURE_OK;
+}
+
+static capture_result capture(void* state, COLORREF* dest, unsigned char* dirtyRows, capture_timestamps* timestamps)
+{
+    return gdi_capture_frame((gdi_capture*) state, dest, dirtyRows, timestamps);
+}
+
+static bool reconfigure(void* state, int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight)
+{
+    return gdi_reconfigure((gdi_capture*) state, screenWidth, screenHeight, bitmapWidth, bitmapHeight);
+}
+
+static void uninitialize(void* state)
+{
+    gdi_uninitialize((gdi_capture*) state);
+}
+
+// GDI does not know what changed, so every row is compared to the last frame
+const capture_interface gdi_interface = { capture, reconfigure, uninitialize, NULL, NULL, false };
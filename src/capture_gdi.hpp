@@ -0,0 +1,53 @@
+/**
+ * LibAmbient - GDI capture backend.
+ *
+ * The screen is downscaled using StretchBlt (HALFTONE) into a DIB section,
+ * whose bits are read in place. With a sample grid the screen is copied
+ * at native resolution into the DIB section and sampled from there.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_CAPTURE_GDI_H
+#define LIB_AMBIENT_CAPTURE_GDI_H
+
+#include <Windows.h>
+#include "capture.hpp"
+#include "sampling.hpp"
+
+// State of a captured monitor
+struct gdi_capture
+{
+    HDC                 hScreenDC;
+    HDC                 hMemoryDC;
+    HBITMAP             hBitmap;        // Top-down 32 bit DIB section, selected into hMemoryDC
+    HBITMAP             hOldBitmap;
+    int                 dibWidth, dibHeight;
+
+    // The bits of hBitmap holding the downscaled screenshot
+    COLORREF*           pixels;
+
+    // Set if the native resolution image is sampled instead of downscaled.
+    // hBitmap has the size of the screen and pixels is NULL in that case.
+    const sample_grid*  grid;
+    const BYTE*         nativeBits;
+    pixel_format        nativeFormat;   // Follows the depth of the display, so the copy needs no conversion
+    int                 nativePitch;
+    sample_gather_fn    gather;
+
+    int     screenWidth, screenHeight;
+    int     bitmapWidth, bitmapHeight;
+};
+
+extern const capture_interface gdi_interface;
+
+bool            gdi_initialize(gdi_capture* gdi, HMONITOR monitor, int screenWidth, int screenHeight,
+                               int bitmapWidth, int bitmapHeight, const sample_grid* grid);
+void            gdi_uninitialize(gdi_capture* gdi);
+bool            gdi_reconfigure(gdi_capture* gdi, int screenWidth, int screenHeight,
+                                int bitmapWidth, int bitmapHeight);
+capture_result  gdi_capture_frame(gdi_capture* gdi, COLORREF* dest, unsigned char* dirtyRows,
+                                  capture_timestamps* timestamps);
+
+#endif
@@ -0,0 +1,121 @@
+/**
+ * LibAmbient - Replay of frames supplied by the caller.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "libambient.hpp"
+#include "capture_replay.hpp"
+#include "stats.hpp"
+#include <string.h>
+
+/**
+ * Initializes the replay of frames of the specified size.
+ *
+ * @param grid Optional, samples the frames instead of downscaling them.
+ *             Its size replaces bitmapWidth and bitmapHeight, it must outlive the replay state.
+ */
+bool replay_initialize(replay_capture* replay, int screenWidth, int screenHeight,
+                       int bitmapWidth, int bitmapHeight, const sample_grid* grid)
+{
+    memset(replay, 0, sizeof(*replay));
+    replay->grid    = grid;
+    replay->gather  = grid ? sample_grid_kernel(grid, PIXEL_BGRA8) : NULL;
+    if (!replay_reconfigure(replay, screenWidth, screenHeight,
+        grid ? grid->width : bitmapWidth, grid ? grid->height : bitmapHeight))
+    {
+        replay_uninitialize(replay);
+        return false;
+    }
+    return true;
+}
+
+void replay_uninitialize(replay_capture* replay)
+{
+    box_filter_uninitialize(&replay->box);
+}
+
+/**
+ * Changes the size of the frames and of the downscaled image.
+ * A frame which was submitted but not captured yet is dropped, as it has the old size.
+ *
+ * @param bitmapWidth The width of the downscaled image, or of the sample grid
+ *                    which the caller already laid out for the new size
+ *
+ * @return false if the buffers could not be grown, the old state is kept in that case
+ */
+bool replay_reconfigure(replay_capture* replay, int screenWidth, int screenHeight,
+                        int bitmapWidth, int bitmapHeight)
+{
+    if (!replay->grid && !box_filter_configure(&replay->box, screenWidth, screenHeight, bitmapWidth, bitmapHeight))
+        return false;
+
+    replay->screenWidth     = screenWidth;
+    replay->screenHeight    = screenHeight;
+    replay->bitmapWidth     = bitmapWidth;
+    replay->bitmapHeight    = bitmapHeight;
+    replay->frame           = NULL;
+    return true;
+}
+
+/**
+ * Makes the specified frame the one read by the next capture.
+ * The pixels are not copied, so they must stay valid until then.
+ *
+ * @param pitch The distance between two rows of the frame in bytes
+ * @param frameTime The time the frame is shown at (see stats_now)
+ */
+void replay_submit(replay_capture* replay, const COLOR* pixels, int pitch, long long frameTime)
+{
+    replay->frame       = pixels;
+    replay->pitch       = pitch;
+    replay->frameTime   = frameTime;
+}
+
+/**
+ * Downscales (or samples) the frame submitted last into the specified buffer,
+ * which must hold bitmapWidth * bitmapHeight pixels.
+ *
+ * @param dirtyRows Optional, every row is marked as dirty, as nothing is known about the frames
+ *
+ * @return CAPTURE_UNCHANGED if no frame was submitted since the last call
+ */
+capture_result replay_capture_frame(replay_capture* replay, COLORREF* dest, unsigned char* dirtyRows,
+                                    capture_timestamps* timestamps)
+{
+    if (!replay->frame)
+        return CAPTURE_UNCHANGED;
+
+    const unsigned char* frame = (const unsigned char*) replay->frame;
+    replay->frame = NULL;
+    timestamps->copied = stats_now();
+
+    if (replay->grid)
+        replay->gather(replay->grid, frame, replay->pitch, (COLOR*) dest);
+    else
+        box_filter_apply(&replay->box, frame, replay->pitch, (COLOR*) dest);
+
+    if (dirtyRows)
+        memset(dirtyRows, 1, replay->bitmapHeight);
+    timestamps->readBack = stats_now();
+    return CAPTURE_OK;
+}
+
+static capture_result capture(void* state, COLORREF* dest, unsigned char* dirtyRows, capture_timestamps* timestamps)
+{
+    return replay_capture_frame((replay_capture*) state, dest, dirtyRows, timestamps);
+}
+
+static bool reconfigure(void* state, int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight)
+{
+    return replay_reconfigure((replay_capture*) state, screenWidth, screenHeight, bitmapWidth, bitmapHeight);
+}
+
+static void uninitialize(void* state)
+{
+    replay_uninitialize((replay_capture*) state);
+}
+
+// Nothing is known about the frames, so every row is compared to the last frame
+const capture_interface replay_interface = { capture, reconfigure, uninitialize, NULL, NULL, false };
@@ -0,0 +1,48 @@
+/**
+ * LibAmbient - Replay of frames supplied by the caller.
+ *
+ * Instead of capturing the screen, each capture reads the frame submitted last
+ * (e.g. from a video or a frame dump, see ambient_open_dump) and downscales it
+ * with a box filter or samples it like a native resolution screenshot.
+ * Nothing waits for a display, so frames are processed as fast as they are submitted.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_CAPTURE_REPLAY_H
+#define LIB_AMBIENT_CAPTURE_REPLAY_H
+
+#include "capture.hpp"
+#include "sampling.hpp"
+
+// State of a replayed sequence of frames
+struct replay_capture
+{
+    // Set if the frames are sampled instead of downscaled
+    const sample_grid*  grid;
+    sample_gather_fn    gather;
+
+    box_filter          box;            // Downscales the frames if they are not sampled
+
+    // The frame submitted last, NULL once it was captured
+    const COLOR*        frame;
+    int                 pitch;
+    long long           frameTime;      // Time of the frame on the clock of stats_now
+
+    int     screenWidth, screenHeight;
+    int     bitmapWidth, bitmapHeight;
+};
+
+extern const capture_interface replay_interface;
+
+bool            replay_initialize(replay_capture* replay, int screenWidth, int screenHeight,
+                                  int bitmapWidth, int bitmapHeight, const sample_grid* grid);
+void            replay_uninitialize(replay_capture* replay);
+bool            replay_reconfigure(replay_capture* replay, int screenWidth, int screenHeight,
+                                   int bitmapWidth, int bitmapHeight);
+void            replay_submit(replay_capture* replay, const COLOR* pixels, int pitch, long long frameTime);
+capture_result  replay_capture_frame(replay_capture* replay, COLORREF* dest, unsigned char* dirtyRows,
+                                     capture_timestamps* timestamps);
+
+#endif
@@ -0,0 +1,701 @@
+/**
+ * LibAmbient - X11 capture backend.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "libambient.hpp"
+#include "capture_x11.hpp"
+#include "stats.hpp"
+#include <X11/Xatom.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <mutex>
+#ifdef AMBIENT_HAVE_XRANDR
+    #include <X11/extensions/Xrandr.h>
+#endif
+
+#define X11_MAX_MONITORS 32
+
+// Xlib is made thread safe and the error handler is installed once for all connections
+static std::once_flag   g_x11Initialized;
+static XErrorHandler    g_previousErrorHandler;
+
+// Errors of the connection which is trapped on the calling thread (see trap_errors)
+static thread_local Display*    t_trappedDisplay;
+static thread_local int         t_trappedError;
+
+// Connection used to enumerate the monitors, shared by all contexts.
+// It watches the root window, so the monitors are only queried again once they changed.
+struct monitor_connection
+{
+    std::mutex      lock;
+    Display*        display;
+    bool            opened;         // Set once opening the display was attempted
+    int             randrEvent;     // Event base of RandR, -1 without
+    bool            changed;
+    monitor_info    monitors[X11_MAX_MONITORS];
+    int             count;
+
+    // Properties of the window manager (EWMH) describing the foreground window, None if there is none
+    Atom            activeWindow;
+    Atom            wmState;
+    Atom            wmStateFullscreen;
+};
+
+static monitor_connection g_monitors;
+
+/**
+ * Records the errors of a trapped connection instead of terminating the process,
+ * which the default handler does. Errors of other connections (e.g. those of the application)
+ * are passed on to the handler which was installed before.
+ */
+static int handle_error(Display* display, XErrorEvent* event)
+{
+    if (display == t_trappedDisplay)
+    {
+        t_trappedError = event->error_code;
+        return 0;
+    }
+    return g_previousErrorHandler ? g_previousErrorHandler(display, event) : 0;
+}
+
+/**
+ * Makes Xlib thread safe, as every context has a connection of its own which may be used on any thread.
+ * Xlib (since 1.8) does this on its own before the first connection is opened.
+ */
+static void initialize_x11()
+{
+    XInitThreads();
+    g_previousErrorHandler = XSetErrorHandler(handle_error);
+}
+
+/**
+ * Starts recording the errors of the specified connection on the calling thread.
+ */
+static void trap_errors(Display* display)
+{
+    t_trappedDisplay    = display;
+    t_trappedError      = 0;
+}
+
+/**
+ * Stops recording errors.
+ *
+ * @param sync Waits until the server processed all requests, so errors of requests without a reply arrive
+ *
+ * @return The last error which occurred since trap_errors, 0 if there was none
+ */
+static int untrap_errors(Display* display, bool sync)
+{
+    if (sync)
+        XSync(display, False);
+    t_trappedDisplay = NULL;
+    return t_trappedError;
+}
+
+/**
+ * Queries the monitors of the shared connection, the primary monitor comes first.
+ * Without RandR the whole root window is the only monitor.
+ */
+static void query_monitors(monitor_connection* connection)
+{
+    Display* display = connection->display;
+    Window root = DefaultRootWindow(display);
+    connection->count = 0;
+
+#ifdef AMBIENT_HAVE_XRANDR
+    int count = 0;
+    XRRMonitorInfo* monitors = connection->randrEvent >= 0 ? XRRGetMonitors(display, root, True, &count) : NULL;
+    for (int i = 0; i < count && connection->count < X11_MAX_MONITORS; i++)
+    {
+        monitor_info* dest = connection->monitors + connection->count++;
+        if (monitors[i].primary && dest != connection->monitors)
+        {
+            memmove(connection->monitors + 1, connection->monitors, (dest - connection->monitors) * sizeof(monitor_info));
+            dest = connection->monitors;
+        }
+        dest->handle    = NULL;
+        dest->x         = monitors[i].x;
+        dest->y         = monitors[i].y;
+        dest->width     = monitors[i].width;
+        dest->height    = monitors[i].height;
+    }
+    if (monitors)
+        XRRFreeMonitors(monitors);
+    if (connection->count > 0)
+        return;
+#endif
+
+    XWindowAttributes attributes;
+    if (!XGetWindowAttributes(display, root, &attributes))
+        return;
+    monitor_info* dest = connection->monitors;
+    dest->handle    = NULL;
+    dest->x         = 0;
+    dest->y         = 0;
+    dest->width     = attributes.width;
+    dest->height    = attributes.height;
+    connection->count = 1;
+}
+
+/**
+ * Opens the shared connection on first use and queries the monitors again if they changed.
+ * The lock of the connection must be held.
+ *
+ * @return false if there is no display to connect to
+ */
+static bool update_monitors(monitor_connection* connection)
+{
+    if (!connection->opened)
+    {
+        std::call_once(g_x11Initialized, initialize_x11);
+        connection->opened      = true;
+        connection->randrEvent  = -1;
+        connection->display     = XOpenDisplay(NULL);
+        if (!connection->display)
+        {
+            dbgErr("==> Failed to connect to the X server");
+            return false;
+        }
+
+        connection->activeWindow        = XInternAtom(connection->display, "_NET_ACTIVE_WINDOW", True);
+        connection->wmState             = XInternAtom(connection->display, "_NET_WM_STATE", True);
+        connection->wmStateFullscreen   = XInternAtom(connection->display, "_NET_WM_STATE_FULLSCREEN", True);
+
+        // A resize of the root window (or a change of the RandR configuration) is reported as an event
+        Window root = DefaultRootWindow(connection->display);
+        XSelectInput(connection->display, root, StructureNotifyMask);
+#ifdef AMBIENT_HAVE_XRANDR
+        int errorBase;
+        if (XRRQueryExtension(connection->display, &connection->randrEvent, &errorBase))
+            XRRSelectInput(connection->display, root, RRScreenChangeNotifyMask);
+        else
+            connection->randrEvent = -1;
+#endif
+        connection->changed = true;
+    }
+    if (!connection->display)
+        return false;
+
+    // Only reads the events which arrived, so this is cheap enough for every frame
+    Display* display = connection->display;
+    while (XPending(display))
+    {
+        XEvent event;
+        XNextEvent(display, &event);
+        if (event.type == ConfigureNotify)
+            connection->changed = true;
+#ifdef AMBIENT_HAVE_XRANDR
+        if (connection->randrEvent >= 0 && event.type == connection->randrEvent + RRScreenChangeNotify)
+        {
+            XRRUpdateConfiguration(&event);
+            connection->changed = true;
+        }
+#endif
+    }
+
+    if (connection->changed)
+    {
+        query_monitors(connection);
+        connection->changed = false;
+    }
+    return true;
+}
+
+/**
+ * Returns the amount of monitors of the X screen, 0 if there is no X server.
+ */
+int monitor_count()
+{
+    std::lock_guard<std::mutex> lock(g_monitors.lock);
+    return update_monitors(&g_monitors) ? g_monitors.count : 0;
+}
+
+/**
+ * Looks up the monitor with the specified index, where 0 is the primary monitor.
+ *
+ * @param dest Receives the area of the monitor on the root window, there is no handle
+ *
+ * @return false if there is no such monitor
+ */
+bool monitor_find(int monitorIndex, monitor_info* dest)
+{
+    std::lock_guard<std::mutex> lock(g_monitors.lock);
+    if (!update_monitors(&g_monitors) || monitorIndex < 0 || monitorIndex >= g_monitors.count)
+        return false;
+    *dest = g_monitors.monitors[monitorIndex];
+    return true;
+}
+
+/**
+ * Updates the area of a monitor found with monitor_find.
+ * The monitors are only queried again if the X server reported a change.
+ *
+ * @return false if the monitor does not exist anymore
+ */
+bool monitor_update(int monitorIndex, monitor_info* monitor)
+{
+    return monitor_find(monitorIndex, monitor);
+}
+
+/**
+ * Reads a property of a window which consists of 32 bit values (e.g. windows or atoms).
+ *
+ * @return The values, release them using XFree. NULL if the window does not have the property.
+ */
+static long* get_property(Display* display, Window window, Atom property, Atom type, unsigned long* count)
+{
+    Atom actualType;
+    int format;
+    unsigned long remaining;
+    unsigned char* data = NULL;
+    if (XGetWindowProperty(display, window, property, 0, 1024, False, type, &actualType, &format,
+        count, &remaining, &data) != Success || !data)
+        return NULL;
+    if (actualType != type || format != 32)
+    {
+        XFree(data);
+        return NULL;
+    }
+    return (long*) data;
+}
+
+/**
+ * Determines whether the active window is a fullscreen window on the specified monitor.
+ * X11 has no exclusive fullscreen, but a fullscreen game competes with the capture the same way.
+ * This needs a window manager which follows EWMH, window managers which do not are never contended.
+ */
+bool monitor_fullscreen(const monitor_info* monitor)
+{
+    std::lock_guard<std::mutex> lock(g_monitors.lock);
+    if (!update_monitors(&g_monitors) || g_monitors.activeWindow == None
+        || g_monitors.wmState == None || g_monitors.wmStateFullscreen == None)
+        return false;
+
+    // The active window may be destroyed at any time, which must not terminate the process
+    Display* display = g_monitors.display;
+    Window root = DefaultRootWindow(display);
+    trap_errors(display);
+    unsigned long count = 0;
+    Window active = None;
+    long* windows = get_property(display, root, g_monitors.activeWindow, XA_WINDOW, &count);
+    if (windows)
+    {
+        active = count > 0 ? (Window) windows[0] : None;
+        XFree(windows);
+    }
+
+    bool fullscreen = false;
+    long* states = active != None ? get_property(display, active, g_monitors.wmState, XA_ATOM, &count) : NULL;
+    if (states)
+    {
+        for (unsigned long i = 0; i < count; i++)
+            fullscreen |= (Atom) states[i] == g_monitors.wmStateFullscreen;
+        XFree(states);
+    }
+
+    // The window belongs to the monitor its center is on
+    XWindowAttributes attributes;
+    int x, y;
+    Window child;
+    if (fullscreen)
+    {
+        fullscreen = XGetWindowAttributes(display, active, &attributes)
+            && XTranslateCoordinates(display, active, root, attributes.width / 2, attributes.height / 2,
+                &x, &y, &child)
+            && x >= monitor->x && x < monitor->x + monitor->width
+            && y >= monitor->y && y < monitor->y + monitor->height;
+    }
+    return !untrap_errors(display, false) && fullscreen;
+}
+
+/**
+ * Determines the pixel format of the images of the display.
+ *
+ * @return false if the format is not supported, e.g. an indexed visual
+ */
+static bool native_format(Display* display, pixel_format* format)
+{
+    int screen = DefaultScreen(display);
+    XImage* probe = XCreateImage(display, DefaultVisual(display, screen), DefaultDepth(display, screen),
+        ZPixmap, 0, NULL, 1, 1, 32, 0);
+    if (!probe)
+        return false;
+
+    bool supported = probe->byte_order == LSBFirst;
+    if (probe->bits_per_pixel == 32 || probe->bits_per_pixel == 24)
+    {
+        supported &= probe->red_mask == 0xff0000 && probe->green_mask == 0xff00 && probe->blue_mask == 0xff;
+        *format = probe->bits_per_pixel == 32 ? PIXEL_BGRA8 : PIXEL_BGR8;
+    }
+    else if (probe->bits_per_pixel == 16)
+    {
+        supported &= probe->red_mask == 0xf800 && probe->green_mask == 0x07e0 && probe->blue_mask == 0x001f;
+        *format = PIXEL_RGB565;
+    }
+    else
+    {
+        supported = false;
+    }
+    XDestroyImage(probe);
+    return supported;
+}
+
+static void release_image(x11_capture* x11, XImage* image, XShmSegmentInfo* shm)
+{
+    if (shm->shmaddr)
+    {
+        XShmDetach(x11->display, shm);
+        shmdt(shm->shmaddr);
+        shm->shmaddr = NULL;
+    }
+    if (image)
+    {
+        // The data is the shared memory segment, which was detached already
+        image->data = NULL;
+        XDestroyImage(image);
+    }
+}
+
+/**
+ * Creates a shared memory image of the specified size, which the X server copies the screen into.
+ *
+ * @return false if the server does not share memory with us (e.g. a remote display)
+ */
+static bool create_image(x11_capture* x11, int width, int height, XImage** image, XShmSegmentInfo* shm)
+{
+    Display* display = x11->display;
+    int screen = DefaultScreen(display);
+    memset(shm, 0, sizeof(*shm));
+    *image = XShmCreateImage(display, DefaultVisual(display, screen), DefaultDepth(display, screen),
+        ZPixmap, NULL, shm, width, height);
+    if (!*image)
+        return false;
+
+    shm->shmid = shmget(IPC_PRIVATE, (size_t) (*image)->bytes_per_line * height, IPC_CREAT | 0600);
+    if (shm->shmid < 0)
+    {
+        XDestroyImage(*image);
+        *image = NULL;
+        return false;
+    }
+    shm->shmaddr = (char*) shmat(shm->shmid, NULL, 0);
+    if (shm->shmaddr == (char*) -1)
+        shm->shmaddr = NULL;
+    (*image)->data  = shm->shmaddr;
+    shm->readOnly   = False;
+
+    // Attaching fails on servers which can not access the segment, which is reported as an error
+    bool attached = false;
+    if (shm->shmaddr)
+    {
+        trap_errors(display);
+        attached = XShmAttach(display, shm) != 0;
+        attached = untrap_errors(display, true) == 0 && attached;
+    }
+
+    // The segment is destroyed as soon as both sides detached it
+    shmctl(shm->shmid, IPC_RMID, NULL);
+    if (!attached)
+    {
+        if (shm->shmaddr)
+            shmdt(shm->shmaddr);
+        shm->shmaddr = NULL;
+        (*image)->data = NULL;
+        XDestroyImage(*image);
+        *image = NULL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Prepares capturing the specified monitor.
+ *
+ * @param screenWidth The width of the area to capture, starting at the top left corner of the monitor
+ * @param grid Optional, samples the screen at native resolution instead of downscaling it.
+ *             Its size replaces bitmapWidth and bitmapHeight, it must outlive the capture state.
+ *
+ * @return false if there is no X server or its pixel format is not supported
+ */
+bool x11_initialize(x11_capture* x11, const monitor_info* monitor, int screenWidth, int screenHeight,
+                    int bitmapWidth, int bitmapHeight, const sample_grid* grid)
+{
+    std::call_once(g_x11Initialized, initialize_x11);
+    memset(x11, 0, sizeof(*x11));
+    x11->originX    = monitor->x;
+    x11->originY    = monitor->y;
+    x11->grid       = grid;
+    x11->display    = XOpenDisplay(NULL);
+    if (!x11->display)
+        return false;
+    x11->root = DefaultRootWindow(x11->display);
+
+    // The box filter only averages 32 bit pixels, the samples are read in any format
+    if (!native_format(x11->display, &x11->format) || (!grid && x11->format != PIXEL_BGRA8))
+    {
+        dbgErr("==> Unsupported pixel format of the X server");
+        x11_uninitialize(x11);
+        return false;
+    }
+    x11->gather = grid ? sample_grid_kernel(grid, x11->format) : NULL;
+
+    // The image itself is created by the reconfiguration below
+    x11->shared = XShmQueryExtension(x11->display);
+
+#ifdef AMBIENT_HAVE_XDAMAGE
+    // A single damage object covers the whole root window and is clipped to the monitor when read
+    int version, errorBase;
+    if (XDamageQueryExtension(x11->display, &x11->damageEvent, &errorBase)
+        && XDamageQueryVersion(x11->display, &version, &errorBase) && version >= 1)
+    {
+        x11->damage = XDamageCreate(x11->display, x11->root, XDamageReportNonEmpty);
+        x11->region = XFixesCreateRegion(x11->display, NULL, 0);
+    }
+#endif
+
+    if (!x11_reconfigure(x11, screenWidth, screenHeight,
+        grid ? grid->width : bitmapWidth, grid ? grid->height : bitmapHeight))
+    {
+        x11_uninitialize(x11);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Changes the captured area and the size of the downscaled image.
+ * The next frame is reported as completely dirty.
+ *
+ * @return false if the image could not be recreated, the old state is kept in that case
+ */
+bool x11_reconfigure(x11_capture* x11, int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight)
+{
+    // The old image is only released once everything for the new size was allocated
+    bool resized = screenWidth != x11->screenWidth || screenHeight != x11->screenHeight;
+    XImage* image = NULL;
+    XShmSegmentInfo shm;
+    memset(&shm, 0, sizeof(shm));
+    if (resized && x11->shared && !create_image(x11, screenWidth, screenHeight, &image, &shm))
+    {
+        // Without a previous image there is nothing to keep, the frames are transferred instead
+        if (x11->image)
+            return false;
+        dbgInfo("==> Shared memory not available, transferring the images");
+        x11->shared = false;
+    }
+
+    if (!x11->grid && !box_filter_configure(&x11->box, screenWidth, screenHeight, bitmapWidth, bitmapHeight))
+    {
+        release_image(x11, image, &shm);
+        return false;
+    }
+
+    if (image)
+    {
+        release_image(x11, x11->image, &x11->shm);
+        x11->image  = image;
+        x11->shm    = shm;
+    }
+
+    x11->screenWidth    = screenWidth;
+    x11->screenHeight   = screenHeight;
+    x11->bitmapWidth    = bitmapWidth;
+    x11->bitmapHeight   = bitmapHeight;
+    x11->hasFrame       = false;
+    return true;
+}
+
+/**
+ * Releases the image and closes the connection of the specified capture state.
+ */
+void x11_uninitialize(x11_capture* x11)
+{
+    if (x11->display)
+    {
+        release_image(x11, x11->image, &x11->shm);
+#ifdef AMBIENT_HAVE_XDAMAGE
+        if (x11->region)
+            XFixesDestroyRegion(x11->display, x11->region);
+        if (x11->damage)
+            XDamageDestroy(x11->display, x11->damage);
+#endif
+        XCloseDisplay(x11->display);
+    }
+    box_filter_uninitialize(&x11->box);
+    x11->image      = NULL;
+    x11->display    = NULL;
+}
+
+#ifdef AMBIENT_HAVE_XDAMAGE
+/**
+ * Reads the events of the connection, waiting up to the frame timeout for damage.
+ */
+static void wait_for_damage(x11_capture* x11)
+{
+    int timeoutMs = (int) x11->frameTimeoutMs;
+    for (;;)
+    {
+        while (XPending(x11->display))
+        {
+            XEvent event;
+            XNextEvent(x11->display, &event);
+            if (event.type == x11->damageEvent + XDamageNotify)
+                x11->damaged = true;
+        }
+        if (x11->damaged || timeoutMs <= 0)
+            return;
+
+        pollfd events = { ConnectionNumber(x11->display), POLLIN, 0 };
+        if (poll(&events, 1, timeoutMs) <= 0)
+            return;
+        timeoutMs = 0;
+    }
+}
+
+/**
+ * Takes the damage drawn since the last capture and marks the rows of the downscaled image it covers.
+ *
+ * @return false if nothing was drawn on the captured area
+ */
+static bool take_damage(x11_capture* x11, unsigned char* dirtyRows)
+{
+    XDamageSubtract(x11->display, x11->damage, None, x11->region);
+    x11->damaged = false;
+
+    int count = 0;
+    XRectangle* rects = XFixesFetchRegion(x11->display, x11->region, &count);
+    bool damaged = false;
+    if (dirtyRows)
+        memset(dirtyRows, 0, x11->bitmapHeight);
+    for (int i = 0; i < count; i++)
+    {
+        int x0 = rects[i].x - x11->originX, x1 = x0 + rects[i].width;
+        int y0 = rects[i].y - x11->originY, y1 = y0 + rects[i].height;
+        if (x1 <= 0 || y1 <= 0 || x0 >= x11->screenWidth || y0 >= x11->screenHeight)
+            continue;
+        damaged = true;
+        if (!dirtyRows)
+            continue;
+
+        // Rows of the grid cells, or of the boxes of the filter, the damaged rows fall into
+        if (y0 < 0)                 y0 = 0;
+        if (y1 > x11->screenHeight) y1 = x11->screenHeight;
+        int first, last;
+        if (x11->grid)
+        {
+            first   = y0 / x11->grid->strideY;
+            last    = (y1 + x11->grid->strideY - 1) / x11->grid->strideY;
+        }
+        else
+        {
+            first   = (int) ((long long) y0 * x11->bitmapHeight / x11->screenHeight);
+            last    = (int) (((long long) y1 * x11->bitmapHeight + x11->screenHeight - 1) / x11->screenHeight);
+        }
+        if (last > x11->bitmapHeight)
+            last = x11->bitmapHeight;
+        if (first < last)
+            memset(dirtyRows + first, 1, last - first);
+    }
+    if (rects)
+        XFree(rects);
+    return damaged;
+}
+#endif
+
+/**
+ * Copies the captured area and downscales (or samples) it into the specified buffer,
+ * which must hold bitmapWidth * bitmapHeight pixels.
+ *
+ * @param dirtyRows Optional, receives the rows which were drawn on.
+ *                  Without the DAMAGE extension every row is flagged as dirty.
+ *
+ * @return CAPTURE_UNCHANGED if nothing was drawn on the monitor since the last call
+ */
+capture_result x11_capture_frame(x11_capture* x11, COLORREF* dest, unsigned char* dirtyRows,
+                                 capture_timestamps* timestamps)
+{
+    bool damageRows = false;
+#ifdef AMBIENT_HAVE_XDAMAGE
+    // Damage drawn during the copy is subtracted by the next capture, so nothing is lost.
+    // The first frame after a reconfiguration is reported as completely dirty.
+    if (x11->damage)
+    {
+        if (x11->hasFrame)
+            wait_for_damage(x11);
+        if (x11->hasFrame && !x11->damaged)
+            return CAPTURE_UNCHANGED;
+        if (!take_damage(x11, x11->hasFrame ? dirtyRows : NULL) && x11->hasFrame)
+            return CAPTURE_UNCHANGED;
+        damageRows = x11->hasFrame;
+    }
+#endif
+
+    // Requests on a monitor which shrank in the meantime fail, which is noticed by the next capture
+    XImage* image = x11->image;
+    trap_errors(x11->display);
+    if (x11->shared)
+    {
+        if (!XShmGetImage(x11->display, x11->root, image, x11->originX, x11->originY, AllPlanes))
+            image = NULL;
+    }
+    else
+    {
+        image = XGetImage(x11->display, x11->root, x11->originX, x11->originY,
+            x11->screenWidth, x11->screenHeight, AllPlanes, ZPixmap);
+    }
+    untrap_errors(x11->display, false);
+    if (!image)
+        return CAPTURE_FAILED;
+    timestamps->copied = stats_now();
+
+    const unsigned char* surface = (const unsigned char*) image->data;
+    if (x11->grid)
+        x11->gather(x11->grid, surface, image->bytes_per_line, (COLOR*) dest);
+    else
+        box_filter_apply(&x11->box, surface, image->bytes_per_line, (COLOR*) dest);
+    if (!x11->shared)
+        XDestroyImage(image);
+    timestamps->readBack = stats_now();
+
+    if (dirtyRows && !damageRows)
+        memset(dirtyRows, 1, x11->bitmapHeight);
+    x11->hasFrame = true;
+    return CAPTURE_OK;
+}
+
+static capture_result capture(void* state, COLORREF* dest, unsigned char* dirtyRows, capture_timestamps* timestamps)
+{
+    return x11_capture_frame((x11_capture*) state, dest, dirtyRows, timestamps);
+}
+
+static bool reconfigure(void* state, int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight)
+{
+    return x11_reconfigure((x11_capture*) state, screenWidth, screenHeight, bitmapWidth, bitmapHeight);
+}
+
+static void uninitialize(void* state)
+{
+    x11_uninitialize((x11_capture*) state);
+}
+
+// Without damage every capture copies the screen, so there is nothing to wait for
+static bool set_frame_timeout(void* state, unsigned int timeoutMs)
+{
+    x11_capture* x11 = (x11_capture*) state;
+#ifdef AMBIENT_HAVE_XDAMAGE
+    x11->frameTimeoutMs = timeoutMs;
+    return x11->damage != 0;
+#else
+    (void) x11;
+    (void) timeoutMs;
+    return false;
+#endif
+}
+
+// The damage covers whatever was drawn, not only what changed, so the dirty rows are compared to the last frame
+const capture_interface x11_interface = { capture, reconfigure, uninitialize, NULL, set_frame_timeout, false };
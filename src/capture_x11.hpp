@@ -0,0 +1,71 @@
+/**
+ * LibAmbient - X11 capture backend.
+ *
+ * The captured area of the root window is copied into a shared memory image
+ * (MIT-SHM), so the pixels never pass through the connection to the X server,
+ * and downscaled with a box filter or sampled in place. Servers which do not
+ * share memory (e.g. remote displays) transfer the image with XGetImage instead.
+ * With the DAMAGE extension, frames in which nothing was drawn are not copied
+ * at all and only the damaged rows are reported as dirty.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_CAPTURE_X11_H
+#define LIB_AMBIENT_CAPTURE_X11_H
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#ifdef AMBIENT_HAVE_XDAMAGE
+    #include <X11/extensions/Xdamage.h>
+#endif
+#include "capture.hpp"
+#include "sampling.hpp"
+
+// State of a captured monitor, each with a connection of its own
+struct x11_capture
+{
+    Display*            display;
+    Window              root;
+    int                 originX, originY;   // Top left corner of the monitor on the root window
+
+    // Native resolution image of the captured area
+    XImage*             image;
+    XShmSegmentInfo     shm;
+    bool                shared;             // The image is in shared memory, otherwise it is replaced by every capture
+    pixel_format        format;
+
+    // Set if the image is sampled instead of downscaled
+    const sample_grid*  grid;
+    sample_gather_fn    gather;
+    box_filter          box;
+
+#ifdef AMBIENT_HAVE_XDAMAGE
+    // Area drawn since the last capture, the damage is 0 if the server does not support it
+    Damage              damage;
+    int                 damageEvent;        // Event base of the extension
+    XserverRegion       region;
+    bool                damaged;
+#endif
+    bool                hasFrame;
+
+    // Time to wait for damage once the first frame was captured, 0 polls without waiting
+    unsigned int        frameTimeoutMs;
+
+    int     screenWidth, screenHeight;
+    int     bitmapWidth, bitmapHeight;
+};
+
+extern const capture_interface x11_interface;
+
+bool            x11_initialize(x11_capture* x11, const monitor_info* monitor, int screenWidth, int screenHeight,
+                               int bitmapWidth, int bitmapHeight, const sample_grid* grid);
+void            x11_uninitialize(x11_capture* x11);
+bool            x11_reconfigure(x11_capture* x11, int screenWidth, int screenHeight,
+                                int bitmapWidth, int bitmapHeight);
+capture_result  x11_capture_frame(x11_capture* x11, COLORREF* dest, unsigned char* dirtyRows,
+                                  capture_timestamps* timestamps);
+
+#endif
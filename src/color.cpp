@@ -0,0 +1,204 @@
+/**
+ * LibAmbient - Batch conversion between RGB and HSB.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "color.hpp"
+#include "reduce.hpp"
+#include <math.h>
+
+#ifdef AMBIENT_X86
+    #include <emmintrin.h>
+#endif
+
+/**
+ * Converts a single color, without branches depending on the channel values.
+ * Matches RGBtoHSB up to float rounding, but takes the color as 0xAARRGGBB.
+ */
+static inline void rgb_to_hsb_single(COLOR color, float* hue, float* saturation, float* brightness)
+{
+    float r = (float) ((color >> 16) & 0xff);
+    float g = (float) ((color >> 8) & 0xff);
+    float b = (float) (color & 0xff);
+
+    float cmax  = fmaxf(r, fmaxf(g, b));
+    float cmin  = fminf(r, fminf(g, b));
+    float delta = cmax - cmin;
+    float inv   = 1.0f / fmaxf(delta, 1.0f);
+
+    // The first channel holding the maximum selects the sector
+    float h = r == cmax ? (g - b) * inv
+            : g == cmax ? 2.0f + (b - r) * inv
+            :             4.0f + (r - g) * inv;
+    h *= 1.0f / 6.0f;
+    h += h < 0 ? 1.0f : 0.0f;
+
+    *hue        = delta > 0 ? h : 0.0f;
+    *saturation = delta / fmaxf(cmax, 1.0f);
+    *brightness = cmax * (1.0f / 255.0f);
+}
+
+static inline COLOR hsb_to_rgb_single(float hue, float saturation, float brightness)
+{
+    float h = (hue - floorf(hue)) * 6.0f;
+    float sector = floorf(h);
+    float f = h - sector;
+    int   i = sector < 5.0f ? (int) sector : 5;
+
+    float v = brightness;
+    float p = brightness * (1.0f - saturation);
+    float q = brightness * (1.0f - saturation * f);
+    float t = brightness * (1.0f - saturation * (1.0f - f));
+
+    // Channels of each sector, indexed by [sector][channel]
+    const float channels[6][3] =
+    {
+        { v, t, p }, { q, v, p }, { p, v, t },
+        { p, q, v }, { t, p, v }, { v, p, q }
+    };
+    int r = (int) (channels[i][0] * 255.0f + 0.5f);
+    int g = (int) (channels[i][1] * 255.0f + 0.5f);
+    int b = (int) (channels[i][2] * 255.0f + 0.5f);
+    return 0xff000000 | (r << 16) | (g << 8) | (b << 0);
+}
+
+void rgb_to_hsb_batch_scalar(const COLOR* colors, float* hue, float* saturation, float* brightness, int count)
+{
+    for (int i = 0; i < count; i++)
+        rgb_to_hsb_single(colors[i], &hue[i], &saturation[i], &brightness[i]);
+}
+
+void hsb_to_rgb_batch_scalar(const float* hue, const float* saturation, const float* brightness,
+                             COLOR* dest, int count)
+{
+    for (int i = 0; i < count; i++)
+        dest[i] = hsb_to_rgb_single(hue[i], saturation[i], brightness[i]);
+}
+
+#ifdef AMBIENT_X86
+
+static inline __m128 select_ps(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// SSE2 has no rounding instructions, so the fraction is split off using a truncating conversion
+static inline __m128 floor_ps(__m128 x)
+{
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+}
+
+static void rgb_to_hsb_batch_sse2(const COLOR* colors, float* hue, float* saturation, float* brightness, int count)
+{
+    const __m128i channelMask = _mm_set1_epi32(0xff);
+    const __m128  zero  = _mm_setzero_ps();
+    const __m128  one   = _mm_set1_ps(1.0f);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i*) (colors + i));
+        __m128 r = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 16), channelMask));
+        __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 8), channelMask));
+        __m128 b = _mm_cvtepi32_ps(_mm_and_si128(pixels, channelMask));
+
+        __m128 cmax  = _mm_max_ps(r, _mm_max_ps(g, b));
+        __m128 cmin  = _mm_min_ps(r, _mm_min_ps(g, b));
+        __m128 delta = _mm_sub_ps(cmax, cmin);
+        __m128 inv   = _mm_div_ps(one, _mm_max_ps(delta, one));
+
+        __m128 isRed    = _mm_cmpeq_ps(r, cmax);
+        __m128 isGreen  = _mm_cmpeq_ps(g, cmax);
+        __m128 hRed     = _mm_mul_ps(_mm_sub_ps(g, b), inv);
+        __m128 hGreen   = _mm_add_ps(_mm_set1_ps(2.0f), _mm_mul_ps(_mm_sub_ps(b, r), inv));
+        __m128 hBlue    = _mm_add_ps(_mm_set1_ps(4.0f), _mm_mul_ps(_mm_sub_ps(r, g), inv));
+        __m128 h = select_ps(isRed, hRed, select_ps(isGreen, hGreen, hBlue));
+        h = _mm_mul_ps(h, _mm_set1_ps(1.0f / 6.0f));
+        h = _mm_add_ps(h, _mm_and_ps(_mm_cmplt_ps(h, zero), one));
+        h = _mm_and_ps(h, _mm_cmpgt_ps(delta, zero));
+
+        _mm_storeu_ps(hue + i, h);
+        _mm_storeu_ps(saturation + i, _mm_div_ps(delta, _mm_max_ps(cmax, one)));
+        _mm_storeu_ps(brightness + i, _mm_mul_ps(cmax, _mm_set1_ps(1.0f / 255.0f)));
+    }
+    rgb_to_hsb_batch_scalar(colors + i, hue + i, saturation + i, brightness + i, count - i);
+}
+
+static void hsb_to_rgb_batch_sse2(const float* hue, const float* saturation, const float* brightness,
+                                  COLOR* dest, int count)
+{
+    const __m128 one    = _mm_set1_ps(1.0f);
+    const __m128 scale  = _mm_set1_ps(255.0f);
+    const __m128 half   = _mm_set1_ps(0.5f);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 hIn = _mm_loadu_ps(hue + i);
+        __m128 s   = _mm_loadu_ps(saturation + i);
+        __m128 v   = _mm_loadu_ps(brightness + i);
+
+        __m128 h      = _mm_mul_ps(_mm_sub_ps(hIn, floor_ps(hIn)), _mm_set1_ps(6.0f));
+        __m128 sector = _mm_min_ps(floor_ps(h), _mm_set1_ps(5.0f));
+        __m128 f      = _mm_sub_ps(h, floor_ps(h));
+
+        __m128 p = _mm_mul_ps(v, _mm_sub_ps(one, s));
+        __m128 q = _mm_mul_ps(v, _mm_sub_ps(one, _mm_mul_ps(s, f)));
+        __m128 t = _mm_mul_ps(v, _mm_sub_ps(one, _mm_mul_ps(s, _mm_sub_ps(one, f))));
+
+        __m128 s0 = _mm_cmpeq_ps(sector, _mm_setzero_ps());
+        __m128 s1 = _mm_cmpeq_ps(sector, one);
+        __m128 s2 = _mm_cmpeq_ps(sector, _mm_set1_ps(2.0f));
+        __m128 s3 = _mm_cmpeq_ps(sector, _mm_set1_ps(3.0f));
+        __m128 s4 = _mm_cmpeq_ps(sector, _mm_set1_ps(4.0f));
+
+        // Same table as hsb_to_rgb_single, sector 5 is the fallback of each select
+        __m128 r = select_ps(s0, v, select_ps(s1, q, select_ps(_mm_or_ps(s2, s3), p, select_ps(s4, t, v))));
+        __m128 g = select_ps(s0, t, select_ps(_mm_or_ps(s1, s2), v, select_ps(s3, q, p)));
+        __m128 b = select_ps(_mm_or_ps(s0, s1), p, select_ps(s2, t, select_ps(_mm_or_ps(s3, s4), v, q)));
+
+        __m128i ri = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(r, scale), half));
+        __m128i gi = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(g, scale), half));
+        __m128i bi = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(b, scale), half));
+        __m128i rgb = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(ri, 16), _mm_slli_epi32(gi, 8)), bi);
+        _mm_storeu_si128((__m128i*) (dest + i), _mm_or_si128(rgb, _mm_set1_epi32((int) 0xff000000)));
+    }
+    hsb_to_rgb_batch_scalar(hue + i, saturation + i, brightness + i, dest + i, count - i);
+}
+
+#endif
+
+/**
+ * Converts the specified colors to hue, saturation and brightness, each within [0, 1].
+ * Requires the kernels to be selected using reduce_initialize().
+ */
+void rgb_to_hsb_batch(const COLOR* colors, float* hue, float* saturation, float* brightness, int count)
+{
+#ifdef AMBIENT_X86
+    if (reduce_simd_level() >= SIMD_SSE2)
+    {
+        rgb_to_hsb_batch_sse2(colors, hue, saturation, brightness, count);
+        return;
+    }
+#endif
+    rgb_to_hsb_batch_scalar(colors, hue, saturation, brightness, count);
+}
+
+/**
+ * Converts the specified hue, saturation and brightness values to colors.
+ * Requires the kernels to be selected using reduce_initialize().
+ */
+void hsb_to_rgb_batch(const float* hue, const float* saturation, const float* brightness, COLOR* dest, int count)
+{
+#ifdef AMBIENT_X86
+    if (reduce_simd_level() >= SIMD_SSE2)
+    {
+        hsb_to_rgb_batch_sse2(hue, saturation, brightness, dest, count);
+        return;
+    }
+#endif
+    hsb_to_rgb_batch_scalar(hue, saturation, brightness, dest, count);
+}
@@ -0,0 +1,25 @@
+/**
+ * LibAmbient - Batch conversion between RGB and HSB.
+ *
+ * The colors are converted in a structure of arrays layout without branches,
+ * so four colors at once are processed by the SSE2 variants.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_COLOR_H
+#define LIB_AMBIENT_COLOR_H
+
+#include "libambient.hpp"
+
+// Colors are passed as 0xAARRGGBB, the alpha channel is ignored (and set on output)
+void    rgb_to_hsb_batch(const COLOR* colors, float* hue, float* saturation, float* brightness, int count);
+void    hsb_to_rgb_batch(const float* hue, const float* saturation, const float* brightness, COLOR* dest, int count);
+
+// Kernel variants, exposed for testing and benchmarking
+void    rgb_to_hsb_batch_scalar(const COLOR* colors, float* hue, float* saturation, float* brightness, int count);
+void    hsb_to_rgb_batch_scalar(const float* hue, const float* saturation, const float* brightness,
+                                COLOR* dest, int count);
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * LibAmbient - Averaging colors in linear light or OKLab.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "colorspace.hpp"
+#include "reduce.hpp"
+#include <math.h>
+
+// Built once by colorspace_initialize() and shared by all contexts
+static unsigned int     g_linearLut[LINEAR_LUT_SIZE];
+static unsigned short   g_oklabLut[OKLAB_LUT_SIZE * 4];
+
+static double srgb_to_linear(double c)
+{
+    return c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+}
+
+static double linear_to_srgb(double c)
+{
+    return c <= 0.0031308 ? c * 12.92 : 1.055 * pow(c, 1.0 / 2.4) - 0.055;
+}
+
+static COLOR to_channel(double c)
+{
+    if (c <= 0) return 0;
+    if (c >= 1) return 255;
+    return (COLOR) (c * 255.0 + 0.5);
+}
+
+/**
+ * Converts a linear RGB color to OKLab (see https://bottosson.github.io/posts/oklab/).
+ */
+static void linear_to_oklab(double r, double g, double b, double* lab)
+{
+    double l = cbrt(0.4122214708 * r + 0.5363325363 * g + 0.0514459929 * b);
+    double m = cbrt(0.2119034982 * r + 0.6806995451 * g + 0.1073969566 * b);
+    double s = cbrt(0.0883024619 * r + 0.2817188376 * g + 0.6299787005 * b);
+
+    lab[0] = 0.2104542553 * l + 0.7936177850 * m - 0.0040720468 * s;
+    lab[1] = 1.9779984951 * l - 2.4285922050 * m + 0.4505937099 * s;
+    lab[2] = 0.0259040371 * l + 0.7827717662 * m - 0.8086757660 * s;
+}
+
+static void oklab_to_linear(double L, double a, double b, double* rgb)
+{
+    double l = L + 0.3963377774 * a + 0.2158037573 * b;
+    double m = L - 0.1055613458 * a - 0.0638541728 * b;
+    double s = L - 0.0894841775 * a - 1.2914855480 * b;
+    l = l * l * l;
+    m = m * m * m;
+    s = s * s * s;
+
+    rgb[0] =  4.0767416621 * l - 3.3077115913 * m + 0.2309699292 * s;
+    rgb[1] = -1.2684380046 * l + 2.6097574011 * m - 0.3413193965 * s;
+    rgb[2] = -0.0041960863 * l - 0.7034186147 * m + 1.7076147010 * s;
+}
+
+static unsigned short to_oklab_entry(double value, int bias)
+{
+    double entry = value * OKLAB_LUT_SCALE + bias + 0.5;
+    if (entry <= 0)     return 0;
+    if (entry >= 65535) return 65535;
+    return (unsigned short) entry;
+}
+
+/**
+ * Fills the lookup tables of the linear and the OKLab accumulation.
+ * Must be called before any of the other functions is used.
+ */
+void colorspace_initialize()
+{
+    for (int i = 0; i < LINEAR_LUT_SIZE; i++)
+        g_linearLut[i] = (unsigned int) (srgb_to_linear(i / 255.0) * LINEAR_LUT_SCALE + 0.5);
+
+    for (int i = 0; i < OKLAB_LUT_SIZE; i++)
+    {
+        // Expand the RGB565 value to 8 bits per channel, like the hue lookup table
+        int r5 = (i >> 11) & 0x1f, g6 = (i >> 5) & 0x3f, b5 = i & 0x1f;
+        int r = (r5 << 3) | (r5 >> 2);
+        int g = (g6 << 2) | (g6 >> 4);
+        int b = (b5 << 3) | (b5 >> 2);
+
+        double lab[3];
+        linear_to_oklab(srgb_to_linear(r / 255.0), srgb_to_linear(g / 255.0), srgb_to_linear(b / 255.0), lab);
+
+        unsigned short* entry = g_oklabLut + i * 4;
+        entry[0] = to_oklab_entry(lab[0], 0);
+        entry[1] = to_oklab_entry(lab[1], OKLAB_LUT_BIAS);
+        entry[2] = to_oklab_entry(lab[2], OKLAB_LUT_BIAS);
+        entry[3] = 0;
+    }
+}
+
+/**
+ * Adds the specified pixels to the sums of the specified color space.
+ * For sRGB and linear light the sums are in the byte order of the pixels, for OKLab they are L, a, b.
+ */
+void colorspace_sum(COLOR_SPACE space, const COLOR* pixels, int count, unsigned long long* sums)
+{
+    switch (space)
+    {
+    case COLOR_SPACE_LINEAR:
+        sum_linear(pixels, count, g_linearLut, sums);
+        break;
+    case COLOR_SPACE_OKLAB:
+        sum_oklab(pixels, count, g_oklabLut, sums);
+        break;
+    default:
+        sum_channels(pixels, count, sums);
+        break;
+    }
+}
+
+/**
+ * Turns the sums of the specified amount of pixels (see colorspace_sum)
+ * into their average color, as 0xffRRGGBB.
+ */
+COLOR colorspace_average(COLOR_SPACE space, const unsigned long long* sums, unsigned long long count)
+{
+    if (count == 0)
+        return 0xff000000;
+
+    double rgb[3];
+    switch (space)
+    {
+    case COLOR_SPACE_LINEAR:
+        rgb[0] = linear_to_srgb((double) sums[2] / count / LINEAR_LUT_SCALE);
+        rgb[1] = linear_to_srgb((double) sums[1] / count / LINEAR_LUT_SCALE);
+        rgb[2] = linear_to_srgb((double) sums[0] / count / LINEAR_LUT_SCALE);
+        break;
+    case COLOR_SPACE_OKLAB:
+        oklab_to_linear((double) sums[0] / count / OKLAB_LUT_SCALE,
+                        ((double) sums[1] / count - OKLAB_LUT_BIAS) / OKLAB_LUT_SCALE,
+                        ((double) sums[2] / count - OKLAB_LUT_BIAS) / OKLAB_LUT_SCALE, rgb);
+        for (int c = 0; c < 3; c++)
+            rgb[c] = linear_to_srgb(rgb[c] > 0 ? rgb[c] : 0);
+        break;
+    default:
+        // Integer division, so the result is exactly that of the plain average
+        return 0xff000000
+            | ((COLOR) (sums[2] / count) << 16)
+            | ((COLOR) (sums[1] / count) << 8)
+            | ((COLOR) (sums[0] / count) << 0);
+    }
+
+    return 0xff000000 | (to_channel(rgb[0]) << 16) | (to_channel(rgb[1]) << 8) | to_channel(rgb[2]);
+}
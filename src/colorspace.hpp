@@ -0,0 +1,21 @@
+/**
+ * LibAmbient - Averaging colors in linear light or OKLab.
+ *
+ * The pixels are mapped through lookup tables while they are summed
+ * (see sum_linear and sum_oklab), so only the averages have to be
+ * converted back to sRGB and the cost per pixel stays that of a plain sum.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_COLORSPACE_H
+#define LIB_AMBIENT_COLORSPACE_H
+
+#include "libambient.hpp"
+
+void    colorspace_initialize();
+void    colorspace_sum(COLOR_SPACE space, const COLOR* pixels, int count, unsigned long long* sums);
+COLOR   colorspace_average(COLOR_SPACE space, const unsigned long long* sums, unsigned long long count);
+
+#endif
@@ -0,0 +1,151 @@
+/**
+ * LibAmbient - State of a single capture context.
+ *
+ * Every context captures one monitor and owns all of its buffers,
+ * so several contexts can be used concurrently on separate threads.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_CONTEXT_H
+#define LIB_AMBIENT_CONTEXT_H
+
+#include "libambient.hpp"
+#include "budget.hpp"
+#ifdef _WIN32
+    #include "capture_gdi.hpp"
+    #include "capture_dxgi.hpp"
+    #include "reduce_gpu.hpp"
+#else
+    #include "capture_x11.hpp"
+#endif
+#include "capture_replay.hpp"
+#include "filter.hpp"
+#include "letterbox.hpp"
+#include "output.hpp"
+#include "palette.hpp"
+#include "pipeline.hpp"
+#include "sampling.hpp"
+#include "shared.hpp"
+#include "stats.hpp"
+#include "throttle.hpp"
+#include "workers.hpp"
+#include "zones.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct ambient_context
+{
+    // Capture, the interface forwards to the state of the backend in use
+    CAPTURE_BACKEND             backend;
+    const capture_interface*    capture;
+    void*                       captureState;
+#ifdef _WIN32
+    gdi_capture                 gdi;
+    dxgi_capture                dxgi;
+#else
+    x11_capture                 x11;
+#endif
+    replay_capture              replay;         // Frames submitted by the caller (see ambient_submit_frame)
+    int                 screenWidth, screenHeight;
+    int                 bitmapWidth, bitmapHeight;
+
+    // The captured monitor, whose size is watched for display mode changes (see detect_display_change).
+    // A replay has no monitor, its index is -1.
+    int                 monitorIndex;
+    monitor_info        monitor;
+    sample_grid         grid;           // Only used if the screen is sampled instead of downscaled
+    latency_budget      budget;         // Adapts the bitmap size (see ambient_set_latency_budget)
+
+    // A buffer containing the color values of each pixel of the downscaled screenshot.
+    // For GDI this is the DIB section the screen is drawn into.
+    COLORREF*           pixelBuffer;
+    bool                ownsPixelBuffer;
+    size_t              pixelCapacity;  // Pixels the own pixel buffer can hold
+
+    // Captures the next frames while the current one is reduced (see ambient_config::pipelineDepth).
+    // The pixel buffer and the dirty rows are those of the frame held from the pipeline in that case.
+    bool                pipelined;
+    capture_pipeline    pipeline;
+
+    // Per-row state of the last frame, used to skip rows which did not change.
+    // The sums of a row are stored in the byte order of the pixels,
+    // i.e. in the order GetRValue, GetGValue, GetBValue (L, a, b for OKLab, see colorSpace).
+    unsigned long long* rowChecksums;
+    unsigned long long* rowSums;
+    unsigned char*      dirtyRows;      // Rows the backend reported as possibly changed
+    unsigned char*      staleRows;      // Rows whose cached sums are out of date
+    int                 rowCapacity;    // Rows the per-row buffers can hold, they only grow
+
+    // Incremented whenever a captured frame differs from the previous one.
+    // Each result remembers the frame it was calculated from,
+    // so unchanged frames return the cached result.
+    unsigned int        frameId;
+
+    // Splits the reduction of large frames into row tiles (see ambient_set_reduce_threads)
+    worker_pool         workers;
+    unsigned int*       workerHues;     // A histogram per thread, merged into hues
+
+    // Part of the screen the hue is calculated from (see ambient_set_roi and ambient_set_letterbox_detection).
+    // The area is in pixel buffer coordinates, the zones always use the whole buffer.
+    ZONE                roi;            // Screen coordinates, empty for the whole screen
+    letterbox_detector  letterbox;
+    zone_rect           area;           // The ROI without the detected bars
+
+    // Hue
+    HUE_MODE            hueMode;
+    COLOR_SPACE         colorSpace;     // Used for the hue and the zones (see ambient_set_color_space)
+    unsigned int*       hues;           // HUE_RANGE slots, weighted by saturation and brightness
+    unsigned int        hueFrameId;
+    HUE                 lastHue;
+    hue_filter          filter;         // Smooths the hue over time (see ambient_set_smoothing)
+
+    // GPU reduction (DXGI only), replaces the pixel buffer and the row caches
+    bool                gpuReduction;
+#ifdef _WIN32
+    gpu_reduction       gpu;
+#endif
+    zone_rect           gpuArea;        // The ROI in frame coordinates
+    zone_rect*          gpuRects;       // Zones in frame coordinates
+    unsigned long long* gpuSums;        // Sums of the ROI, followed by the sums of each zone
+    int                 gpuCapacity;    // Amount of sums (divided by 3) the buffers can hold
+
+    // Zones
+    zone_layout         zones;
+    unsigned int        zoneFrameId;
+    ZONE_REDUCTION      zoneReduction;
+    integral_image      integral;
+
+    // Dominant colors (see ambient_get_palette), the histogram is allocated on first use
+    color_palette       palette;
+    int                 paletteColors;  // Amount of colors the palette was requested with
+    unsigned int        paletteFrameId;
+
+    // LED output of the capture thread (see ambient_set_output)
+    color_output        output;
+    unsigned int        outputFrameId;  // Frame of the colors which were sent last
+    HUE                 outputHue;
+
+    // Publication of the results of the capture thread to other processes (see ambient_publish)
+    shared_publisher    publisher;
+
+    // Serializes the capture pipeline between the caller and the capture thread
+    std::mutex          captureLock;
+
+    // Instrumentation, guarded by its own lock so querying never waits for a capture
+    frame_stats         stats;
+    std::mutex          statsLock;
+
+    // State of the asynchronous capture mode (see ambient_start_capture)
+    std::thread             captureThread;
+    std::mutex              captureThreadLock;
+    std::condition_variable captureThreadSignal;
+    bool                    captureThreadStop;
+    std::atomic<HUE>        latestHue;
+    capture_throttle        throttle;   // Slows down the capture thread (see ambient_set_throttling), uses the capture lock
+};
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * LibAmbient - Memory mapped frame dumps.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "dump.hpp"
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+/**
+ * Maps the specified dump file and validates its header.
+ *
+ * @return false if the file can not be opened or is no dump
+ */
+bool dump_open(ambient_dump* dump, const char* path)
+{
+    memset(dump, 0, sizeof(*dump));
+#ifdef _WIN32
+    dump->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (dump->file == INVALID_HANDLE_VALUE)
+    {
+        dump->file = NULL;
+        return false;
+    }
+
+    // The whole file has to fit into the address space
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(dump->file, &fileSize) || fileSize.QuadPart < (LONGLONG) sizeof(dump_header)
+        || (unsigned long long) fileSize.QuadPart > SIZE_MAX)
+    {
+        dump_close(dump);
+        return false;
+    }
+    unsigned long long size = (unsigned long long) fileSize.QuadPart;
+
+    dump->mapping = CreateFileMappingA(dump->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (dump->mapping)
+        dump->view = (const unsigned char*) MapViewOfFile(dump->mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    // The whole file has to fit into the address space, the mapping keeps it open
+    struct stat info;
+    unsigned long long size = fstat(file, &info) == 0 ? (unsigned long long) info.st_size : 0;
+    void* view = size >= sizeof(dump_header) && size <= SIZE_MAX
+        ? mmap(NULL, (size_t) size, PROT_READ, MAP_SHARED, file, 0) : MAP_FAILED;
+    close(file);
+    if (view != MAP_FAILED)
+    {
+        madvise(view, (size_t) size, MADV_SEQUENTIAL);
+        dump->view = (const unsigned char*) view;
+        dump->size = (size_t) size;
+    }
+#endif
+    if (!dump->view)
+    {
+        dump_close(dump);
+        return false;
+    }
+
+    dump_header header;
+    memcpy(&header, dump->view, sizeof(header));
+    if (header.magic != DUMP_MAGIC || header.version != DUMP_VERSION
+        || header.width == 0 || header.height == 0 || header.width > 65536 || header.height > 65536
+        || header.rateNumerator == 0 || header.rateDenominator == 0)
+    {
+        dbgErr("==> Not a frame dump");
+        dump_close(dump);
+        return false;
+    }
+
+    // A partially written last frame is ignored
+    unsigned long long frameSize = (unsigned long long) header.width * header.height * sizeof(COLOR);
+    unsigned long long frames = (size - sizeof(dump_header)) / frameSize;
+    dump->info.width            = (int) header.width;
+    dump->info.height           = (int) header.height;
+    dump->info.frames           = frames > INT32_MAX ? INT32_MAX : (int) frames;
+    dump->info.frameIntervalMs  = 1000.0 * header.rateDenominator / header.rateNumerator;
+    return true;
+}
+
+void dump_close(ambient_dump* dump)
+{
+#ifdef _WIN32
+    if (dump->view)
+        UnmapViewOfFile(dump->view);
+    if (dump->mapping)
+        CloseHandle(dump->mapping);
+    if (dump->file)
+        CloseHandle(dump->file);
+    dump->mapping   = NULL;
+    dump->file      = NULL;
+#else
+    if (dump->view)
+        munmap((void*) dump->view, dump->size);
+    dump->size      = 0;
+#endif
+    dump->view      = NULL;
+}
+
+/**
+ * Returns the pixels of the specified frame inside the mapping, NULL if it does not exist.
+ */
+const COLOR* dump_frame(const ambient_dump* dump, int index)
+{
+    if (index < 0 || index >= dump->info.frames)
+        return NULL;
+    size_t frameSize = (size_t) dump->info.width * dump->info.height * sizeof(COLOR);
+    return (const COLOR*) (dump->view + sizeof(dump_header) + (size_t) index * frameSize);
+}
@@ -0,0 +1,49 @@
+/**
+ * LibAmbient - Memory mapped frame dumps.
+ *
+ * A dump is a header followed by raw 32 bit frames (BGRA, rows without padding)
+ * of a fixed size and frame rate, e.g. the rawvideo output of a video decoder.
+ * The file is mapped as a whole, so replaying a frame costs no copy.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_DUMP_H
+#define LIB_AMBIENT_DUMP_H
+
+#include "platform.hpp"
+#include "libambient.hpp"
+
+#define DUMP_MAGIC      0x44424d41  // "AMBD"
+#define DUMP_VERSION    1
+
+// Header of a dump file (little endian), which must not change without incrementing DUMP_VERSION.
+// The amount of frames follows from the size of the file, so frames can be appended.
+struct dump_header
+{
+    unsigned int        magic;
+    unsigned int        version;
+    unsigned int        width, height;
+    unsigned int        rateNumerator;      // Frames per second, e.g. 60000 / 1001
+    unsigned int        rateDenominator;
+    unsigned long long  reserved;           // 0
+};
+
+struct ambient_dump
+{
+#ifdef _WIN32
+    HANDLE                  file;
+    HANDLE                  mapping;
+#else
+    size_t                  size;       // Size of the mapping, i.e. of the file
+#endif
+    const unsigned char*    view;
+    ambient_dump_info       info;
+};
+
+bool            dump_open(ambient_dump* dump, const char* path);
+void            dump_close(ambient_dump* dump);
+const COLOR*    dump_frame(const ambient_dump* dump, int index);
+
+#endif
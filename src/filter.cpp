@@ -0,0 +1,64 @@
+/**
+ * LibAmbient - Temporal filtering of the hue.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "filter.hpp"
+#include "stats.hpp"
+#include <math.h>
+
+/**
+ * Sets the parameters of the filter, negative values are treated as 0.
+ * The current hue is kept, so the filter can be reconfigured at any time.
+ */
+void hue_filter_configure(hue_filter* filter, float timeConstantMs, float maxSlewRate)
+{
+    filter->timeConstantMs  = timeConstantMs > 0 ? timeConstantMs : 0;
+    filter->maxSlewRate     = maxSlewRate > 0 ? maxSlewRate : 0;
+}
+
+/**
+ * Moves the filtered hue towards the specified hue and returns it.
+ * 
+ * The hue moves along the shorter arc, so a change from 350° to 10°
+ * passes 0° instead of sweeping through all other colors.
+ * 
+ * @param target The hue of the current frame
+ * @param now The time of the current frame (see stats_now)
+ */
+HUE hue_filter_update(hue_filter* filter, HUE target, long long now)
+{
+    if (!filter->primed || (filter->timeConstantMs == 0 && filter->maxSlewRate == 0))
+    {
+        filter->hue         = target;
+        filter->lastUpdate  = now;
+        filter->primed      = true;
+        return target;
+    }
+
+    float elapsedMs = stats_elapsed_ms(filter->lastUpdate, now);
+    filter->lastUpdate = now;
+    if (elapsedMs <= 0)
+        return filter->hue;
+
+    // Shortest signed distance on the hue circle, within [-0.5, 0.5)
+    float delta = target - filter->hue;
+    delta -= floorf(delta + 0.5f);
+
+    float step = delta;
+    if (filter->timeConstantMs > 0)
+        step *= 1.0f - expf(-elapsedMs / filter->timeConstantMs);
+
+    if (filter->maxSlewRate > 0)
+    {
+        float maxStep = filter->maxSlewRate / 360.0f * elapsedMs / 1000.0f;
+        if (step >  maxStep) step =  maxStep;
+        if (step < -maxStep) step = -maxStep;
+    }
+
+    HUE hue = filter->hue + step;
+    filter->hue = hue - floorf(hue);
+    return filter->hue;
+}
@@ -0,0 +1,31 @@
+/**
+ * LibAmbient - Temporal filtering of the hue.
+ *
+ * An exponential moving average which interpolates along the shorter arc
+ * of the hue circle, optionally limited to a maximum rate of change.
+ * The filter depends on the time between two frames rather than on the
+ * amount of frames, so it behaves the same at any capture rate.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_FILTER_H
+#define LIB_AMBIENT_FILTER_H
+
+#include "libambient.hpp"
+
+struct hue_filter
+{
+    float       timeConstantMs;     // Time to cover ~63% of a step, 0 disables the average
+    float       maxSlewRate;        // Maximum change in degrees per second, 0 disables the limit
+
+    HUE         hue;                // Current output of the filter
+    long long   lastUpdate;         // Time of the last update (see stats_now)
+    bool        primed;             // Set once the filter holds a hue
+};
+
+void    hue_filter_configure(hue_filter* filter, float timeConstantMs, float maxSlewRate);
+HUE     hue_filter_update(hue_filter* filter, HUE target, long long now);
+
+#endif
@@ -0,0 +1,123 @@
+/**
+ * LibAmbient - Detection of letterbox and pillarbox bars.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "letterbox.hpp"
+
+// Channel value up to which a pixel counts as black, which tolerates compression noise and dithering
+#define LETTERBOX_BLACK_LEVEL       24
+
+// A bar covers less than this fraction (1 / n) of the buffer, per edge.
+// If no picture is found within it, the frame is considered to be dark rather than letterboxed.
+#define LETTERBOX_MAX_BAR           3
+
+// Consecutive scans which have to agree before the area changes,
+// so fades and subtitles inside the bars do not make the area flicker
+#define LETTERBOX_CONFIRMATIONS     2
+
+/**
+ * Returns whether all pixels of a line are black.
+ * 
+ * @param stride The distance between two pixels of the line, 1 for a row and the width for a column
+ */
+static bool is_black(const COLOR* pixels, int count, int stride)
+{
+    for (int i = 0; i < count; i++)
+    {
+        COLOR color = pixels[i * stride];
+        if ((color & 0xff) > LETTERBOX_BLACK_LEVEL || ((color >> 8) & 0xff) > LETTERBOX_BLACK_LEVEL
+            || ((color >> 16) & 0xff) > LETTERBOX_BLACK_LEVEL)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Searches the active picture of the specified frame.
+ * 
+ * @return false if a side did not show any picture, e.g. during a dark scene
+ */
+static bool detect_area(const COLOR* pixels, int width, int height, zone_rect* dest)
+{
+    int maxRows = height / LETTERBOX_MAX_BAR, maxColumns = width / LETTERBOX_MAX_BAR;
+
+    int top = 0, bottom = height;
+    while (top < maxRows && is_black(pixels + top * width, width, 1))
+        top++;
+    while (height - bottom < maxRows && is_black(pixels + (bottom - 1) * width, width, 1))
+        bottom--;
+    if (top == maxRows || height - bottom == maxRows)
+        return false;
+
+    // The columns only need to be black between the horizontal bars
+    int left = 0, right = width, rows = bottom - top;
+    while (left < maxColumns && is_black(pixels + top * width + left, rows, width))
+        left++;
+    while (width - right < maxColumns && is_black(pixels + top * width + right - 1, rows, width))
+        right--;
+    if (left == maxColumns || width - right == maxColumns)
+        return false;
+
+    dest->x0 = left;
+    dest->y0 = top;
+    dest->x1 = right;
+    dest->y1 = bottom;
+    return true;
+}
+
+static bool equal_rects(const zone_rect* a, const zone_rect* b)
+{
+    return a->x0 == b->x0 && a->y0 == b->y0 && a->x1 == b->x1 && a->y1 == b->y1;
+}
+
+/**
+ * Resets the detector to the whole pixel buffer of the specified size.
+ * 
+ * @param intervalFrames The amount of new frames between two scans, 0 disables the detection
+ */
+void letterbox_configure(letterbox_detector* detector, int intervalFrames, int width, int height)
+{
+    zone_rect whole = { 0, 0, width, height };
+    detector->intervalFrames    = intervalFrames > 0 ? intervalFrames : 0;
+    detector->framesLeft        = 0;
+    detector->area              = whole;
+    detector->candidate         = whole;
+    detector->confirmations     = 0;
+}
+
+/**
+ * Counts a new frame and scans it if the interval elapsed.
+ * 
+ * @return true if the active picture area changed
+ */
+bool letterbox_update(letterbox_detector* detector, const COLOR* pixels, int width, int height)
+{
+    if (detector->intervalFrames == 0 || --detector->framesLeft > 0)
+        return false;
+    detector->framesLeft = detector->intervalFrames;
+
+    zone_rect found;
+    if (!detect_area(pixels, width, height, &found))
+        return false;
+
+    if (equal_rects(&found, &detector->area))
+    {
+        detector->confirmations = 0;
+        return false;
+    }
+
+    if (!equal_rects(&found, &detector->candidate))
+    {
+        detector->candidate     = found;
+        detector->confirmations = 0;
+    }
+    if (++detector->confirmations < LETTERBOX_CONFIRMATIONS)
+        return false;
+
+    detector->area          = found;
+    detector->confirmations = 0;
+    return true;
+}
@@ -0,0 +1,32 @@
+/**
+ * LibAmbient - Detection of letterbox and pillarbox bars.
+ *
+ * Every few frames the rows and columns along the edges of the pixel buffer
+ * are scanned for black lines, so the hue can be calculated from the active
+ * picture only. The scan stops at the first line which is not black,
+ * so it only touches the bars and one line of picture per edge.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_LETTERBOX_H
+#define LIB_AMBIENT_LETTERBOX_H
+
+#include "libambient.hpp"
+#include "zones.hpp"
+
+struct letterbox_detector
+{
+    int         intervalFrames;     // New frames between two scans, 0 disables the detection
+    int         framesLeft;         // New frames until the next scan
+
+    zone_rect   area;               // The active picture, in pixel buffer coordinates
+    zone_rect   candidate;          // A different area which was found, but not confirmed yet
+    int         confirmations;      // Consecutive scans which found the candidate
+};
+
+void    letterbox_configure(letterbox_detector* detector, int intervalFrames, int width, int height);
+bool    letterbox_update(letterbox_detector* detector, const COLOR* pixels, int width, int height);
+
+#endif
@@ -1,53 +1,2031 @@
 /**
  * LibAmbient - A library for calculating the ambient color of your screen.
  * 
- * While this library targets windows machines only,
- * it is possible to extend support for other operating systems in the future.
+ * The library captures the screen using GDI or DXGI on Windows and X11 elsewhere.
+ * Everything but the capture backends is portable.
  * 
  * (c) 2020 Kraus David. All rights reserved.
  * 
  */
 
 #include "libambient.hpp"
+#include "context.hpp"
+#include "color.hpp"
+#include "colorspace.hpp"
+#include "dump.hpp"
+#include "tonemap.hpp"
+#include "reduce.hpp"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
-#include <tchar.h>
-#include <Windows.h>
+#ifdef _WIN32
+    #include <Windows.h>
+    #include <dwmapi.h>
+#endif
+#include <chrono>
 
-// Functions to convert between color spaces
-void    RGBtoHSB(int r, int g, int b, float* dest);
-COLOR   HSBtoRGB(float hue, float saturation, float brightness);
+// The context used by the functions without a context parameter
+// (initialize, getAmbientScreenHue, ...)
+ambient_context*    g_defaultContext;
 
-// Some global variables and buffers which are often used,
-// so we allocate them once to increase performance.
-int     g_bitmapWidth, g_bitmapHeight;
-int     g_screenWidth, g_screenHeight;
+// Maps the RGB565 value of a pixel to its hue bin and weight
+// (see HUE_LUT_ENTRY), so the histogram does not need RGBtoHSB per pixel.
+// Built once and shared by all contexts.
+unsigned short      g_hueLut[HUE_LUT_SIZE];
+std::once_flag      g_globalsInitialized;
 
-// Array with HUE_RANGE (360) slots (1 for each hue, rounded),
-// containing the occurrences of the hue.
-#define HUE_RANGE 360 // Max hue in degrees
-int*        g_hues;
+// Time a paced capture waits for a new frame, which bounds the time to stop the capture thread
+#define PACING_FRAME_TIMEOUT_MS 100
 
-// A buffer containing the color values of each pixel
-// contained in the below bitmap.
-// using ::GetDIBits()
-COLORREF*   g_pixelBuffer; 
+// Time of a refresh if neither the vertical blank nor the composition can be waited for
+#define PACING_FALLBACK_MS      16
 
-//Bitmap containing a snapshot of the screen
-HBITMAP             g_hBitmap;
-BITMAPINFOHEADER    g_bitmapInfoHeader = { 0 };
-HDC                 g_hScreenDC;
-HDC                 g_hMemoryDC;
+// Radius (in degrees) of the window used to find the peak of the histogram,
+// so a wide range of similar hues wins over a single spike.
+#define HUE_PEAK_RADIUS 8
 
-void clear_buffers()
+// Frames with less pixels are reduced on the calling thread only, as waking the workers costs more
+#define REDUCE_PARALLEL_MIN_PIXELS  (1 << 16)
+
+// Pixels of a reduction tile, enough to amortize claiming it
+#define REDUCE_TILE_PIXELS          (1 << 14)
+
+// Smallest bitmap (per axis) the latency budget may shrink the bitmap to
+#define BITMAP_MIN_SIZE 8
+
+void clear_buffers(ambient_context* context)
+{
+    memset(context->hues, 0, HUE_RANGE * sizeof(unsigned int));
+}
+
+/**
+ * Fills the hue lookup table with the hue of each RGB565 color.
+ * The weight of a color is the product of its saturation and brightness,
+ * so grey and dark pixels hardly contribute to the dominant hue.
+ */
+static void build_hue_lut()
+{
+    COLOR* colors       = (COLOR*) malloc(HUE_LUT_SIZE * sizeof(COLOR));
+    float* hue          = (float*) malloc(HUE_LUT_SIZE * sizeof(float));
+    float* saturation   = (float*) malloc(HUE_LUT_SIZE * sizeof(float));
+    float* brightness   = (float*) malloc(HUE_LUT_SIZE * sizeof(float));
+    if (!colors || !hue || !saturation || !brightness)
+    {
+        dbgErr("==> Failed to allocate the hue lookup table");
+        free(colors); free(hue); free(saturation); free(brightness);
+        return;
+    }
+
+    for (int i = 0; i < HUE_LUT_SIZE; i++)
+    {
+        // Expand the quantized channels to the full 8 bit range
+        int r = (i >> 11) & 0x1f, g = (i >> 5) & 0x3f, b = i & 0x1f;
+        r = (r << 3) | (r >> 2);
+        g = (g << 2) | (g >> 4);
+        b = (b << 3) | (b >> 2);
+        colors[i] = (r << 16) | (g << 8) | b;
+    }
+    rgb_to_hsb_batch(colors, hue, saturation, brightness, HUE_LUT_SIZE);
+
+    for (int i = 0; i < HUE_LUT_SIZE; i++)
+    {
+        int bin     = (int) (hue[i] * HUE_RANGE) % HUE_RANGE;
+        int weight  = (int) (saturation[i] * brightness[i] * HUE_LUT_MAX_WEIGHT + 0.5f);
+        g_hueLut[i] = HUE_LUT_ENTRY(bin, weight);
+    }
+
+    free(colors);
+    free(hue);
+    free(saturation);
+    free(brightness);
+}
+
+/**
+ * Initializes the state shared by all contexts.
+ */
+static void initialize_globals()
+{
+    reduce_initialize();
+    tonemap_initialize();
+    colorspace_initialize();
+    build_hue_lut();
+}
+
+/**
+ * Calculates a cheap checksum of a single row of the pixel buffer,
+ * processing two pixels at once.
+ */
+static unsigned long long row_checksum(const COLORREF* row, int width)
+{
+    // Rows of odd widths are only aligned to single pixels, memcpy compiles to a plain (unaligned) load
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+    for (int x = 0; x < width / 2; x++)
+    {
+        unsigned long long pair;
+        memcpy(&pair, row + 2 * x, sizeof(pair));
+        hash = (hash ^ pair) * 0x100000001b3ULL;
+    }
+    if (width & 1)
+        hash = (hash ^ row[width - 1]) * 0x100000001b3ULL;
+    return hash;
+}
+
+/**
+ * Returns whether the reduction of the current frame is split across the workers.
+ */
+static bool reduce_in_parallel(ambient_context* context)
+{
+    return context->workers.threadCount > 0
+        && context->bitmapWidth * context->bitmapHeight >= REDUCE_PARALLEL_MIN_PIXELS;
+}
+
+/**
+ * Returns the amount of rows of a reduction tile.
+ */
+static int tile_rows(ambient_context* context)
+{
+    int rows = REDUCE_TILE_PIXELS / context->bitmapWidth;
+    return rows > 0 ? rows : 1;
+}
+
+/**
+ * Updates the cached channel sums of the stale rows inside a tile (see tile_function).
+ * Every row has its own sums, so tiles never write to the same memory.
+ */
+static void sum_rows(void* user, int begin, int end, int /* thread */)
+{
+    ambient_context* context = (ambient_context*) user;
+    const zone_rect* area = &context->area;
+    for (int y = area->y0 + begin; y < area->y0 + end; y++)
+    {
+        if (!context->staleRows[y])
+            continue;
+
+        unsigned long long* sums = context->rowSums + y * 3;
+        sums[0] = sums[1] = sums[2] = 0;
+        const COLOR* row = (const COLOR*) context->pixelBuffer + y * context->bitmapWidth;
+        colorspace_sum(context->colorSpace, row + area->x0, area->x1 - area->x0, sums);
+        context->staleRows[y] = 0;
+    }
+}
+
+/**
+ * Adds the active area of the specified rows (relative to the area) to a histogram.
+ */
+static void accumulate_area(ambient_context* context, int begin, int end, unsigned int* hues)
+{
+    const zone_rect* area = &context->area;
+    const COLOR* pixels = (const COLOR*) context->pixelBuffer;
+    int width = area->x1 - area->x0;
+    if (width == context->bitmapWidth)
+    {
+        accumulate_hues(pixels + (area->y0 + begin) * width, (end - begin) * width, g_hueLut, hues);
+        return;
+    }
+
+    for (int y = area->y0 + begin; y < area->y0 + end; y++)
+        accumulate_hues(pixels + y * context->bitmapWidth + area->x0, width, g_hueLut, hues);
+}
+
+/**
+ * Adds the rows of a tile to the histogram of the thread running it (see tile_function).
+ */
+static void accumulate_rows(void* user, int begin, int end, int thread)
+{
+    ambient_context* context = (ambient_context*) user;
+    accumulate_area(context, begin, end, context->workerHues + thread * HUE_RANGE);
+}
+
+/**
+ * Updates the cached channel sums of all stale rows inside the active area.
+ */
+static void update_row_sums(ambient_context* context)
+{
+    int rows = context->area.y1 - context->area.y0;
+    if (reduce_in_parallel(context))
+        worker_pool_run(&context->workers, rows, tile_rows(context), sum_rows, context);
+    else
+        sum_rows(context, 0, rows, 0);
+}
+
+/**
+ * Calculates the hue of the average color of the pixel buffer.
+ */
+static HUE average_hue(ambient_context* context)
+{
+    unsigned long long sums[3] = { 0, 0, 0 };
+    unsigned long long pixelCount;
+    COLOR_SPACE space = context->colorSpace;
+    if (context->gpuReduction)
+    {
+        // The first sums of the GPU reduction cover the ROI, the shader only sums sRGB values
+        const zone_rect* area = &context->gpuArea;
+        sums[0] = context->gpuSums[0];
+        sums[1] = context->gpuSums[1];
+        sums[2] = context->gpuSums[2];
+        pixelCount = (unsigned long long) (area->x1 - area->x0) * (area->y1 - area->y0);
+        space = COLOR_SPACE_SRGB;
+    }
+    else
+    {
+        update_row_sums(context);
+
+        //Sample the screen quad
+        const zone_rect* area = &context->area;
+        for (int y = area->y0; y < area->y1; y++)
+        {
+            sums[0] += context->rowSums[y * 3 + 0];
+            sums[1] += context->rowSums[y * 3 + 1];
+            sums[2] += context->rowSums[y * 3 + 2];
+        }
+        pixelCount = (unsigned long long) (area->x1 - area->x0) * (area->y1 - area->y0);
+    }
+
+    //Average result, converted back from the color space once
+    COLOR average = colorspace_average(space, sums, pixelCount);
+
+    // Convert color to HSB to set the saturation
+    // and brightness of the color to 100%
+    float hsb[3];
+    RGBtoHSB((int) ((average >> 16) & 0xff), (int) ((average >> 8) & 0xff), (int) (average & 0xff), hsb);
+    return hsb[0];
+}
+
+/**
+ * Calculates the most dominant hue of the pixel buffer using the hue histogram.
+ * 
+ * The peak is searched using a circular window sliding over the histogram,
+ * the returned hue is the weighted mean of the bins inside the best window.
+ */
+static HUE dominant_hue(ambient_context* context)
+{
+    // The GPU reduction builds the histogram along with the sums
+    unsigned int* hues = context->hues;
+    if (!context->gpuReduction && reduce_in_parallel(context))
+    {
+        // Each thread fills its own histogram, which are merged afterwards
+        int histograms = context->workers.threadCount + 1;
+        memset(context->workerHues, 0, histograms * HUE_RANGE * sizeof(unsigned int));
+        worker_pool_run(&context->workers, context->area.y1 - context->area.y0, tile_rows(context),
+            accumulate_rows, context);
+
+        clear_buffers(context);
+        for (int t = 0; t < histograms; t++)
+            for (int bin = 0; bin < HUE_RANGE; bin++)
+                hues[bin] += context->workerHues[t * HUE_RANGE + bin];
+    }
+    else if (!context->gpuReduction)
+    {
+        clear_buffers(context);
+        accumulate_area(context, 0, context->area.y1 - context->area.y0, hues);
+    }
+
+    unsigned long long window = 0;
+    for (int i = -HUE_PEAK_RADIUS; i <= HUE_PEAK_RADIUS; i++)
+        window += hues[(i + HUE_RANGE) % HUE_RANGE];
+
+    unsigned long long best = window;
+    int bestBin = 0;
+    for (int bin = 1; bin < HUE_RANGE; bin++)
+    {
+        window += hues[(bin + HUE_PEAK_RADIUS) % HUE_RANGE];
+        window -= hues[(bin - HUE_PEAK_RADIUS - 1 + HUE_RANGE) % HUE_RANGE];
+        if (window > best)
+        {
+            best    = window;
+            bestBin = bin;
+        }
+    }
+
+    // Nothing but grey pixels
+    if (best == 0)
+        return 0;
+
+    long long weightedOffset = 0;
+    for (int i = -HUE_PEAK_RADIUS; i <= HUE_PEAK_RADIUS; i++)
+        weightedOffset += (long long) i * hues[(bestBin + i + HUE_RANGE) % HUE_RANGE];
+
+    float hue = (bestBin + 0.5f + (float) weightedOffset / (float) best) / HUE_RANGE;
+    if (hue < 0)        hue += 1.0f;
+    if (hue >= 1.0f)    hue -= 1.0f;
+    return hue;
+}
+
+/**
+ * Maps the ROI onto a surface of the specified size, e.g. the pixel buffer.
+ */
+static void roi_rect(ambient_context* context, int width, int height, zone_rect* dest)
+{
+    if (context->roi.width > 0 && context->roi.height > 0)
+    {
+        zones_map_rect(&context->roi, context->screenWidth, context->screenHeight, width, height, dest);
+        return;
+    }
+
+    dest->x0 = 0;
+    dest->y0 = 0;
+    dest->x1 = width;
+    dest->y1 = height;
+}
+
+/**
+ * Recalculates the active area of the pixel buffer from the ROI and the detected bars.
+ * The cached row sums are invalidated, the cached hue is not.
+ */
+static void update_area(ambient_context* context)
+{
+    zone_rect* area = &context->area;
+    roi_rect(context, context->bitmapWidth, context->bitmapHeight, area);
+
+    // Bars reaching across the whole ROI are ignored
+    const zone_rect* picture = &context->letterbox.area;
+    zone_rect clipped = *area;
+    if (clipped.x0 < picture->x0) clipped.x0 = picture->x0;
+    if (clipped.y0 < picture->y0) clipped.y0 = picture->y0;
+    if (clipped.x1 > picture->x1) clipped.x1 = picture->x1;
+    if (clipped.y1 > picture->y1) clipped.y1 = picture->y1;
+    if (clipped.x1 > clipped.x0 && clipped.y1 > clipped.y0)
+        *area = clipped;
+
+    // Row sums only cover the columns of the area
+    memset(context->staleRows, 1, context->bitmapHeight);
+}
+
+#ifdef _WIN32
+/**
+ * Captures the screen and reduces it on the GPU, instead of capturing into the pixel buffer.
+ * Fills the sums of the ROI and of each zone, as well as the hue histogram of the ROI.
+ */
+static capture_result capture_gpu(ambient_context* context, capture_timestamps* timestamps)
+{
+    capture_result result = dxgi_capture_frame(&context->dxgi, NULL, NULL, timestamps);
+    if (result != CAPTURE_OK)
+        return result;
+
+    int count = context->zones.count;
+    if (count + 1 > context->gpuCapacity)
+    {
+        free(context->gpuRects);
+        free(context->gpuSums);
+        context->gpuRects       = (zone_rect*)          malloc((count + 1) * sizeof(zone_rect));
+        context->gpuSums        = (unsigned long long*) malloc((count + 1) * 3 * sizeof(unsigned long long));
+        context->gpuCapacity    = context->gpuRects && context->gpuSums ? count + 1 : 0;
+        if (!context->gpuCapacity)
+            return CAPTURE_FAILED;
+    }
+
+    // The zones are summed on the full resolution frame
+    int width = context->dxgi.screenWidth, height = context->dxgi.screenHeight;
+    roi_rect(context, width, height, &context->gpuArea);
+    zones_map(&context->zones, context->screenWidth, context->screenHeight, width, height, context->gpuRects);
+    if (!gpu_reduce(&context->gpu, context->dxgi.mipView, &context->gpuArea, context->gpuRects, count,
+        context->gpuSums, context->hues))
+        return CAPTURE_FAILED;
+    timestamps->readBack = stats_now();
+
+    context->frameId++;
+    return CAPTURE_OK;
+}
+#endif
+
+/**
+ * Captures a frame with the backend of the context (see capture_function).
+ */
+static capture_result capture_backend(void* user, COLORREF* dest, unsigned char* dirtyRows,
+                                      capture_timestamps* timestamps)
+{
+    ambient_context* context = (ambient_context*) user;
+    return context->capture->capture_frame(context->captureState, dest, dirtyRows, timestamps);
+}
+
+/**
+ * Makes sure the per-row buffers and the own pixel buffer can hold a bitmap of the specified size.
+ * They only grow, so a reconfiguration which keeps (or shrinks) the size allocates nothing.
+ * 
+ * @return false if a buffer could not be grown, the previous buffers are kept in that case
+ */
+static bool reserve_buffers(ambient_context* context, int bitmapWidth, int bitmapHeight)
+{
+    if (bitmapHeight > context->rowCapacity)
+    {
+        unsigned long long* rowChecksums    = (unsigned long long*) malloc(bitmapHeight * sizeof(unsigned long long));
+        unsigned long long* rowSums         = (unsigned long long*) malloc(bitmapHeight * 3 * sizeof(unsigned long long));
+        unsigned char*      dirtyRows       = (unsigned char*)      malloc(bitmapHeight);
+        unsigned char*      staleRows       = (unsigned char*)      malloc(bitmapHeight);
+        if (!rowChecksums || !rowSums || !dirtyRows || !staleRows)
+        {
+            free(rowChecksums);
+            free(rowSums);
+            free(dirtyRows);
+            free(staleRows);
+            return false;
+        }
+
+        free(context->rowChecksums);
+        free(context->rowSums);
+        free(context->dirtyRows);
+        free(context->staleRows);
+        context->rowChecksums   = rowChecksums;
+        context->rowSums        = rowSums;
+        context->dirtyRows      = dirtyRows;
+        context->staleRows      = staleRows;
+        context->rowCapacity    = bitmapHeight;
+        memset(context->staleRows, 1, bitmapHeight);
+    }
+
+    size_t pixels = (size_t) bitmapWidth * bitmapHeight;
+    if (context->ownsPixelBuffer && pixels > context->pixelCapacity)
+    {
+        COLORREF* pixelBuffer = (COLORREF*) calloc(pixels, sizeof(COLORREF));
+        if (!pixelBuffer)
+            return false;
+
+        free(context->pixelBuffer);
+        context->pixelBuffer    = pixelBuffer;
+        context->pixelCapacity  = pixels;
+    }
+    return true;
+}
+
+/**
+ * Changes the captured area and the size of the downscaled screenshot, reusing the buffers
+ * and the capture objects wherever they are large enough. Contexts sampling the screen
+ * lay out their sample grid again, whose size replaces the bitmap size.
+ * The cached results stay valid until the next frame changed.
+ * 
+ * @return false if the sizes could not be applied, the previous ones are kept in that case
+ */
+static bool reconfigure_context(ambient_context* context, int screenWidth, int screenHeight,
+                                int bitmapWidth, int bitmapHeight)
+{
+    // The worker of the pipeline uses the backend
+    if (context->pipelined)
+        pipeline_stop(&context->pipeline);
+
+    sample_grid grid = context->grid;
+    bool sampled    = context->grid.width != 0;
+    bool regrid     = sampled && (screenWidth != context->screenWidth || screenHeight != context->screenHeight);
+    if (regrid && !sample_grid_initialize(&grid, context->grid.mode, context->grid.strideX, context->grid.strideY,
+        screenWidth, screenHeight))
+        return false;
+    if (sampled)
+    {
+        bitmapWidth     = grid.width;
+        bitmapHeight    = grid.height;
+    }
+
+    int oldWidth = context->bitmapWidth, oldHeight = context->bitmapHeight;
+    bool success = reserve_buffers(context, bitmapWidth, bitmapHeight)
+        && (!context->pipelined || pipeline_resize(&context->pipeline, bitmapWidth, bitmapHeight))
+        && zones_remap(&context->zones, screenWidth, screenHeight, bitmapWidth, bitmapHeight);
+
+    // The GPU reduction maps everything onto the frame itself
+    if (success && !context->gpuReduction)
+    {
+        const capture_interface* capture = context->capture;
+        if (!capture->reconfigure(context->captureState, screenWidth, screenHeight, bitmapWidth, bitmapHeight))
+        {
+            // A failed reconfiguration may have released the old resources as well (e.g. DXGI), so they are restored
+            capture->reconfigure(context->captureState, context->screenWidth, context->screenHeight,
+                oldWidth, oldHeight);
+            zones_remap(&context->zones, context->screenWidth, context->screenHeight, oldWidth, oldHeight);
+            success = false;
+        }
+    }
+
+    if (!success)
+    {
+        // The buffers only grew, so the previous size still fits
+        if (context->pipelined)
+            pipeline_resize(&context->pipeline, oldWidth, oldHeight);
+        if (regrid)
+            sample_grid_uninitialize(&grid);
+        return false;
+    }
+
+    if (regrid)
+    {
+        sample_grid_uninitialize(&context->grid);
+        context->grid = grid;
+    }
+
+    // The pixel buffer is the DIB section of GDI unless pipelined, which may have been replaced
+    if (!context->ownsPixelBuffer)
+    {
+#ifdef _WIN32
+        context->pixelBuffer = context->pipelined ? pipeline_pixels(&context->pipeline) : context->gdi.pixels;
+#else
+        context->pixelBuffer = pipeline_pixels(&context->pipeline);
+#endif
+    }
+
+    context->screenWidth    = screenWidth;
+    context->screenHeight   = screenHeight;
+    context->bitmapWidth    = bitmapWidth;
+    context->bitmapHeight   = bitmapHeight;
+    memset(context->rowChecksums, 0, bitmapHeight * sizeof(unsigned long long));
+
+    // The bars are searched again at the new size
+    letterbox_configure(&context->letterbox, context->letterbox.intervalFrames, bitmapWidth, bitmapHeight);
+    update_area(context);
+    return true;
+}
+
+/**
+ * Changes the size of the downscaled screenshot and reallocates everything depending on it.
+ * 
+ * @return false if the size could not be changed, the previous size is kept in that case
+ */
+static bool resize_bitmap(ambient_context* context, int bitmapWidth, int bitmapHeight)
+{
+    // The sample grid and the GPU reduction do not use the bitmap size
+    if (context->grid.width || context->gpuReduction)
+        return false;
+
+    return reconfigure_context(context, context->screenWidth, context->screenHeight, bitmapWidth, bitmapHeight);
+}
+
+/**
+ * Follows changes of the resolution (or DPI scaling) of the captured monitor,
+ * so capturing resumes with the next frame. Polling the size of the monitor is cheap
+ * enough for every frame and, unlike WM_DISPLAYCHANGE, needs no window.
+ * 
+ * A context capturing the whole monitor takes over its new size,
+ * a context capturing a part of it is clipped to the monitor.
+ * Replayed frames have no monitor, their size only changes with ambient_reconfigure().
+ */
+static void detect_display_change(ambient_context* context)
+{
+    monitor_info monitor = context->monitor;
+    if (context->monitorIndex < 0 || !monitor_update(context->monitorIndex, &monitor))
+        return;
+
+    int width = monitor.width, height = monitor.height;
+    bool resized = width != context->monitor.width || height != context->monitor.height;
+    bool whole = context->screenWidth == context->monitor.width && context->screenHeight == context->monitor.height;
+    context->monitor = monitor;
+    if (!resized)
+        return;
+
+    int screenWidth     = whole || context->screenWidth  > width  ? width  : context->screenWidth;
+    int screenHeight    = whole || context->screenHeight > height ? height : context->screenHeight;
+    int bitmapWidth     = context->bitmapWidth  < screenWidth  ? context->bitmapWidth  : screenWidth;
+    int bitmapHeight    = context->bitmapHeight < screenHeight ? context->bitmapHeight : screenHeight;
+
+    dbgInfo("==> Display mode changed, reconfiguring ...");
+    if (!reconfigure_context(context, screenWidth, screenHeight, bitmapWidth, bitmapHeight))
+    {
+        dbgErr("==> Failed to reconfigure for the new display mode");
+    }
+    budget_reset(&context->budget);
+}
+
+/**
+ * Captures the screen into the pixel buffer.
+ * 
+ * Rows which changed since the last frame are marked as stale
+ * and the frame id is incremented if anything changed at all.
+ * If capturing failed, the buffer still holds the previous frame.
+ * 
+ * @param timestamps Receives the time each step of the capture finished
+ * 
+ * @return CAPTURE_UNCHANGED if the frame equals the previous one
+ */
+static capture_result capture_frame(ambient_context* context, capture_timestamps* timestamps)
+{
+    timestamps->started = stats_now();
+    detect_display_change(context);
+#ifdef _WIN32
+    if (context->gpuReduction)
+        return capture_gpu(context, timestamps);
+#endif
+
+    // A pipelined frame was captured earlier, its pixels replace the pixel buffer until the next new frame
+    capture_result result;
+    unsigned char* dirtyRows = context->dirtyRows;
+    if (context->pipelined)
+    {
+        result = pipeline_next(&context->pipeline, timestamps, &context->pixelBuffer, &dirtyRows);
+        timestamps->dequeued = stats_now();
+    }
+    else
+    {
+        result = capture_backend(context, context->pixelBuffer, dirtyRows, timestamps);
+        timestamps->dequeued = timestamps->readBack;
+    }
+
+    if (result != CAPTURE_OK)
+        return result;
+
+    // Unless the backend knows exactly what changed (DXGI), every row is compared to the last frame
+    bool verify = !context->capture->exactDirtyRows;
+    bool changed = false;
+    for (int y = 0; y < context->bitmapHeight; y++)
+    {
+        if (!dirtyRows[y])
+            continue;
+
+        if (verify)
+        {
+            unsigned long long checksum = row_checksum(context->pixelBuffer + y * context->bitmapWidth,
+                context->bitmapWidth);
+            if (context->frameId != 0 && checksum == context->rowChecksums[y])
+                continue;
+            context->rowChecksums[y] = checksum;
+        }
+        context->staleRows[y] = 1;
+        changed = true;
+    }
+
+    if (!changed && context->frameId != 0)
+        return CAPTURE_UNCHANGED;
+
+    context->frameId++;
+    return CAPTURE_OK;
+}
+
+/**
+ * Records the timing of a frame, which just finished.
+ * 
+ * The reduce stage covers everything after the frame was dequeued,
+ * i.e. the change detection and the calculation of the result.
+ * The total includes the time a pipelined frame waited to be reduced.
+ */
+static void record_frame(ambient_context* context, const capture_timestamps* timestamps, capture_result result)
+{
+    long long start = timestamps->started;
+    long long end = stats_now();
+
+    std::lock_guard<std::mutex> lock(context->statsLock);
+    frame_stats* stats = &context->stats;
+    stats->frames++;
+    if (result == CAPTURE_OK)           stats->changed++;
+    else if (result == CAPTURE_FAILED)  stats->dropped++;
+    else                                stats->unchanged++;
+
+    if (timestamps->copied)
+        stats_record(stats, STAGE_CAPTURE, stats_elapsed_ms(start, timestamps->copied));
+    if (timestamps->copied && timestamps->readBack)
+    {
+        stats_record(stats, STAGE_READBACK, stats_elapsed_ms(timestamps->copied, timestamps->readBack));
+        stats_record(stats, STAGE_REDUCE, stats_elapsed_ms(timestamps->dequeued, end));
+    }
+    stats_record(stats, STAGE_TOTAL, stats_elapsed_ms(start, end));
+}
+
+/**
+ * Feeds the time of the specified frame into the latency budget,
+ * and resizes the bitmap if the budget asks for it.
+ * 
+ * This runs after the result of the frame was calculated, so the reallocation
+ * delays the next frame instead of the current one.
+ */
+static void adapt_to_budget(ambient_context* context, const capture_timestamps* timestamps)
+{
+    // Frames without a readback (e.g. no new DXGI frame) do not reflect the cost of the bitmap
+    if (context->budget.budgetMs <= 0 || !timestamps->readBack)
+        return;
+
+    // The time a pipelined frame waited to be reduced does not count
+    float frameMs = stats_elapsed_ms(timestamps->started, timestamps->readBack)
+        + stats_elapsed_ms(timestamps->dequeued, stats_now());
+    float scale = budget_update(&context->budget, frameMs);
+    if (scale == 1)
+        return;
+
+    int width   = (int) (context->bitmapWidth  * scale + 0.5f);
+    int height  = (int) (context->bitmapHeight * scale + 0.5f);
+    if (width  < BITMAP_MIN_SIZE)       width   = BITMAP_MIN_SIZE;
+    if (height < BITMAP_MIN_SIZE)       height  = BITMAP_MIN_SIZE;
+    if (width  > context->screenWidth)  width   = context->screenWidth;
+    if (height > context->screenHeight) height  = context->screenHeight;
+    if (width == context->bitmapWidth && height == context->bitmapHeight)
+        return;
+
+    dbgInfo("==> Resizing the bitmap to fit the latency budget ...");
+    if (!resize_bitmap(context, width, height))
+    {
+        dbgErr("==> Failed to resize the bitmap");
+    }
+}
+
+/**
+ * Updates the active area if the letterbox detection found different bars in a new frame.
+ */
+static void detect_letterbox(ambient_context* context, capture_result result)
+{
+    if (result == CAPTURE_OK && !context->gpuReduction && letterbox_update(&context->letterbox,
+        (const COLOR*) context->pixelBuffer, context->bitmapWidth, context->bitmapHeight))
+        update_area(context);
+}
+
+/**
+ * Captures the screen and calculates its hue.
+ * 
+ * @param timestamps Receives the time each step of the capture finished
+ */
+static HUE capture_hue(ambient_context* context, capture_timestamps* timestamps)
+{
+    *timestamps = { 0, 0, 0, 0 };
+    capture_result result = capture_frame(context, timestamps);
+    detect_letterbox(context, result);
+
+    // Unchanged frames cost nothing but the capture
+    if (context->hueFrameId != context->frameId)
+    {
+        context->lastHue    = context->hueMode == HUE_MODE_DOMINANT ? dominant_hue(context) : average_hue(context);
+        context->hueFrameId = context->frameId;
+    }
+
+    record_frame(context, timestamps, result);
+    adapt_to_budget(context, timestamps);
+
+    // A replay is smoothed on the clock of its frames, which may be processed faster than real time
+    long long time = context->backend == BACKEND_REPLAY ? context->replay.frameTime : timestamps->started;
+    return hue_filter_update(&context->filter, context->lastHue, time);
+}
+
+/**
+ * Initializes the capture backend of a new context, falling back to the native backend
+ * of the platform if the requested one is not available.
+ * 
+ * @return false if capturing is not possible at all
+ */
+static bool initialize_backend(ambient_context* context, const ambient_config* config,
+                               const monitor_info* monitor, const sample_grid* grid)
+{
+    int bitmapWidth = context->bitmapWidth, bitmapHeight = context->bitmapHeight;
+    context->backend = config->backend;
+    if (context->backend == BACKEND_REPLAY)
+    {
+        context->capture        = &replay_interface;
+        context->captureState   = &context->replay;
+        return replay_initialize(&context->replay, context->screenWidth, context->screenHeight,
+            bitmapWidth, bitmapHeight, grid);
+    }
+
+#ifdef _WIN32
+    HMONITOR handle = (HMONITOR) monitor->handle;
+    if (context->backend == BACKEND_DXGI && config->gpuReduction && !grid)
+    {
+        // Fall back to reading back the frames if compute shaders are not available
+        context->gpuReduction = dxgi_initialize(&context->dxgi, handle, bitmapWidth, bitmapHeight, NULL, true, false)
+            && gpu_reduction_initialize(&context->gpu, context->dxgi.device, context->dxgi.context);
+        if (!context->gpuReduction)
+            dxgi_uninitialize(&context->dxgi);
+    }
+
+    if (context->backend == BACKEND_DXGI)
+    {
+        if (context->gpuReduction
+            || dxgi_initialize(&context->dxgi, handle, bitmapWidth, bitmapHeight, grid, false, config->hdr != 0))
+        {
+            context->capture        = &dxgi_interface;
+            context->captureState   = &context->dxgi;
+            return true;
+        }
+        dbgErr("==> DXGI capture not available, falling back to GDI");
+    }
+
+    // A backend which failed to initialize is still released by ambient_destroy()
+    context->backend        = BACKEND_GDI;
+    context->capture        = &gdi_interface;
+    context->captureState   = &context->gdi;
+    return gdi_initialize(&context->gdi, handle, context->screenWidth, context->screenHeight,
+        bitmapWidth, bitmapHeight, grid);
+#else
+    // X11 is the only native backend, the Windows ones fall back to it
+    context->backend        = BACKEND_X11;
+    context->capture        = &x11_interface;
+    context->captureState   = &context->x11;
+    return x11_initialize(&context->x11, monitor, context->screenWidth, context->screenHeight,
+        bitmapWidth, bitmapHeight, grid);
+#endif
+}
+
+/**
+ * Creates a context capturing the specified area of a monitor.
+ * A replay has no monitor, its frames have the specified size instead.
+ * 
+ * @param screenWidth The width of the area to capture, 0 to capture the whole monitor
+ * @param screenHeight The height of the area to capture, 0 to capture the whole monitor
+ */
+static ambient_context* create_context(int monitorIndex, int screenWidth, int screenHeight,
+                                       const ambient_config* config)
+{
+    std::call_once(g_globalsInitialized, initialize_globals);
+
+    bool replay = config->backend == BACKEND_REPLAY;
+    monitor_info monitor = { NULL, 0, 0, screenWidth, screenHeight };
+    bool found = replay || monitor_find(monitorIndex, &monitor);
+    bool resample = config->sampling == SAMPLING_RESAMPLE;
+    if ((replay ? screenWidth <= 0 || screenHeight <= 0 : !found)
+        || (resample && (config->bitmapWidth <= 0 || config->bitmapHeight <= 0)))
+    {
+        dbgErr("==> Invalid monitor or bitmap size");
+        return NULL;
+    }
+
+    ambient_context* context = new ambient_context();
+    context->screenWidth    = screenWidth  > 0 ? screenWidth  : monitor.width;
+    context->screenHeight   = screenHeight > 0 ? screenHeight : monitor.height;
+    context->bitmapWidth    = config->bitmapWidth;
+    context->bitmapHeight   = config->bitmapHeight;
+    context->monitorIndex   = monitorIndex;
+    context->monitor        = monitor;
+    context->latestHue.store(-1.0f);
+    throttle_configure(&context->throttle, NULL);
+
+    // Without resampling the size of the sample grid replaces the bitmap size
+    const sample_grid* grid = NULL;
+    if (!resample)
+    {
+        if (!sample_grid_initialize(&context->grid, config->sampling, config->sampleStrideX,
+            config->sampleStrideY, context->screenWidth, context->screenHeight))
+        {
+            dbgErr("==> Failed to allocate the sample grid");
+            ambient_destroy(context);
+            return NULL;
+        }
+        grid = &context->grid;
+        context->bitmapWidth    = grid->width;
+        context->bitmapHeight   = grid->height;
+    }
+
+    dbgInfo("==> Allocating resources ...")
+    int bitmapWidth = context->bitmapWidth, bitmapHeight = context->bitmapHeight;
+    context->hues           = (unsigned int*)       malloc(HUE_RANGE * sizeof(unsigned int));
+    context->rowChecksums   = (unsigned long long*) malloc(bitmapHeight * sizeof(unsigned long long));
+    context->rowSums        = (unsigned long long*) malloc(bitmapHeight * 3 * sizeof(unsigned long long));
+    context->dirtyRows      = (unsigned char*)      malloc(bitmapHeight);
+    context->staleRows      = (unsigned char*)      malloc(bitmapHeight);
+    if (!context->hues || !context->rowChecksums
+        || !context->rowSums || !context->dirtyRows || !context->staleRows)
+    {
+        dbgErr("==> Failed to allocate resources");
+        ambient_destroy(context);
+        return NULL;
+    }
+    context->rowCapacity = bitmapHeight;
+    memset(context->staleRows, 1, bitmapHeight);
+    clear_buffers(context);
+    letterbox_configure(&context->letterbox, 0, bitmapWidth, bitmapHeight);
+    update_area(context);
+
+    dbgInfo("==> Preparing capture ...");
+    if (!initialize_backend(context, config, &monitor, grid))
+    {
+        dbgErr("==> Screen capture not available");
+        ambient_destroy(context);
+        return NULL;
+    }
+
+    // GDI downscales straight into its DIB section, which is summed in place.
+    // The other backends copy each frame into a buffer of our own,
+    // or into the slots of the pipeline if frames are captured ahead.
+    // A replay is never captured ahead, as each frame is only submitted right before it is processed.
+    context->pipelined = config->pipelineDepth > 1 && !context->gpuReduction && !replay;
+    if (context->pipelined)
+    {
+        if (!pipeline_initialize(&context->pipeline, config->pipelineDepth, bitmapWidth, bitmapHeight,
+            capture_backend, context))
+        {
+            dbgErr("==> Failed to allocate resources");
+            ambient_destroy(context);
+            return NULL;
+        }
+        context->pixelBuffer = pipeline_pixels(&context->pipeline);
+    }
+#ifdef _WIN32
+    else if (context->backend == BACKEND_GDI && context->gdi.pixels)
+    {
+        context->pixelBuffer = context->gdi.pixels;
+    }
+#endif
+    else
+    {
+        context->pixelBuffer        = (COLORREF*) calloc(bitmapWidth * bitmapHeight, sizeof(COLORREF));
+        context->pixelCapacity      = (size_t) bitmapWidth * bitmapHeight;
+        context->ownsPixelBuffer    = true;
+        if (!context->pixelBuffer)
+        {
+            dbgErr("==> Failed to allocate resources");
+            ambient_destroy(context);
+            return NULL;
+        }
+    }
+
+    dbgInfo("==> Done");
+    return context;
+}
+
+/**
+ * Returns the amount of monitors which can be captured.
+ */
+AMBIENT_API int ambient_get_monitor_count()
+{
+    return monitor_count();
+}
+
+/**
+ * Creates a context capturing the specified monitor.
+ * 
+ * Each context owns all of its resources, so several monitors
+ * can be captured concurrently from separate threads.
+ * 
+ * @param monitorIndex The monitor to capture, where 0 is the primary monitor
+ * @param config The size of the downscaled screenshot (or the sampling stride) and the capture backend to use
+ * 
+ * @return The context, or NULL if the monitor does not exist or capturing is not possible.
+ *         Release it using ambient_destroy().
+ * 
+ * Note:    If the DXGI backend is not available (e.g. prior to Windows 8),
+ *          the context falls back to GDI. Other platforms always capture with X11.
+ *          Use ambient_get_backend() to query the backend which is actually in use.
+ *          With gpuReduction set, the full resolution frames are reduced by a compute shader
+ *          and only the results are read back. If compute shaders are not available,
+ *          the context reads back the downscaled frames as usual.
+ */
+AMBIENT_API ambient_context* ambient_create(int monitorIndex, const ambient_config* config)
+{
+    dbgInfo("Creating Ambient context ...");
+    return create_context(monitorIndex, 0, 0, config);
+}
+
+/**
+ * Creates a context processing frames supplied by the caller instead of capturing a monitor,
+ * e.g. to evaluate the colors of a recorded video without playing it back (see ambient_submit_frame).
+ * 
+ * @param width The width of the submitted frames
+ * @param height The height of the submitted frames
+ * @param config Like ambient_create(), the backend is ignored
+ * 
+ * @return The context, or NULL if a size is invalid. Release it using ambient_destroy().
+ * 
+ * Note:    Reconfiguring the context changes the size of the frames,
+ *          passing 0 as the screen size restores the size passed here.
+ */
+AMBIENT_API ambient_context* ambient_create_replay(int width, int height, const ambient_config* config)
+{
+    dbgInfo("Creating Ambient replay context ...");
+    ambient_config replay = *config;
+    replay.backend = BACKEND_REPLAY;
+    return create_context(-1, width, height, &replay);
+}
+
+/**
+ * Changes the captured area and the size of the downscaled screenshot of a context.
+ * 
+ * Unlike destroying and creating the context again, the buffers are reused as long as they
+ * are large enough and the capture objects are only replaced if their size changed,
+ * so neither memory nor GDI handles churn. Changes of the display mode (resolution, DPI)
+ * are detected by every capture and followed automatically, so this is only needed
+ * to pick different sizes. Capturing resumes with the next frame.
+ * 
+ * @param screenWidth The width of the area to capture, 0 to capture the whole monitor
+ * @param screenHeight The height of the area to capture, 0 to capture the whole monitor
+ * @param bitmapWidth The width of the downscaled screenshot, ignored if the screen is sampled
+ * @param bitmapHeight The height of the downscaled screenshot, ignored if the screen is sampled
+ * 
+ * @return 0 if the sizes could not be applied, the previous ones are kept in that case
+ */
+AMBIENT_API int ambient_reconfigure(ambient_context* context, int screenWidth, int screenHeight,
+                                    int bitmapWidth, int bitmapHeight)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    if (!context->grid.width && (bitmapWidth <= 0 || bitmapHeight <= 0))
+        return 0;
+
+    detect_display_change(context);
+    if (screenWidth  <= 0) screenWidth  = context->monitor.width;
+    if (screenHeight <= 0) screenHeight = context->monitor.height;
+    if (!reconfigure_context(context, screenWidth, screenHeight, bitmapWidth, bitmapHeight))
+        return 0;
+
+    budget_reset(&context->budget);
+    return 1;
+}
+
+/**
+ * Stops the capture thread of the specified context and frees all of its resources.
+ */
+AMBIENT_API void ambient_destroy(ambient_context* context)
+{
+    if (!context)
+        return;
+
+    dbgInfo("Destroying Ambient context ...");
+    ambient_stop_capture(context);
+    if (context->output.open)
+        output_close(&context->output);
+    shared_publish_close(&context->publisher);
+
+    // The worker of the pipeline uses the backend
+    if (context->pipelined)
+        pipeline_uninitialize(&context->pipeline);
+
+    dbgInfo("==> Deallocating resources ...");
+    worker_pool_uninitialize(&context->workers);
+    free(context->workerHues);
+    free(context->hues);
+    if (context->ownsPixelBuffer)
+        free(context->pixelBuffer);
+    free(context->rowChecksums);
+    free(context->rowSums);
+    free(context->dirtyRows);
+    free(context->staleRows);
+    zones_uninitialize(&context->zones);
+    zones_release_integral(&context->integral);
+    palette_uninitialize(&context->palette);
+    free(context->gpuRects);
+    free(context->gpuSums);
+#ifdef _WIN32
+    gpu_reduction_uninitialize(&context->gpu);
+#endif
+    if (context->capture)
+        context->capture->uninitialize(context->captureState);
+    sample_grid_uninitialize(&context->grid);
+    delete context;
+    dbgInfo("==> Done");
+}
+
+/**
+ * Returns the capture backend which is in use.
+ * 
+ * This may differ from the backend passed to ambient_create(),
+ * if it was not available on this machine.
+ */
+AMBIENT_API CAPTURE_BACKEND ambient_get_backend(ambient_context* context)
+{
+    return context->backend;
+}
+
+/**
+ * Returns the current hue of the screen.
+ * 
+ * This function takes a screenshot of the entire screen and
+ * determines its hue, either from the average color or by counting
+ * the occurrences of each hue (see ambient_set_hue_mode).
+ * 
+ * The returned hue can then be used to calculate a color
+ * using the HSBtoRGB function.
+ * 
+ * If the screen did not change since the last call, the previous hue is returned.
+ * Otherwise only the rows which actually changed are summed again.
+ * 
+ * Note:    This function blocks until the capture is done.
+ *          Use ambient_start_capture() and ambient_get_latest_hue() to capture asynchronously.
+ */
+AMBIENT_API HUE ambient_get_hue(ambient_context* context)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    capture_timestamps timestamps;
+    return capture_hue(context, &timestamps);
+}
+
+/**
+ * Selects how ambient_get_hue() determines the hue of the screen.
+ * 
+ * HUE_MODE_AVERAGE returns the hue of the average color of all pixels,
+ * which tends to result in muddy colors on colorful content.
+ * HUE_MODE_DOMINANT builds a histogram of the hues of all pixels, weighted by
+ * their saturation and brightness, and returns its peak.
+ */
+AMBIENT_API void ambient_set_hue_mode(ambient_context* context, HUE_MODE mode)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    context->hueMode    = mode;
+    context->hueFrameId = context->frameId - 1;
+}
+
+/**
+ * Selects the color space the pixels are averaged in, for the hue and the zones.
+ * 
+ * COLOR_SPACE_SRGB (the default) averages the captured values directly, which lets
+ * dark pixels weigh too much and turns mixed colors grey and dull.
+ * COLOR_SPACE_LINEAR averages in linear light, COLOR_SPACE_OKLAB in the perceptually uniform
+ * OKLab space. Both map every pixel through a lookup table while summing it, so they cost
+ * about the same as sRGB; only the averages are converted back. Like the hue histogram,
+ * OKLab looks up the RGB565 value of a pixel, which shifts averages by up to 4 levels.
+ * 
+ * Note:    The GPU reduction (see ambient_config::gpuReduction) always averages in sRGB.
+ *          The zones do not use the summed-area table outside of sRGB.
+ */
+AMBIENT_API void ambient_set_color_space(ambient_context* context, COLOR_SPACE space)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    if (context->colorSpace == space)
+        return;
+
+    // The cached row sums are those of the previous color space
+    context->colorSpace = space;
+    memset(context->staleRows, 1, context->bitmapHeight);
+    context->hueFrameId     = context->frameId - 1;
+    context->zoneFrameId    = context->frameId - 1;
+}
+
+/**
+ * Sets the tone curve HDR frames of the specified context are mapped into the SDR range with.
+ * 
+ * With ambient_config::hdr set, the DXGI backend duplicates HDR displays as linear half floats
+ * instead of letting Windows convert them to 8 bits, which clips and washes out the colors.
+ * Each frame is exposed so SDR white becomes the white of the captured image, tone mapped
+ * and encoded as sRGB while it is read back (using F16C if available), so the hue, the zones
+ * and the palette are calculated exactly like for SDR displays. The default is TONE_MAP_CLIP
+ * with the brightness settings of the display.
+ * 
+ * @param mode The curve highlights above SDR white are mapped with
+ * @param paperWhiteNits The brightness of SDR white, 0 for the SDR content brightness set in Windows
+ * @param peakNits The brightness TONE_MAP_REINHARD maps to white, 0 for the peak brightness of the display
+ * 
+ * @return Nonzero if the context captures HDR frames, otherwise the curve has no effect
+ *         (SDR display, GDI or X11 backend, GPU reduction or ambient_config::hdr not set)
+ * 
+ * Note:    The curve applies to the next frame, even if the desktop does not change.
+ */
+AMBIENT_API int ambient_set_tone_map(ambient_context* context, TONE_MAP mode, float paperWhiteNits, float peakNits)
+{
+#ifdef _WIN32
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    if (context->backend != BACKEND_DXGI || context->gpuReduction)
+        return 0;
+
+    // The worker of the pipeline reads back with the curve
+    if (context->pipelined)
+        pipeline_stop(&context->pipeline);
+    return dxgi_set_tone_map(&context->dxgi, mode, paperWhiteNits, peakNits);
+#else
+    // Only DXGI captures HDR frames
+    (void) context;
+    (void) mode;
+    (void) paperWhiteNits;
+    (void) peakNits;
+    return 0;
+#endif
+}
+
+/**
+ * Enables temporal smoothing of the hue returned by the specified context.
+ * 
+ * The hue follows the captured hue using an exponential moving average,
+ * along the shorter arc of the hue circle (e.g. from 350° to 10° via 0°).
+ * As the filter is based on time instead of frames, smoothness stays
+ * the same when capturing less often.
+ * 
+ * @param timeConstantMs Time in which the hue covers ~63% of a change, 0 disables the average
+ * @param maxSlewRate Maximum change of the hue in degrees per second, 0 for no limit
+ * 
+ * Note:    Both parameters set to 0 disable smoothing, which is the default.
+ */
+AMBIENT_API void ambient_set_smoothing(ambient_context* context, float timeConstantMs, float maxSlewRate)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    hue_filter_configure(&context->filter, timeConstantMs, maxSlewRate);
+}
+
+/**
+ * Lets the specified context adapt the size of its bitmap to a latency budget.
+ * 
+ * The time spent capturing and reducing each frame is measured, and the bitmap
+ * shrinks while the frames take longer than the budget or grows (up to the size
+ * of the screen) while they take clearly less. The bitmap size passed on creation
+ * is the starting point. Resizing happens between two frames and keeps the zones.
+ * 
+ * @param budgetMs The time a frame may take, e.g. 2 ms, 0 keeps the current size from now on
+ * 
+ * @return 0 if the bitmap size is fixed, i.e. the screen is sampled or reduced on the GPU
+ */
+AMBIENT_API int ambient_set_latency_budget(ambient_context* context, float budgetMs)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    if (context->grid.width || context->gpuReduction)
+        return 0;
+
+    budget_configure(&context->budget, budgetMs);
+    return 1;
+}
+
+/**
+ * Returns the current size of the bitmap the screen is downscaled to,
+ * which changes over time if a latency budget is set.
+ * If the screen is sampled, this is the size of the sample grid.
+ */
+AMBIENT_API void ambient_get_bitmap_size(ambient_context* context, int* width, int* height)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    *width  = context->bitmapWidth;
+    *height = context->bitmapHeight;
+}
+
+/**
+ * Splits the reduction of large frames (e.g. native resolution sample grids)
+ * into row tiles, which are processed by a pool of persistent threads.
+ * 
+ * Each thread keeps its own partial results, which are merged after all tiles
+ * are done. Frames below 64K pixels are always reduced on the calling thread.
+ * 
+ * @param threads The amount of threads, including the one capturing. 1 or less reduces serially (the default).
+ * @param affinityMask The processors the additional threads may run on, e.g. to keep them
+ *                     off the cores of a game, 0 for any
+ * 
+ * @return 0 if the threads could not be started, the reduction is serial in that case
+ */
+AMBIENT_API int ambient_set_reduce_threads(ambient_context* context, int threads, unsigned long long affinityMask)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    worker_pool_uninitialize(&context->workers);
+    free(context->workerHues);
+    context->workerHues = NULL;
+    if (threads <= 1)
+        return 1;
+
+    context->workerHues = (unsigned int*) malloc(threads * HUE_RANGE * sizeof(unsigned int));
+    if (!context->workerHues || !worker_pool_initialize(&context->workers, threads, affinityMask))
+    {
+        dbgErr("Failed to start the reduce threads");
+        worker_pool_uninitialize(&context->workers);
+        free(context->workerHues);
+        context->workerHues = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Restricts the hue to a region of the screen, e.g. the window of a video player.
+ * 
+ * The whole screen is still captured, as the zones may cover any part of it,
+ * but only the pixels inside the region are reduced.
+ * 
+ * @param x The left edge of the region in screen coordinates (relative to the monitor)
+ * @param y The top edge of the region
+ * @param width The width of the region, 0 for the whole screen
+ * @param height The height of the region, 0 for the whole screen
+ */
+AMBIENT_API void ambient_set_roi(ambient_context* context, int x, int y, int width, int height)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    ZONE roi = { x, y, width, height };
+    context->roi = roi;
+    update_area(context);
+    context->hueFrameId     = context->frameId - 1;
+    context->paletteFrameId = context->frameId - 1;
+}
+
+/**
+ * Detects black letterbox (and pillarbox) bars, which are then excluded from the hue.
+ * 
+ * The edges of the captured frame are scanned every few new frames, which only reads
+ * the bars themselves and a single line of picture per edge. A change of the bars
+ * has to be found twice in a row before it is applied. Dark scenes, in which no
+ * picture is found close to an edge, keep the bars of the previous scan.
+ * Not available with the GPU reduction, which never reads back the frame.
+ * 
+ * @param intervalFrames The amount of new frames between two scans, 0 disables the detection
+ */
+AMBIENT_API void ambient_set_letterbox_detection(ambient_context* context, int intervalFrames)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    letterbox_configure(&context->letterbox, intervalFrames, context->bitmapWidth, context->bitmapHeight);
+    update_area(context);
+    context->hueFrameId     = context->frameId - 1;
+    context->paletteFrameId = context->frameId - 1;
+}
+
+/**
+ * Returns the part of the screen the hue is currently calculated from,
+ * i.e. the ROI without the detected bars.
+ * 
+ * @param dest Receives the area in screen coordinates (relative to the monitor)
+ */
+AMBIENT_API void ambient_get_active_area(ambient_context* context, ZONE* dest)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    int width = context->bitmapWidth, height = context->bitmapHeight;
+    const zone_rect* area = &context->area;
+#ifdef _WIN32
+    if (context->gpuReduction)
+    {
+        width   = context->dxgi.screenWidth;
+        height  = context->dxgi.screenHeight;
+        roi_rect(context, width, height, &context->gpuArea);
+        area    = &context->gpuArea;
+    }
+#endif
+
+    dest->x         = area->x0 * context->screenWidth  / width;
+    dest->y         = area->y0 * context->screenHeight / height;
+    dest->width     = area->x1 * context->screenWidth  / width  - dest->x;
+    dest->height    = area->y1 * context->screenHeight / height - dest->y;
+}
+
+/**
+ * Calculates the colors of the zones from the current frame, unless they are up to date.
+ */
+static void update_zone_colors(ambient_context* context)
+{
+    if (context->zoneFrameId == context->frameId)
+        return;
+
+    if (context->gpuReduction)
+        zones_average(context->gpuRects, context->gpuSums + 3, context->zones.count, COLOR_SPACE_SRGB,
+            context->zones.colors);
+    else
+        zones_reduce(&context->zones, (const COLOR*) context->pixelBuffer, context->bitmapWidth,
+            context->bitmapHeight, context->zoneReduction, context->colorSpace, &context->integral);
+    context->zoneFrameId = context->frameId;
+}
+
+/**
+ * Replaces the zones, the capture lock must be held.
+ * 
+ * @return 0 if the zones could not be allocated
+ */
+static int set_zones(ambient_context* context, const ZONE* zones, int count)
+{
+    zones_uninitialize(&context->zones);
+    context->zoneFrameId = context->frameId - 1;
+    if (!zones_initialize(&context->zones, zones, count, context->screenWidth, context->screenHeight,
+        context->bitmapWidth, context->bitmapHeight))
+    {
+        dbgErr("Failed to allocate zones");
+        return 0;
+    }
+
+    // Lay out the packets now instead of inside the capture thread
+    if (context->output.open)
+        output_reserve(&context->output, count > 0 ? count : 1);
+    return 1;
+}
+
+/**
+ * Sets the zones calculated by ambient_get_zone_colors().
+ * 
+ * All zones are calculated from a single capture,
+ * so the capture cost does not depend on the amount of zones.
+ * 
+ * @param zones The zones in screen coordinates (relative to the monitor), may overlap each other
+ * @param count The amount of zones, 0 removes all zones
+ * 
+ * @return 0 if the zones could not be allocated
+ */
+AMBIENT_API int ambient_set_zones(ambient_context* context, const ZONE* zones, int count)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    return set_zones(context, zones, count);
+}
+
+/**
+ * Sets zones along the edges of the screen, e.g. for an LED strip around the bezel.
+ * 
+ * The zones are ordered clockwise starting at the top left corner:
+ * top (left to right), right (top to bottom), bottom (right to left)
+ * and left (bottom to top).
+ * 
+ * @param top The amount of zones along the top edge
+ * @param bottom The amount of zones along the bottom edge
+ * @param left The amount of zones along the left edge
+ * @param right The amount of zones along the right edge
+ * @param depth The distance in screen pixels each zone reaches into the screen
+ * 
+ * @return 0 if a count is negative, the depth is not positive or the zones could not be allocated
+ */
+AMBIENT_API int ambient_set_edge_zones(ambient_context* context, int top, int bottom, int left, int right, int depth)
+{
+    // The layout writes each edge on its own, so a negative count must not shrink the buffer of the others
+    if (top < 0 || bottom < 0 || left < 0 || right < 0 || depth <= 0)
+        return 0;
+
+    int count = top + bottom + left + right;
+    ZONE* zones = (ZONE*) malloc((count > 0 ? count : 1) * sizeof(ZONE));
+    if (!zones)
+        return 0;
+
+    // The layout depends on the screen size, which a reconfiguration may change in the meantime
+    int success;
+    {
+        std::lock_guard<std::mutex> lock(context->captureLock);
+        count = zones_edge_layout(zones, top, bottom, left, right, depth, context->screenWidth, context->screenHeight);
+        success = set_zones(context, zones, count);
+    }
+    free(zones);
+    return success;
+}
+
+/**
+ * Captures the screen and calculates the average color of each zone.
+ * 
+ * @param dest Receives the colors in the order the zones were specified in
+ * @param count The amount of colors dest can hold
+ * 
+ * @return The amount of colors written to dest
+ */
+AMBIENT_API int ambient_get_zone_colors(ambient_context* context, COLOR* dest, int count)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    capture_timestamps timestamps = { 0, 0, 0, 0 };
+    capture_result result = capture_frame(context, &timestamps);
+    update_zone_colors(context);
+    record_frame(context, &timestamps, result);
+    adapt_to_budget(context, &timestamps);
+
+    if (count > context->zones.count)
+        count = context->zones.count;
+    if (count <= 0)
+        return 0;
+
+    memcpy(dest, context->zones.colors, count * sizeof(COLOR));
+    return count;
+}
+
+/**
+ * Selects how ambient_get_zone_colors() sums the zones.
+ * 
+ * ZONE_REDUCTION_INTEGRAL builds a summed-area table of the pixel buffer once per frame,
+ * after which every zone costs four lookups regardless of its size. This pays off
+ * with many overlapping zones (e.g. smoothing windows or shared corner LEDs).
+ * ZONE_REDUCTION_AUTO (the default) decides based on how much the zones cover.
+ */
+AMBIENT_API void ambient_set_zone_reduction(ambient_context* context, ZONE_REDUCTION reduction)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    context->zoneReduction = reduction;
+}
+
+/**
+ * Extracts the palette of the active area of the current frame, unless it is up to date.
+ */
+static void update_palette(ambient_context* context, int colors)
+{
+    if (context->paletteFrameId == context->frameId && context->paletteColors == colors)
+        return;
+
+    const zone_rect* area = &context->area;
+    const COLOR* pixels = (const COLOR*) context->pixelBuffer;
+    int width = area->x1 - area->x0;
+    palette_clear(&context->palette);
+    if (width == context->bitmapWidth)
+        palette_accumulate(&context->palette, pixels + area->y0 * width, (area->y1 - area->y0) * width);
+    else
+        for (int y = area->y0; y < area->y1; y++)
+            palette_accumulate(&context->palette, pixels + y * context->bitmapWidth + area->x0, width);
+
+    palette_extract(&context->palette, colors);
+    context->paletteColors  = colors;
+    context->paletteFrameId = context->frameId;
+}
+
+/**
+ * Captures the screen and returns its dominant colors, e.g. for a scene palette.
+ * 
+ * The colors are found using median cut over a histogram of the active area
+ * (see ambient_set_roi), so the cost of a frame is bounded and independent of the content.
+ * The capture is the same as that of ambient_get_hue(), an unchanged frame
+ * returns the previous palette.
+ * 
+ * @param dest Receives the colors, most frequent first
+ * @param count The amount of colors to extract, at most 32
+ * 
+ * @return The amount of colors written to dest, which is less than count if the frame
+ *         does not have as many distinct colors, 0 on failure or with GPU reduction
+ */
+AMBIENT_API int ambient_get_palette(ambient_context* context, COLOR* dest, int count)
+{
+    if (count > PALETTE_MAX_COLORS)
+        count = PALETTE_MAX_COLORS;
+    if (count <= 0)
+        return 0;
+
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    if (context->gpuReduction)
+        return 0;
+    if (!context->palette.histogram && !palette_initialize(&context->palette))
+    {
+        dbgErr("==> Failed to allocate the palette");
+        return 0;
+    }
+
+    capture_timestamps timestamps = { 0, 0, 0, 0 };
+    capture_result result = capture_frame(context, &timestamps);
+    detect_letterbox(context, result);
+    update_palette(context, count);
+    record_frame(context, &timestamps, result);
+    adapt_to_budget(context, &timestamps);
+
+    count = context->palette.count;
+    memcpy(dest, context->palette.colors, count * sizeof(COLOR));
+    return count;
+}
+
+/**
+ * Streams the hue of the current frame (or the colors of its zones) to the LED output.
+ * Unchanged colors are only sent again to keep the controllers in realtime mode.
+ */
+static void send_output(ambient_context* context, HUE hue)
+{
+    if (context->outputFrameId == context->frameId && context->outputHue == hue
+        && !output_needs_keepalive(&context->output))
+        return;
+    context->outputFrameId  = context->frameId;
+    context->outputHue      = hue;
+
+    // Without zones all LEDs show the hue, at full saturation and brightness
+    if (context->zones.count > 0)
+    {
+        update_zone_colors(context);
+        output_send(&context->output, context->zones.colors, context->zones.count);
+    }
+    else
+    {
+        COLOR color = HSBtoRGB(hue, 1.0f, 1.0f);
+        output_send(&context->output, &color, 1);
+    }
+}
+
+/**
+ * Streams the colors captured by the capture thread to LED controllers,
+ * without another process between the library and the LEDs.
+ * 
+ * Each new frame of ambient_start_capture() (or ambient_start_paced_capture()) is sent
+ * right after it was reduced. With zones, one LED is sent per zone in the order of the zones,
+ * otherwise a single LED showing the hue at full saturation and brightness.
+ * The packets are laid out once for the amount of LEDs, and all packets of a frame are
+ * sent back to back. Unchanged colors are repeated every second, so the controllers
+ * stay in realtime mode.
+ * 
+ * @param config The protocol and target of the output, NULL closes the output
+ * 
+ * @return 0 if the serial port or socket could not be opened
+ */
+AMBIENT_API int ambient_set_output(ambient_context* context, const ambient_output_config* config)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    if (context->output.open)
+        output_close(&context->output);
+    if (!config)
+        return 1;
+
+    if (!output_open(&context->output, config))
+        return 0;
+    output_reserve(&context->output, context->zones.count > 0 ? context->zones.count : 1);
+    context->outputFrameId = context->frameId - 1;
+    return 1;
+}
+
+/**
+ * Publishes the hue of the current frame and the colors of its zones to other processes.
+ */
+static void publish_results(ambient_context* context, HUE hue)
+{
+    if (context->zones.count > 0)
+        update_zone_colors(context);
+
+    ambient_stats stats;
+    bool withStats = shared_publish_stats_due(&context->publisher);
+    if (withStats)
+    {
+        std::lock_guard<std::mutex> lock(context->statsLock);
+        stats_summarize(&context->stats, &stats);
+    }
+    shared_publish(&context->publisher, context->frameId, hue, context->zones.colors, context->zones.count,
+        withStats ? &stats : NULL);
+}
+
+/**
+ * Publishes the results of the capture thread under the specified name,
+ * so other processes can read them with ambient_open_reader() instead of capturing the screen themselves.
+ * 
+ * Each frame of ambient_start_capture() (or ambient_start_paced_capture()) publishes its hue
+ * and the colors of up to 1024 zones, the statistics are published a few times per second.
+ * Only a single context should publish under a name, the segment is visible
+ * within the session of the user.
+ * 
+ * @param name The name of the publication, NULL stops publishing
+ * 
+ * @return 0 if the shared memory segment could not be created
+ */
+AMBIENT_API int ambient_publish(ambient_context* context, const char* name)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    shared_publish_close(&context->publisher);
+    if (!name)
+        return 1;
+
+    if (!shared_publish_open(&context->publisher, name))
+    {
+        dbgErr("Failed to create the shared memory segment");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Opens the results published by another process (see ambient_publish).
+ * Reading does not require a context and never captures the screen.
+ * 
+ * @return NULL if nothing is published under the specified name
+ */
+AMBIENT_API ambient_reader* ambient_open_reader(const char* name)
+{
+    ambient_reader* reader = (ambient_reader*) malloc(sizeof(ambient_reader));
+    if (reader && !shared_reader_open(reader, name))
+    {
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+AMBIENT_API void ambient_close_reader(ambient_reader* reader)
+{
+    if (!reader)
+        return;
+    shared_reader_close(reader);
+    free(reader);
+}
+
+/**
+ * Copies the latest published results. The copy is consistent,
+ * i.e. all values belong to the same publication.
+ * 
+ * @param dest Receives the hue and the statistics
+ * @param zones Optional, receives the colors of the zones
+ * @param zoneCapacity The amount of colors zones can hold
+ * 
+ * @return 0 if nothing was published yet, or if the publisher stopped in the middle of a publication
+ */
+AMBIENT_API int ambient_read_snapshot(ambient_reader* reader, ambient_snapshot* dest, COLOR* zones, int zoneCapacity)
+{
+    return shared_read(reader, dest, zones, zoneCapacity) ? 1 : 0;
+}
+
+/**
+ * Waits for the specified amount of display refreshes, using the vertical blank
+ * of the backend (e.g. the DXGI output) or the DWM composition.
+ */
+static void wait_for_refreshes(ambient_context* context, int count)
+{
+    const capture_interface* capture = context->capture;
+    for (int i = 0; i < count; i++)
+    {
+        if (capture->wait_for_vblank && capture->wait_for_vblank(context->captureState))
+            continue;
+#ifdef _WIN32
+        if (SUCCEEDED(DwmFlush()))
+            continue;
+#endif
+
+        // Neither is available (e.g. composition is disabled), assume a common refresh rate
+        std::this_thread::sleep_for(std::chrono::milliseconds(PACING_FALLBACK_MS));
+    }
+}
+
+/**
+ * Copies the decision of the throttle into the stats, where it can be queried without waiting for a capture.
+ * 
+ * @param changed Set if the decision changed since it was copied last
+ */
+static void report_throttle(ambient_context* context, bool changed)
+{
+    std::lock_guard<std::mutex> lock(context->statsLock);
+    context->stats.throttleReasons  = context->throttle.reasons;
+    context->stats.throttleFactor   = context->throttle.factor;
+    if (changed)
+        context->stats.throttleChanges++;
+}
+
+/**
+ * Lets the throttle decide on the frame the capture thread just captured.
+ * 
+ * @param frameEvents Set if the capture waited for the frame, as the wait is not part of its latency
+ */
+static void update_throttle(ambient_context* context, const capture_timestamps* timestamps, bool frameEvents)
+{
+    if (!context->throttle.enabled)
+        return;
+
+    // Like the latency budget, the time a pipelined frame waited to be reduced does not count
+    float frameMs = 0;
+    if (timestamps->readBack)
+    {
+        long long start = frameEvents ? timestamps->copied : timestamps->started;
+        frameMs = stats_elapsed_ms(start, timestamps->readBack)
+            + stats_elapsed_ms(timestamps->dequeued, stats_now());
+    }
+
+    // A replay has no monitor, only the power state applies to it
+    const monitor_info* monitor = context->monitorIndex >= 0 ? &context->monitor : NULL;
+    if (throttle_update(&context->throttle, monitor, frameMs))
+    {
+        dbgInfo("==> Throttling of the capture thread changed");
+        report_throttle(context, true);
+    }
+    if (context->throttle.factor > 1)
+    {
+        std::lock_guard<std::mutex> lock(context->statsLock);
+        context->stats.throttledFrames++;
+    }
+}
+
+/**
+ * Body of the capture thread, which captures until ambient_stop_capture() is called.
+ */
+static void capture_thread(ambient_context* context, CAPTURE_PACING pacing, int intervalMs, int divisor)
+{
+    // Waiting for the next frame inside the capture itself (DXGI, X11 damage) replaces the wait for a refresh
+    const capture_interface* capture = context->capture;
+    bool frameEvents = false;
+    {
+        std::lock_guard<std::mutex> lock(context->captureLock);
+        if (pacing == PACING_FRAME && capture->set_frame_timeout)
+        {
+            if (context->pipelined)
+                pipeline_stop(&context->pipeline);
+            frameEvents = capture->set_frame_timeout(context->captureState, PACING_FRAME_TIMEOUT_MS);
+        }
+
+        // Each run of the thread starts at full rate, until the throttle decides otherwise
+        throttle_reset(&context->throttle);
+        report_throttle(context, false);
+    }
+
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> threadLock(context->captureThreadLock);
+    while (!context->captureThreadStop)
+    {
+        threadLock.unlock();
+        float factor;
+        {
+            std::lock_guard<std::mutex> lock(context->captureLock);
+            capture_timestamps timestamps;
+            HUE hue = capture_hue(context, &timestamps);
+            context->latestHue.store(hue, std::memory_order_release);
+            if (context->output.open)
+                send_output(context, hue);
+            if (context->publisher.segment)
+                publish_results(context, hue);
+            update_throttle(context, &timestamps, frameEvents);
+            factor = context->throttle.factor;
+        }
+
+        if (pacing != PACING_INTERVAL)
+        {
+            // With frame events the capture waits for the last refresh itself
+            int refreshes = (int) (divisor * factor + 0.5f);
+            wait_for_refreshes(context, frameEvents ? refreshes - 1 : refreshes);
+            threadLock.lock();
+            continue;
+        }
+        threadLock.lock();
+
+        // Keep the interval independent of the time the capture took
+        next += std::chrono::milliseconds((long long) (intervalMs * factor + 0.5f));
+        if (next < std::chrono::steady_clock::now())
+            next = std::chrono::steady_clock::now();
+        context->captureThreadSignal.wait_until(threadLock, next, [context] { return context->captureThreadStop; });
+    }
+    threadLock.unlock();
+
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    if (frameEvents)
+    {
+        if (context->pipelined)
+            pipeline_stop(&context->pipeline);
+        capture->set_frame_timeout(context->captureState, 0);
+    }
+
+    // Without the thread nothing is throttled
+    throttle_reset(&context->throttle);
+    report_throttle(context, false);
+}
+
+/**
+ * Starts capturing the screen on an internal thread.
+ * 
+ * The most recent hue can be queried with ambient_get_latest_hue(),
+ * which never blocks. If the capture thread is already running,
+ * it is restarted using the new interval.
+ * 
+ * @param intervalMs The time between the start of two captures in milliseconds
+ */
+AMBIENT_API void ambient_start_capture(ambient_context* context, int intervalMs)
+{
+    ambient_stop_capture(context);
+
+    dbgInfo("Starting capture thread ...");
+    context->captureThreadStop  = false;
+    context->captureThread      = std::thread(capture_thread, context, PACING_INTERVAL,
+        intervalMs > 0 ? intervalMs : 0, 1);
+}
+
+/**
+ * Starts capturing the screen on an internal thread, in sync with the display.
+ * 
+ * Instead of a fixed interval, which either captures more often than the display
+ * refreshes or beats against it, the captures follow the refreshes of the display.
+ * 
+ * @param pacing PACING_VBLANK captures every divisor-th refresh.
+ *               PACING_FRAME additionally waits until the desktop actually changed
+ *               (DXGI, or X11 with the DAMAGE extension, behaves like PACING_VBLANK otherwise).
+ * @param divisor Captures every n-th refresh, e.g. 2 captures at 30 Hz on a 60 Hz display
+ * 
+ * Note:    With PACING_FRAME a capture waits up to PACING_FRAME_TIMEOUT_MS for a new frame
+ *          while holding the context, so other calls on the same context may be delayed.
+ *          Use ambient_get_latest_hue() to query the results.
+ */
+AMBIENT_API void ambient_start_paced_capture(ambient_context* context, CAPTURE_PACING pacing, int divisor)
+{
+    ambient_stop_capture(context);
+
+    dbgInfo("Starting capture thread ...");
+    context->captureThreadStop  = false;
+    context->captureThread      = std::thread(capture_thread, context, pacing, 0, divisor > 0 ? divisor : 1);
+}
+
+/**
+ * Stops the capture thread started by ambient_start_capture()
+ * and waits for it to finish. Does nothing if it is not running.
+ */
+AMBIENT_API void ambient_stop_capture(ambient_context* context)
+{
+    if (!context->captureThread.joinable())
+        return;
+
+    dbgInfo("Stopping capture thread ...");
+    {
+        std::lock_guard<std::mutex> lock(context->captureThreadLock);
+        context->captureThreadStop = true;
+    }
+    context->captureThreadSignal.notify_all();
+    context->captureThread.join();
+}
+
+/**
+ * Lets the capture thread slow down while it is not worth (or harmful) to capture at full rate.
+ * 
+ * On battery, the interval of ambient_start_capture() (or the divisor of ambient_start_paced_capture())
+ * is stretched by the battery factor. If a fullscreen exclusive application is in the foreground
+ * of the captured monitor, or if the captures take much longer than usual, the capture competes
+ * with another application (e.g. GDI capture makes games drop frames), so it backs off by the
+ * contention factor. If several reasons apply, the larger factor is used.
+ * 
+ * Every decision is reported through ambient_get_stats(), e.g. to tell users why the LEDs slowed down.
+ * 
+ * @param config The reasons to throttle for and the factors, NULL disables throttling
+ * 
+ * Note:    The power state and the foreground are checked about once per second.
+ *          Captures outside of the capture thread (e.g. ambient_get_hue()) are never throttled.
+ */
+AMBIENT_API void ambient_set_throttling(ambient_context* context, const ambient_throttle_config* config)
+{
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    bool throttled = context->throttle.reasons != 0;
+    throttle_configure(&context->throttle, config);
+    report_throttle(context, throttled);
+}
+
+/**
+ * Returns the hue of the most recent frame of the capture thread.
+ * 
+ * This function is wait-free and can be called from any thread,
+ * e.g. a UI or LED driver thread which must never block.
+ * 
+ * @return The latest hue, or a negative value if no frame has been captured yet
+ */
+AMBIENT_API HUE ambient_get_latest_hue(ambient_context* context)
+{
+    return context->latestHue.load(std::memory_order_acquire);
+}
+
+/**
+ * Returns the timing of each stage of the capture pipeline and the frame counters.
+ * 
+ * The timings are rolling statistics over the most recent frames, all counters
+ * start at the creation of the context (or the last ambient_reset_stats()).
+ * This function never waits for a capture in progress, so it can safely be
+ * polled from a monitoring thread.
+ */
+AMBIENT_API void ambient_get_stats(ambient_context* context, ambient_stats* dest)
+{
+    std::lock_guard<std::mutex> lock(context->statsLock);
+    stats_summarize(&context->stats, dest);
+}
+
+/**
+ * Clears the timings and frame counters of the specified context.
+ */
+AMBIENT_API void ambient_reset_stats(ambient_context* context)
+{
+    std::lock_guard<std::mutex> lock(context->statsLock);
+    int reasons = context->stats.throttleReasons;
+    float factor = context->stats.throttleFactor;
+    memset(&context->stats, 0, sizeof(context->stats));
+    context->stats.throttleReasons  = reasons;
+    context->stats.throttleFactor   = factor;
+}
+
+/**
+ * Submits a frame to a replay context, the capture lock must be held.
+ * 
+ * @param height The amount of rows of the frame, which must cover the screen of the context
+ * 
+ * @return 0 if the context does not replay frames or the frame is too small
+ */
+static int submit_frame(ambient_context* context, const COLOR* pixels, int pitch, int height, double timestampMs)
+{
+    if (context->backend != BACKEND_REPLAY || !pixels || pitch < context->screenWidth * (int) sizeof(COLOR)
+        || height < context->screenHeight)
+        return 0;
+
+    replay_submit(&context->replay, pixels, pitch, stats_ticks(timestampMs));
+    return 1;
+}
+
+/**
+ * Submits the next frame of a replay context (see ambient_create_replay).
+ * The frame is processed by the next getter (or the capture thread), until then
+ * the previous results are returned. Frames which are never processed are skipped.
+ * 
+ * @param pixels The frame in the byte order of a screenshot (BGRA), which must stay valid until it was processed
+ * @param pitch The distance in bytes between the start of two rows
+ * @param timestampMs The time of the frame, which drives the smoothing instead of the clock
+ * 
+ * @return 0 if the context does not replay frames
+ */
+AMBIENT_API int ambient_submit_frame(ambient_context* context, const COLOR* pixels, int pitch, double timestampMs)
+{
+    // The caller is responsible for the frame having as many rows as the screen
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    return submit_frame(context, pixels, pitch, context->screenHeight, timestampMs);
+}
+
+/**
+ * Opens a dump of recorded frames, which is mapped into memory instead of being read.
+ * 
+ * A dump starts with a dump_header (see dump.hpp), followed by the frames
+ * as raw BGRA pixels without row padding. Decoded video, e.g. the output of
+ * ffmpeg -f rawvideo -pix_fmt bgra, becomes a dump by prefixing it with the header.
+ * 
+ * @return NULL if the file does not exist or is not a dump
+ */
+AMBIENT_API ambient_dump* ambient_open_dump(const char* path)
+{
+    ambient_dump* dump = (ambient_dump*) malloc(sizeof(ambient_dump));
+    if (dump && !dump_open(dump, path))
+    {
+        free(dump);
+        return NULL;
+    }
+    return dump;
+}
+
+AMBIENT_API void ambient_close_dump(ambient_dump* dump)
+{
+    if (!dump)
+        return;
+    dump_close(dump);
+    free(dump);
+}
+
+/**
+ * Returns the size, the amount of frames and the frame rate of a dump.
+ */
+AMBIENT_API void ambient_get_dump_info(ambient_dump* dump, ambient_dump_info* dest)
+{
+    *dest = dump->info;
+}
+
+/**
+ * Returns the pixels of the specified frame of a dump, which stay valid until the dump is closed.
+ * 
+ * @return NULL if the index is out of range
+ */
+AMBIENT_API const COLOR* ambient_get_dump_frame(ambient_dump* dump, int index)
+{
+    return dump_frame(dump, index);
+}
+
+/**
+ * Submits the specified frame of a dump to a replay context,
+ * timed by the frame rate of the dump (see ambient_submit_frame).
+ * 
+ * @return 0 if the index is out of range or the frames do not have the size of the context
+ */
+AMBIENT_API int ambient_submit_dump_frame(ambient_context* context, ambient_dump* dump, int index)
 {
-    memset(g_hues, 0, HUE_RANGE * sizeof(int));
+    // The size is compared under the lock, so a reconfiguration can not make the frames too small
+    std::lock_guard<std::mutex> lock(context->captureLock);
+    const COLOR* pixels = dump_frame(dump, index);
+    if (!pixels || dump->info.width != context->screenWidth || dump->info.height != context->screenHeight)
+        return 0;
+
+    return submit_frame(context, pixels, dump->info.width * (int) sizeof(COLOR), dump->info.height,
+        index * dump->info.frameIntervalMs);
 }
 
 /**
- * Initializes the ambient library.
+ * Initializes the ambient library using the GDI capture backend.
  * 
  * This function allocates the required amount of 
  * memory depending on the specified screen size.
@@ -62,33 +2040,72 @@ void clear_buffers()
  */
 AMBIENT_API void initialize(int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight)
 {
-    dbgInfo("Initializing Ambient Library ...");
-    g_screenWidth       = screenWidth;
-    g_screenHeight      = screenHeight;
-    g_bitmapWidth       = bitmapWidth;
-    g_bitmapHeight      = bitmapHeight;
+    initializeWithBackend(screenWidth, screenHeight, bitmapWidth, bitmapHeight, BACKEND_GDI);
+}
 
-    dbgInfo("==> Allocating resources ...")
-    g_hues          = (int*)        malloc(HUE_RANGE * sizeof(int));
-    g_pixelBuffer   = (COLORREF*)   malloc(bitmapWidth * bitmapHeight * sizeof(COLORREF));
-    clear_buffers();
+/**
+ * Initializes the ambient library using the specified capture backend.
+ * 
+ * The functions without a context parameter operate on
+ * a default context capturing the primary monitor.
+ * 
+ * @param screenWidth The width of screen
+ * @param screenHeight The height of the screen
+ * @param bitmapWidth The width of the internal buffer containing the taken screenshot
+ * @param bitmapWidth The height of the internal buffer containing the taken screenshot
+ * @param backend The capture backend to use, DXGI captures HDR displays in HDR (see ambient_set_tone_map)
+ */
+AMBIENT_API void initializeWithBackend(int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight,
+                                       CAPTURE_BACKEND backend)
+{
+    dbgInfo("Initializing Ambient Library ...");
+    ambient_config config = {};
+    config.bitmapWidth  = bitmapWidth;
+    config.bitmapHeight = bitmapHeight;
+    config.backend      = backend;
+    config.sampling     = SAMPLING_RESAMPLE;
+    config.hdr          = 1;
+    g_defaultContext = create_context(0, screenWidth, screenHeight, &config);
+}
 
-    dbgInfo("==> Preparing capture ...");
-    g_hScreenDC = CreateDC(_T("DISPLAY"), NULL, NULL, NULL);
-    g_hMemoryDC = CreateCompatibleDC(g_hScreenDC);
-    g_hBitmap   = CreateCompatibleBitmap(g_hScreenDC, screenWidth, screenHeight);
-
-    BITMAP bm;
-    GetObject(g_hBitmap, sizeof(bm), &bm);
-    g_bitmapInfoHeader.biSize           = sizeof(BITMAPINFOHEADER);
-    g_bitmapInfoHeader.biPlanes         = bm.bmPlanes;
-    g_bitmapInfoHeader.biBitCount       = bm.bmBitsPixel;
-    g_bitmapInfoHeader.biWidth          = bitmapWidth;
-    g_bitmapInfoHeader.biHeight         = bitmapHeight;
-    g_bitmapInfoHeader.biCompression    = BI_RGB;
-    g_bitmapInfoHeader.biSizeImage      = 0;
+/**
+ * Initializes the ambient library without downscaling the screen.
+ * 
+ * Instead, every strideX-th pixel of every strideY-th row is read
+ * directly from the native resolution screenshot.
+ * 
+ * @param screenWidth The width of screen
+ * @param screenHeight The height of the screen
+ * @param sampling SAMPLING_STRIDE or SAMPLING_PATTERN, which moves each sample to
+ *                 a fixed offset inside its cell to avoid aliasing with regular content
+ * @param strideX The horizontal distance between two samples in pixels
+ * @param strideY The vertical distance between two samples in pixels
+ * @param backend The capture backend to use, DXGI captures HDR displays in HDR (see ambient_set_tone_map)
+ */
+AMBIENT_API void initializeWithSampling(int screenWidth, int screenHeight, SAMPLING_MODE sampling,
+                                        int strideX, int strideY, CAPTURE_BACKEND backend)
+{
+    dbgInfo("Initializing Ambient Library ...");
+    ambient_config config = {};
+    config.backend          = backend;
+    config.sampling         = sampling;
+    config.sampleStrideX    = strideX;
+    config.sampleStrideY    = strideY;
+    config.hdr              = 1;
+    g_defaultContext = create_context(0, screenWidth, screenHeight, &config);
+}
 
-    dbgInfo("==> Done");
+/**
+ * Changes the sizes of the default context without uninitializing the library,
+ * see ambient_reconfigure().
+ * 
+ * @return 0 if the library is not initialized or the sizes could not be applied
+ */
+AMBIENT_API int reinitialize(int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight)
+{
+    if (!g_defaultContext)
+        return 0;
+    return ambient_reconfigure(g_defaultContext, screenWidth, screenHeight, bitmapWidth, bitmapHeight);
 }
 
 /**
@@ -99,76 +2116,101 @@ AMBIENT_API void initialize(int screenWidth, int screenHeight, int bitmapWidth,
 AMBIENT_API void uninitialize()
 {
     dbgInfo("Uninitializing Ambient Library ...");
-    dbgInfo("==> Deallocating resources ...");
+    ambient_destroy(g_defaultContext);
+    g_defaultContext = NULL;
+}
 
-    free(g_hues);
-    free(g_pixelBuffer);
-    DeleteDC(g_hMemoryDC);
-    DeleteDC(g_hScreenDC);
-    dbgInfo("==> Done");
+// The remaining functions forward to the default context.
+// Without one (initialize() was not called or failed) they do nothing and return neutral values.
+
+AMBIENT_API CAPTURE_BACKEND getCaptureBackend()
+{
+    return g_defaultContext ? ambient_get_backend(g_defaultContext) : BACKEND_GDI;
 }
 
-/**
- * Returns the current hue of the screen.
- * 
- * This function takes a screenshot of the entire screen and
- * determines the dominant hue by counting it's occurrences.
- * 
- * The returned hue can then be used to calculate a color
- * using the HSBtoRGB function.
- * 
- * Note:    It is advised to execute this function
- *          in a separate thread as it will most certainly block.
- */
 AMBIENT_API HUE getAmbientScreenHue()
 {
-    HBITMAP hOldBitmap = (HBITMAP) SelectObject(g_hMemoryDC, g_hBitmap);
+    return g_defaultContext ? ambient_get_hue(g_defaultContext) : 0;
+}
 
-    // Specify the resize mode.
-    ::SetStretchBltMode(g_hMemoryDC, HALFTONE);
+AMBIENT_API void    setHueMode(HUE_MODE mode)                               { if (g_defaultContext) ambient_set_hue_mode(g_defaultContext, mode); }
+AMBIENT_API void    setColorSpace(COLOR_SPACE space)                        { if (g_defaultContext) ambient_set_color_space(g_defaultContext, space); }
+AMBIENT_API int     setToneMap(TONE_MAP mode, float white, float peak)      { return g_defaultContext ? ambient_set_tone_map(g_defaultContext, mode, white, peak) : 0; }
+AMBIENT_API void    setSmoothing(float timeConstantMs, float maxSlewRate)   { if (g_defaultContext) ambient_set_smoothing(g_defaultContext, timeConstantMs, maxSlewRate); }
+AMBIENT_API int     setLatencyBudget(float budgetMs)                        { return g_defaultContext ? ambient_set_latency_budget(g_defaultContext, budgetMs) : 0; }
+AMBIENT_API void    initializeZones(const ZONE* zones, int count)           { if (g_defaultContext) ambient_set_zones(g_defaultContext, zones, count); }
+AMBIENT_API int     getZoneColors(COLOR* dest, int count)                   { return g_defaultContext ? ambient_get_zone_colors(g_defaultContext, dest, count) : 0; }
+AMBIENT_API void    setZoneReduction(ZONE_REDUCTION reduction)              { if (g_defaultContext) ambient_set_zone_reduction(g_defaultContext, reduction); }
+AMBIENT_API int     getPalette(COLOR* dest, int count)                      { return g_defaultContext ? ambient_get_palette(g_defaultContext, dest, count) : 0; }
+AMBIENT_API int     setOutput(const ambient_output_config* config)          { return g_defaultContext ? ambient_set_output(g_defaultContext, config) : 0; }
+AMBIENT_API int     publishResults(const char* name)                        { return g_defaultContext ? ambient_publish(g_defaultContext, name) : 0; }
+AMBIENT_API void    startCapture(int intervalMs)                            { if (g_defaultContext) ambient_start_capture(g_defaultContext, intervalMs); }
+AMBIENT_API void    startPacedCapture(CAPTURE_PACING pacing, int divisor)   { if (g_defaultContext) ambient_start_paced_capture(g_defaultContext, pacing, divisor); }
+AMBIENT_API void    stopCapture()                                           { if (g_defaultContext) ambient_stop_capture(g_defaultContext); }
+AMBIENT_API void    setThrottling(const ambient_throttle_config* config)    { if (g_defaultContext) ambient_set_throttling(g_defaultContext, config); }
+AMBIENT_API HUE     getLatestHue()                                          { return g_defaultContext ? ambient_get_latest_hue(g_defaultContext) : -1.0f; }
+AMBIENT_API void    resetStats()                                            { if (g_defaultContext) ambient_reset_stats(g_defaultContext); }
+AMBIENT_API void    setLetterboxDetection(int intervalFrames)               { if (g_defaultContext) ambient_set_letterbox_detection(g_defaultContext, intervalFrames); }
 
-    // Copy and resize the image to a memory buffer
-    StretchBlt(g_hMemoryDC, 0, 0, g_bitmapWidth, g_bitmapHeight, g_hScreenDC,
-        0, g_screenHeight, g_screenWidth, -g_screenHeight, SRCCOPY);
+AMBIENT_API void getStats(ambient_stats* dest)
+{
+    if (g_defaultContext)
+        ambient_get_stats(g_defaultContext, dest);
+    else
+        memset(dest, 0, sizeof(*dest));
+}
 
-    GetDIBits(g_hMemoryDC, g_hBitmap, 0, g_bitmapHeight, g_pixelBuffer,
-        (BITMAPINFO*) &g_bitmapInfoHeader, DIB_RGB_COLORS);
-    
-    //Sample the screen quad
-    long rSum = 0, gSum = 0, bSum = 0;
-    for (int y = 0; y < g_bitmapHeight; y++)
-    {
-        for (int x = 0; x < g_bitmapWidth; x++)
-        {
-            COLORREF pixelColor = g_pixelBuffer[y * g_bitmapWidth + x];
-            rSum += GetRValue(pixelColor);
-            gSum += GetGValue(pixelColor);
-            bSum += GetBValue(pixelColor);
-        }
-    }
+AMBIENT_API void initializeEdgeZones(int top, int bottom, int left, int right, int depth)
+{
+    if (g_defaultContext)
+        ambient_set_edge_zones(g_defaultContext, top, bottom, left, right, depth);
+}
 
-    //Average result
-    int pixelCount = g_bitmapWidth * g_bitmapHeight;
-    rSum /= pixelCount;
-    gSum /= pixelCount;
-    bSum /= pixelCount;
+AMBIENT_API int setReduceThreads(int threads, unsigned long long affinityMask)
+{
+    if (!g_defaultContext)
+        return 0;
+    return ambient_set_reduce_threads(g_defaultContext, threads, affinityMask);
+}
 
-    // Convert color to HSB to set the saturation
-    // and brightness of the color to 100%
-    float hsb[3];
-    RGBtoHSB(bSum, gSum, rSum, hsb);
+AMBIENT_API void setRegionOfInterest(int x, int y, int width, int height)
+{
+    if (g_defaultContext)
+        ambient_set_roi(g_defaultContext, x, y, width, height);
+}
 
-    //Clean up
-    clear_buffers();
+/**
+ * Converts the specified colors to hue, saturation and brightness.
+ * 
+ * The results are stored as separate arrays (each holding count values within [0, 1]),
+ * which allows converting several colors at once using SIMD.
+ * The results match those of RGBtoHSB up to float rounding.
+ * 
+ * @param colors The colors to convert, as 0xAARRGGBB (the alpha channel is ignored)
+ */
+AMBIENT_API void ambient_rgb_to_hsb_batch(const COLOR* colors, float* hue, float* saturation, float* brightness,
+                                          int count)
+{
+    std::call_once(g_globalsInitialized, initialize_globals);
+    rgb_to_hsb_batch(colors, hue, saturation, brightness, count);
+}
 
-    return hsb[0];
+/**
+ * Converts the specified hue, saturation and brightness values to colors (0xffRRGGBB).
+ * This is the inverse of ambient_rgb_to_hsb_batch and matches HSBtoRGB.
+ */
+AMBIENT_API void ambient_hsb_to_rgb_batch(const float* hue, const float* saturation, const float* brightness,
+                                          COLOR* dest, int count)
+{
+    std::call_once(g_globalsInitialized, initialize_globals);
+    hsb_to_rgb_batch(hue, saturation, brightness, dest, count);
 }
 
 /**
  * This function takes in three values ranging from 0 to 255 (red, green and blue)
  * and stores the values for hue, saturation and brightness inside the specified buffer.
  */
-void RGBtoHSB(int r, int g, int b, float* dest)
+AMBIENT_API void RGBtoHSB(int r, int g, int b, float* dest)
 {
     float hue, saturation, brightness;
     int cmax = (r > g) ? r : g;
@@ -209,7 +2251,7 @@ void RGBtoHSB(int r, int g, int b, float* dest)
  * and returns the corresponding color as red, green and blue values
  * ranging from 0 to 255.
  */
-COLOR HSBtoRGB(float hue, float saturation, float brightness)
+AMBIENT_API COLOR HSBtoRGB(float hue, float saturation, float brightness)
 {
     int r = 0, g = 0, b = 0;
     if (saturation == 0) {
@@ -1,8 +1,8 @@
 /**
  * LibAmbient - A library for calculating the ambient color of your screen.
  * 
- * While this library targets windows machines only,
- * it is possible to extend support for other operating systems in the future.
+ * The library captures the screen using GDI or DXGI on Windows and X11 elsewhere.
+ * Everything but the capture backends is portable.
  * 
  * (c) 2020 Kraus David. All rights reserved.
  * 
@@ -12,12 +12,189 @@
 #define LIB_AMBIENT_H
 
 #ifndef AMBIENT_API
-    #define AMBIENT_API __declspec(dllexport)
+    #ifdef _WIN32
+        #define AMBIENT_API __declspec(dllexport)
+    #else
+        #define AMBIENT_API __attribute__((visibility("default")))
+    #endif
 #endif
 
 typedef unsigned int COLOR;
 typedef float HUE;
 
+// Available capture backends
+typedef enum
+{
+    BACKEND_GDI     = 0,    // GDI StretchBlt and GetDIBits, available on every Windows machine
+    BACKEND_DXGI    = 1,    // DXGI Desktop Duplication, downscaled on the GPU (Windows 8 and later)
+    BACKEND_REPLAY  = 2,    // Frames supplied by the caller instead of the screen (see ambient_create_replay)
+    BACKEND_X11     = 3     // X11 shared memory images (MIT-SHM), the only backend outside of Windows
+} CAPTURE_BACKEND;
+
+// Ways to determine the hue of the screen
+typedef enum
+{
+    HUE_MODE_AVERAGE    = 0,    // Hue of the average color
+    HUE_MODE_DOMINANT   = 1     // Peak of the hue histogram, weighted by saturation and brightness
+} HUE_MODE;
+
+// Color spaces the pixels are averaged in (see ambient_set_color_space)
+typedef enum
+{
+    COLOR_SPACE_SRGB    = 0,    // The gamma encoded values as captured, dark pixels weigh too much
+    COLOR_SPACE_LINEAR  = 1,    // Linear light, mixes colors like the light of the display does
+    COLOR_SPACE_OKLAB   = 2     // OKLab, perceptually uniform, keeps mixed colors from turning grey
+} COLOR_SPACE;
+
+// Ways to map the highlights of HDR frames into the SDR range (see ambient_set_tone_map)
+typedef enum
+{
+    TONE_MAP_CLIP       = 0,    // Clips every channel at SDR white, SDR content stays as it is
+    TONE_MAP_REINHARD   = 1,    // Compresses everything up to the peak brightness of the display
+    TONE_MAP_ACES       = 2     // Filmic curve with a soft shoulder and more contrast, independent of the display
+} TONE_MAP;
+
+// A rectangular area of the screen, in screen coordinates
+typedef struct
+{
+    int x, y;
+    int width, height;
+} ZONE;
+
+// Ways to sum the zones (see ambient_set_zone_reduction)
+typedef enum
+{
+    ZONE_REDUCTION_AUTO     = 0,    // Picks one of the below depending on how much the zones cover
+    ZONE_REDUCTION_SPANS    = 1,    // Sums the pixels of each zone directly
+    ZONE_REDUCTION_INTEGRAL = 2     // Builds a summed-area table, each zone costs four lookups
+} ZONE_REDUCTION;
+
+// How the capture thread schedules its captures (see ambient_start_paced_capture)
+typedef enum
+{
+    PACING_INTERVAL = 0,    // Fixed interval, independent of the display
+    PACING_VBLANK   = 1,    // Every n-th vertical blank (DXGI) or DWM composition (GDI), X11 assumes 60 Hz
+    PACING_FRAME    = 2     // Only new frames, at most every n-th refresh (DXGI frame events, X11 damage)
+} CAPTURE_PACING;
+
+// Reasons the capture thread slows down (see ambient_set_throttling), combined as flags
+typedef enum
+{
+    THROTTLE_NONE       = 0,
+    THROTTLE_BATTERY    = 1,    // The machine runs on battery (or battery saver is on)
+    THROTTLE_LATENCY    = 2,    // Captures take much longer than usual, e.g. a game competes for the GPU
+    THROTTLE_FULLSCREEN = 4     // A fullscreen exclusive application is in the foreground of the captured monitor
+} THROTTLE_REASON;
+
+// Configuration of the throttling of the capture thread (see ambient_set_throttling)
+typedef struct
+{
+    int     reasons;            // THROTTLE_REASON flags which slow down the capture thread, 0 disables throttling
+    float   batteryFactor;      // Factor the interval (or divisor) is stretched by on battery, 0 for 2
+    float   contentionFactor;   // Factor for THROTTLE_LATENCY and THROTTLE_FULLSCREEN, 0 for 4
+    float   latencyThreshold;   // Captures slower than this multiple of the usual latency are contended, 0 for 3
+} ambient_throttle_config;
+
+// Ways to reduce the amount of sampled pixels
+typedef enum
+{
+    SAMPLING_RESAMPLE   = 0,    // Downscale the screen to bitmapWidth x bitmapHeight (HALFTONE / GPU)
+    SAMPLING_STRIDE     = 1,    // Read every n-th pixel of every m-th row at native resolution
+    SAMPLING_PATTERN    = 2     // Like SAMPLING_STRIDE, using a fixed, well distributed offset inside each cell
+} SAMPLING_MODE;
+
+// Protocols of the LED output (see ambient_set_output)
+typedef enum
+{
+    OUTPUT_ADALIGHT     = 0,    // Serial port, "Ada" header followed by RGB triplets
+    OUTPUT_WLED_DRGB    = 1,    // WLED realtime UDP, up to 490 LEDs
+    OUTPUT_WLED_DNRGB   = 2,    // WLED realtime UDP with a start index, any amount of LEDs
+    OUTPUT_E131         = 3     // E1.31 (sACN), 170 LEDs per universe
+} OUTPUT_PROTOCOL;
+
+// Configuration of the LED output (see ambient_set_output)
+typedef struct
+{
+    OUTPUT_PROTOCOL protocol;
+    const char*     target;     // Serial port (e.g. "COM3") or IPv4 address, NULL sends E1.31 via multicast
+    int             port;       // UDP port, 0 for the default of the protocol (21324 for WLED, 5568 for E1.31)
+    int             baudRate;   // Adalight only, 0 for 115200
+    int             universe;   // E1.31 only, the first universe, 0 for 1
+} ambient_output_config;
+
+// Configuration of a capture context (see ambient_create)
+typedef struct
+{
+    int             bitmapWidth;    // Size of the internal, downscaled screenshot (SAMPLING_RESAMPLE only)
+    int             bitmapHeight;
+    CAPTURE_BACKEND backend;
+    SAMPLING_MODE   sampling;
+    int             sampleStrideX;  // Distance between two samples in pixels (SAMPLING_STRIDE and SAMPLING_PATTERN)
+    int             sampleStrideY;
+    int             gpuReduction;   // Nonzero reduces full resolution frames on the GPU (BACKEND_DXGI, SAMPLING_RESAMPLE),
+                                    // bitmapWidth and bitmapHeight only apply if this is not available
+    int             pipelineDepth;  // Frames in flight, 2 or 3 capture the next frames while the current one is reduced
+                                    // (adds depth - 1 frames of latency), 0 or 1 capture and reduce serially
+    int             hdr;            // Nonzero captures HDR displays as half floats and tone maps them
+                                    // (BACKEND_DXGI without gpuReduction, see ambient_set_tone_map)
+} ambient_config;
+
+// Rolling statistics of a pipeline stage over the most recent frames
+typedef struct
+{
+    float   minMs;
+    float   avgMs;
+    float   maxMs;
+    float   p99Ms;
+} ambient_timing;
+
+// Statistics of a capture context (see ambient_get_stats)
+typedef struct
+{
+    ambient_timing      capture;    // Copying the screen (StretchBlt / AcquireNextFrame + GPU downscale)
+    ambient_timing      readback;   // Reading the pixels into system memory (Map, close to 0 for GDI)
+    ambient_timing      reduce;     // Change detection and calculation of the hue or zone colors
+    ambient_timing      total;      // Complete call, including frames which did not change
+
+    unsigned long long  frames;     // Amount of captured frames
+    unsigned long long  changed;    // Frames which differed from the previous one
+    unsigned long long  unchanged;  // Frames identical to the previous one (cached result was returned)
+    unsigned long long  dropped;    // Frames which could not be captured
+
+    // Throttling of the capture thread (see ambient_set_throttling)
+    int                 throttleReasons;    // THROTTLE_REASON flags which slow down the capture thread right now
+    float               throttleFactor;     // Factor the interval (or divisor) is stretched by, 1 if not throttled
+    unsigned long long  throttleChanges;    // Decisions which changed throttleReasons
+    unsigned long long  throttledFrames;    // Frames the capture thread captured while throttled
+} ambient_stats;
+
+// A capture context, each one captures a single monitor
+typedef struct ambient_context ambient_context;
+
+// A memory mapped file of recorded frames (see ambient_open_dump)
+typedef struct ambient_dump ambient_dump;
+
+// Properties of a frame dump (see ambient_get_dump_info)
+typedef struct
+{
+    int     width, height;      // Size of the frames
+    int     frames;             // Amount of complete frames
+    double  frameIntervalMs;    // Time between two frames
+} ambient_dump_info;
+
+// A process reading the results published by another one (see ambient_open_reader)
+typedef struct ambient_reader ambient_reader;
+
+// Results published by a capturing process (see ambient_read_snapshot)
+typedef struct
+{
+    unsigned int        frameId;        // Incremented with every publication
+    HUE                 hue;
+    int                 zoneCount;      // Zones published, may exceed the zones copied
+    unsigned long long  publishedMs;    // GetTickCount64() at the time of publication
+    ambient_stats       stats;          // Updated a few times per second
+} ambient_snapshot;
+
 // Debug stuff
 // (use '#define DEBUG' before including this header to enable debug messages)
 #ifdef DEBUG
@@ -30,9 +207,107 @@ typedef float HUE;
 
 extern "C"
 {
+    // Capture contexts
+    AMBIENT_API int                 ambient_get_monitor_count();
+    AMBIENT_API ambient_context*    ambient_create(int monitorIndex, const ambient_config* config);
+    AMBIENT_API ambient_context*    ambient_create_replay(int width, int height, const ambient_config* config);
+    AMBIENT_API void                ambient_destroy(ambient_context* context);
+    AMBIENT_API int                 ambient_reconfigure(ambient_context* context, int screenWidth, int screenHeight,
+                                                        int bitmapWidth, int bitmapHeight);
+    AMBIENT_API CAPTURE_BACKEND     ambient_get_backend(ambient_context* context);
+    AMBIENT_API HUE                 ambient_get_hue(ambient_context* context);
+    AMBIENT_API void                ambient_set_hue_mode(ambient_context* context, HUE_MODE mode);
+    AMBIENT_API void                ambient_set_color_space(ambient_context* context, COLOR_SPACE space);
+    AMBIENT_API int                 ambient_set_tone_map(ambient_context* context, TONE_MAP mode,
+                                                         float paperWhiteNits, float peakNits);
+    AMBIENT_API void                ambient_set_smoothing(ambient_context* context, float timeConstantMs,
+                                                          float maxSlewRate);
+    AMBIENT_API int                 ambient_set_latency_budget(ambient_context* context, float budgetMs);
+    AMBIENT_API void                ambient_get_bitmap_size(ambient_context* context, int* width, int* height);
+    AMBIENT_API int                 ambient_set_reduce_threads(ambient_context* context, int threads,
+                                                               unsigned long long affinityMask);
+    AMBIENT_API void                ambient_set_roi(ambient_context* context, int x, int y, int width, int height);
+    AMBIENT_API void                ambient_set_letterbox_detection(ambient_context* context, int intervalFrames);
+    AMBIENT_API void                ambient_get_active_area(ambient_context* context, ZONE* dest);
+    AMBIENT_API int                 ambient_set_zones(ambient_context* context, const ZONE* zones, int count);
+    AMBIENT_API int                 ambient_set_edge_zones(ambient_context* context, int top, int bottom,
+                                                           int left, int right, int depth);
+    AMBIENT_API int                 ambient_get_zone_colors(ambient_context* context, COLOR* dest, int count);
+    AMBIENT_API void                ambient_set_zone_reduction(ambient_context* context, ZONE_REDUCTION reduction);
+    AMBIENT_API int                 ambient_get_palette(ambient_context* context, COLOR* dest, int count);
+    AMBIENT_API int                 ambient_set_output(ambient_context* context, const ambient_output_config* config);
+    AMBIENT_API void                ambient_start_capture(ambient_context* context, int intervalMs);
+    AMBIENT_API void                ambient_start_paced_capture(ambient_context* context, CAPTURE_PACING pacing,
+                                                                int divisor);
+    AMBIENT_API void                ambient_stop_capture(ambient_context* context);
+    AMBIENT_API void                ambient_set_throttling(ambient_context* context,
+                                                           const ambient_throttle_config* config);
+    AMBIENT_API HUE                 ambient_get_latest_hue(ambient_context* context);
+    AMBIENT_API void                ambient_get_stats(ambient_context* context, ambient_stats* dest);
+    AMBIENT_API void                ambient_reset_stats(ambient_context* context);
+
+    // Replay of recorded frames
+    AMBIENT_API int                 ambient_submit_frame(ambient_context* context, const COLOR* pixels, int pitch,
+                                                         double timestampMs);
+    AMBIENT_API ambient_dump*       ambient_open_dump(const char* path);
+    AMBIENT_API void                ambient_close_dump(ambient_dump* dump);
+    AMBIENT_API void                ambient_get_dump_info(ambient_dump* dump, ambient_dump_info* dest);
+    AMBIENT_API const COLOR*        ambient_get_dump_frame(ambient_dump* dump, int index);
+    AMBIENT_API int                 ambient_submit_dump_frame(ambient_context* context, ambient_dump* dump, int index);
+
+    // Sharing the results with other processes
+    AMBIENT_API int                 ambient_publish(ambient_context* context, const char* name);
+    AMBIENT_API ambient_reader*     ambient_open_reader(const char* name);
+    AMBIENT_API void                ambient_close_reader(ambient_reader* reader);
+    AMBIENT_API int                 ambient_read_snapshot(ambient_reader* reader, ambient_snapshot* dest,
+                                                          COLOR* zones, int zoneCapacity);
+
+    // Default context, capturing the primary monitor
     AMBIENT_API void    initialize(int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight);
+    AMBIENT_API void    initializeWithBackend(int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight,
+                                              CAPTURE_BACKEND backend);
+    AMBIENT_API void    initializeWithSampling(int screenWidth, int screenHeight, SAMPLING_MODE sampling,
+                                               int strideX, int strideY, CAPTURE_BACKEND backend);
+    AMBIENT_API CAPTURE_BACKEND getCaptureBackend();
+    AMBIENT_API int     reinitialize(int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight);
     AMBIENT_API void    uninitialize();
     AMBIENT_API HUE     getAmbientScreenHue();
+    AMBIENT_API void    setHueMode(HUE_MODE mode);
+    AMBIENT_API void    setColorSpace(COLOR_SPACE space);
+    AMBIENT_API int     setToneMap(TONE_MAP mode, float paperWhiteNits, float peakNits);
+    AMBIENT_API void    setSmoothing(float timeConstantMs, float maxSlewRate);
+    AMBIENT_API int     setLatencyBudget(float budgetMs);
+    AMBIENT_API int     setReduceThreads(int threads, unsigned long long affinityMask);
+    AMBIENT_API void    setRegionOfInterest(int x, int y, int width, int height);
+    AMBIENT_API void    setLetterboxDetection(int intervalFrames);
+
+    // Multiple zones (e.g. LED strips)
+    AMBIENT_API void    initializeZones(const ZONE* zones, int count);
+    AMBIENT_API void    initializeEdgeZones(int top, int bottom, int left, int right, int depth);
+    AMBIENT_API int     getZoneColors(COLOR* dest, int count);
+    AMBIENT_API void    setZoneReduction(ZONE_REDUCTION reduction);
+    AMBIENT_API int     getPalette(COLOR* dest, int count);
+    AMBIENT_API int     setOutput(const ambient_output_config* config);
+    AMBIENT_API int     publishResults(const char* name);
+
+    // Asynchronous capture
+    AMBIENT_API void    startCapture(int intervalMs);
+    AMBIENT_API void    startPacedCapture(CAPTURE_PACING pacing, int divisor);
+    AMBIENT_API void    stopCapture();
+    AMBIENT_API void    setThrottling(const ambient_throttle_config* config);
+    AMBIENT_API HUE     getLatestHue();
+
+    // Instrumentation
+    AMBIENT_API void    getStats(ambient_stats* dest);
+    AMBIENT_API void    resetStats();
+
+    // Color conversion
+    AMBIENT_API void    RGBtoHSB(int r, int g, int b, float* dest);
+    AMBIENT_API COLOR   HSBtoRGB(float hue, float saturation, float brightness);
+    AMBIENT_API void    ambient_rgb_to_hsb_batch(const COLOR* colors, float* hue, float* saturation,
+                                                 float* brightness, int count);
+    AMBIENT_API void    ambient_hsb_to_rgb_batch(const float* hue, const float* saturation,
+                                                 const float* brightness, COLOR* dest, int count);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,466 @@
+/**
+ * LibAmbient - Streaming of the colors to LED controllers.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifdef _WIN32
+    // Winsock has to be included before Windows.h
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#else
+    #include <arpa/inet.h>
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <termios.h>
+    #include <unistd.h>
+
+    typedef int SOCKET;
+    #define INVALID_SOCKET      (-1)
+    #define closesocket(socket) close(socket)
+#endif
+#include "output.hpp"
+#include "stats.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OUTPUT_DEFAULT_BAUD_RATE    115200
+#define OUTPUT_WLED_PORT            21324
+#define OUTPUT_E131_PORT            5568
+
+// Seconds WLED stays in realtime mode without a new packet
+#define OUTPUT_WLED_TIMEOUT         2
+
+// Time a write to the serial port may block if the device stops reading
+#define OUTPUT_SERIAL_TIMEOUT_MS    50
+
+// Time after which the last colors are sent again if nothing changed,
+// so the controllers do not leave realtime mode (WLED) or time out (E1.31, 2.5 s)
+#define OUTPUT_KEEPALIVE_MS         1000
+
+// Sizes of the packet headers and the maximum amount of LEDs of a packet
+#define ADALIGHT_HEADER             6
+#define WLED_DRGB_HEADER            2
+#define WLED_DRGB_MAX_LEDS          490
+#define WLED_DNRGB_HEADER           4
+#define WLED_DNRGB_MAX_LEDS         489
+#define E131_HEADER                 126
+#define E131_MAX_LEDS               170     // 510 of the 512 channels of a universe
+
+static void put16(unsigned char* dest, unsigned int value)
+{
+    dest[0] = (unsigned char) (value >> 8);
+    dest[1] = (unsigned char) value;
+}
+
+/**
+ * Writes the header of an E1.31 data packet carrying the specified amount of LEDs.
+ * The sequence number is set when sending.
+ */
+static void write_e131_header(const color_output* output, unsigned char* packet, int universe, int leds)
+{
+    static const unsigned char identifier[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+    int channels    = leds * 3;
+    int length      = E131_HEADER + channels;
+    memset(packet, 0, E131_HEADER);
+
+    // Root layer
+    put16(packet + 0, 0x0010);                      // Preamble size
+    memcpy(packet + 4, identifier, sizeof(identifier));
+    put16(packet + 16, 0x7000 | (length - 16));
+    packet[21] = 0x04;                              // VECTOR_ROOT_E131_DATA
+    memcpy(packet + 22, output->cid, sizeof(output->cid));
+
+    // Framing layer
+    put16(packet + 38, 0x7000 | (length - 38));
+    packet[43] = 0x02;                              // VECTOR_E131_DATA_PACKET
+    strcpy((char*) packet + 44, "LibAmbient");      // Source name
+    packet[108] = 100;                              // Priority
+    put16(packet + 113, universe);
+
+    // DMP layer
+    put16(packet + 115, 0x7000 | (length - 115));
+    packet[117] = 0x02;                             // VECTOR_DMP_SET_PROPERTY
+    packet[118] = 0xa1;                             // Address and data type
+    put16(packet + 121, 0x0001);                    // Address increment
+    put16(packet + 123, channels + 1);              // Property values, including the start code
+}
+
+static int header_size(OUTPUT_PROTOCOL protocol)
+{
+    switch (protocol)
+    {
+        case OUTPUT_ADALIGHT:   return ADALIGHT_HEADER;
+        case OUTPUT_WLED_DRGB:  return WLED_DRGB_HEADER;
+        case OUTPUT_WLED_DNRGB: return WLED_DNRGB_HEADER;
+        default:                return E131_HEADER;
+    }
+}
+
+/**
+ * Returns the distance between two packets inside the buffer.
+ */
+static size_t packet_stride(const color_output* output)
+{
+    return header_size(output->protocol) + output->packetLeds * 3;
+}
+
+static int packet_leds(const color_output* output, int packet)
+{
+    int remaining = output->ledCount - packet * output->packetLeds;
+    return remaining < output->packetLeds ? remaining : output->packetLeds;
+}
+
+#ifdef _WIN32
+static bool open_serial(color_output* output, const ambient_output_config* config)
+{
+    char path[64];
+    if (!config->target || snprintf(path, sizeof(path), "\\\\.\\%s", config->target) >= (int) sizeof(path))
+        return false;
+
+    output->serial = CreateFileA(path, GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    if (output->serial == INVALID_HANDLE_VALUE)
+    {
+        output->serial = NULL;
+        return false;
+    }
+
+    DCB dcb = { 0 };
+    dcb.DCBlength = sizeof(dcb);
+    if (!GetCommState(output->serial, &dcb))
+        return false;
+    dcb.BaudRate    = config->baudRate > 0 ? config->baudRate : OUTPUT_DEFAULT_BAUD_RATE;
+    dcb.ByteSize    = 8;
+    dcb.Parity      = NOPARITY;
+    dcb.StopBits    = ONESTOPBIT;
+    if (!SetCommState(output->serial, &dcb))
+        return false;
+
+    // Never block the capture for long if the device stops reading
+    COMMTIMEOUTS timeouts = { 0 };
+    timeouts.WriteTotalTimeoutConstant = OUTPUT_SERIAL_TIMEOUT_MS;
+    return SetCommTimeouts(output->serial, &timeouts) != 0;
+}
+
+static bool write_serial(color_output* output, const unsigned char* data, int size)
+{
+    DWORD written = 0;
+    return WriteFile(output->serial, data, (DWORD) size, &written, NULL) && written == (DWORD) size;
+}
+#else
+/**
+ * Returns the termios speed of a baud rate, B0 if the platform does not support it.
+ */
+static speed_t serial_speed(int baudRate)
+{
+    switch (baudRate)
+    {
+    case 9600:      return B9600;
+    case 19200:     return B19200;
+    case 38400:     return B38400;
+    case 57600:     return B57600;
+    case 115200:    return B115200;
+    case 230400:    return B230400;
+#ifdef B460800
+    case 460800:    return B460800;
+#endif
+#ifdef B500000
+    case 500000:    return B500000;
+#endif
+#ifdef B921600
+    case 921600:    return B921600;
+#endif
+#ifdef B1000000
+    case 1000000:   return B1000000;
+#endif
+#ifdef B2000000
+    case 2000000:   return B2000000;
+#endif
+    default:        return B0;
+    }
+}
+
+/**
+ * Opens the serial port, which is either a path or the name of a device in /dev (e.g. "ttyUSB0").
+ */
+static bool open_serial(color_output* output, const ambient_output_config* config)
+{
+    char path[64];
+    if (!config->target || snprintf(path, sizeof(path), config->target[0] == '/' ? "%s" : "/dev/%s",
+        config->target) >= (int) sizeof(path))
+        return false;
+
+    speed_t speed = serial_speed(config->baudRate > 0 ? config->baudRate : OUTPUT_DEFAULT_BAUD_RATE);
+    if (speed == B0)
+        return false;
+
+    // Writes do not block, so write_serial can give up if the device stops reading
+    output->serial = open(path, O_WRONLY | O_NOCTTY | O_NONBLOCK);
+    if (output->serial < 0)
+        return false;
+
+    termios options;
+    if (tcgetattr(output->serial, &options) != 0)
+        return false;
+    cfmakeraw(&options);
+    options.c_cflag |= CLOCAL;
+    options.c_cflag &= ~(CSTOPB | PARENB);
+    cfsetispeed(&options, speed);
+    cfsetospeed(&options, speed);
+    return tcsetattr(output->serial, TCSANOW, &options) == 0;
+}
+
+static bool write_serial(color_output* output, const unsigned char* data, int size)
+{
+    long long deadline = stats_now() + stats_ticks(OUTPUT_SERIAL_TIMEOUT_MS);
+    while (size > 0)
+    {
+        ssize_t written = write(output->serial, data, size);
+        if (written > 0)
+        {
+            data += written;
+            size -= (int) written;
+            continue;
+        }
+        if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            return false;
+
+        // The device is not reading, wait for the rest of the timeout
+        int remainingMs = (int) stats_elapsed_ms(stats_now(), deadline);
+        pollfd events = { output->serial, POLLOUT, 0 };
+        if (remainingMs <= 0 || poll(&events, 1, remainingMs) <= 0)
+            return false;
+    }
+    return true;
+}
+#endif
+
+static bool open_socket(color_output* output, const ambient_output_config* config)
+{
+#ifdef _WIN32
+    WSADATA data;
+    output->winsock = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    if (!output->winsock)
+        return false;
+#endif
+
+    in_addr address;
+    if (config->target && inet_pton(AF_INET, config->target, &address) != 1)
+        return false;
+
+    // Without a target, E1.31 uses the multicast group of each universe (see output_send)
+    if (!config->target && config->protocol != OUTPUT_E131)
+        return false;
+    output->host = config->target ? address.s_addr : 0;
+
+    int port = config->port > 0 ? config->port
+        : config->protocol == OUTPUT_E131 ? OUTPUT_E131_PORT : OUTPUT_WLED_PORT;
+    output->port = htons((unsigned short) port);
+
+    SOCKET handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    output->socket = handle;
+    return handle != INVALID_SOCKET;
+}
+
+/**
+ * Opens the serial port or the socket of the specified configuration.
+ * 
+ * @return false if the target could not be opened, the output is closed in that case
+ */
+bool output_open(color_output* output, const ambient_output_config* config)
+{
+    memset(output, 0, sizeof(*output));
+    output->protocol    = config->protocol;
+    output->universe    = config->universe > 0 ? config->universe : 1;
+    output->ledCount    = -1;
+    output->socket      = INVALID_SOCKET;
+#ifdef _WIN32
+    unsigned long long process = GetCurrentProcessId();
+#else
+    output->serial      = -1;
+    unsigned long long process = (unsigned long long) getpid();
+#endif
+
+    // The component identifier only has to be unique for each source
+    unsigned long long seed = (unsigned long long) stats_now() ^ (process << 32);
+    for (int i = 0; i < (int) sizeof(output->cid); i++)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        output->cid[i] = (unsigned char) (seed >> 56);
+    }
+
+    output->open = config->protocol == OUTPUT_ADALIGHT ? open_serial(output, config) : open_socket(output, config);
+    if (!output->open)
+    {
+        dbgErr("==> Failed to open the LED output");
+        output_close(output);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Closes the serial port or the socket and releases the packets.
+ */
+void output_close(color_output* output)
+{
+#ifdef _WIN32
+    if (output->serial)
+        CloseHandle(output->serial);
+#else
+    if (output->serial >= 0)
+        close(output->serial);
+#endif
+    if ((SOCKET) output->socket != INVALID_SOCKET)
+        closesocket((SOCKET) output->socket);
+#ifdef _WIN32
+    if (output->winsock)
+        WSACleanup();
+#endif
+
+    free(output->buffer);
+    memset(output, 0, sizeof(*output));
+}
+
+/**
+ * Lays out the packets for the specified amount of LEDs, allocating the buffer if it is too small.
+ * The headers are written once, so sending only fills in the colors.
+ * 
+ * @return false if the buffer could not be allocated
+ */
+bool output_reserve(color_output* output, int ledCount)
+{
+    if (ledCount == output->ledCount)
+        return true;
+
+    int maxLeds = output->protocol == OUTPUT_ADALIGHT ? (ledCount > 0 ? ledCount : 1)
+        : output->protocol == OUTPUT_WLED_DRGB      ? WLED_DRGB_MAX_LEDS
+        : output->protocol == OUTPUT_WLED_DNRGB     ? WLED_DNRGB_MAX_LEDS
+        :                                             E131_MAX_LEDS;
+
+    // DRGB has no start index, so additional LEDs are dropped
+    if (output->protocol == OUTPUT_WLED_DRGB && ledCount > maxLeds)
+        ledCount = maxLeds;
+
+    output->ledCount    = ledCount;
+    output->packetLeds  = ledCount < maxLeds ? (ledCount > 0 ? ledCount : 1) : maxLeds;
+    output->packetCount = (ledCount + output->packetLeds - 1) / output->packetLeds;
+
+    size_t size = packet_stride(output) * output->packetCount;
+    if (size > output->capacity)
+    {
+        unsigned char* buffer = (unsigned char*) realloc(output->buffer, size);
+        if (!buffer)
+        {
+            output->ledCount = -1;
+            return false;
+        }
+        output->buffer      = buffer;
+        output->capacity    = size;
+    }
+
+    for (int p = 0; p < output->packetCount; p++)
+    {
+        unsigned char* packet = output->buffer + p * packet_stride(output);
+        int leds = packet_leds(output, p);
+        switch (output->protocol)
+        {
+            case OUTPUT_ADALIGHT:
+                packet[0] = 'A';
+                packet[1] = 'd';
+                packet[2] = 'a';
+                put16(packet + 3, ledCount - 1);
+                packet[5] = packet[3] ^ packet[4] ^ 0x55;
+                break;
+
+            case OUTPUT_WLED_DRGB:
+                packet[0] = 2;
+                packet[1] = OUTPUT_WLED_TIMEOUT;
+                break;
+
+            case OUTPUT_WLED_DNRGB:
+                packet[0] = 4;
+                packet[1] = OUTPUT_WLED_TIMEOUT;
+                put16(packet + 2, p * output->packetLeds);
+                break;
+
+            default:
+                write_e131_header(output, packet, output->universe + p, leds);
+                break;
+        }
+    }
+    return true;
+}
+
+/**
+ * Sends the specified colors to the LEDs, in the order of the array.
+ * 
+ * @param colors The colors as 0xAARRGGBB (the alpha channel is ignored)
+ * @param count The amount of colors, the packets are laid out again if the amount changed
+ * 
+ * @return false if the packets could not be sent
+ */
+bool output_send(color_output* output, const COLOR* colors, int count)
+{
+    if (!output->open || count <= 0 || !output_reserve(output, count))
+        return false;
+
+    int header = header_size(output->protocol);
+    size_t stride = packet_stride(output);
+    for (int p = 0; p < output->packetCount; p++)
+    {
+        unsigned char* packet = output->buffer + p * stride;
+        unsigned char* rgb = packet + header;
+        const COLOR* source = colors + p * output->packetLeds;
+        for (int i = 0, leds = packet_leds(output, p); i < leds; i++)
+        {
+            rgb[i * 3 + 0] = (unsigned char) (source[i] >> 16);
+            rgb[i * 3 + 1] = (unsigned char) (source[i] >> 8);
+            rgb[i * 3 + 2] = (unsigned char) source[i];
+        }
+        if (output->protocol == OUTPUT_E131)
+            packet[111] = output->sequence;
+    }
+    output->sequence++;
+    output->lastSend = stats_now();
+
+    if (output->protocol == OUTPUT_ADALIGHT)
+        return write_serial(output, output->buffer, header + output->ledCount * 3);
+
+    sockaddr_in address = {};
+    address.sin_family      = AF_INET;
+    address.sin_port        = output->port;
+    address.sin_addr.s_addr = output->host;
+
+    bool success = true;
+    for (int p = 0; p < output->packetCount; p++)
+    {
+        // Multicast group 239.255.x.y of the universe
+        if (!output->host)
+        {
+            int universe = output->universe + p;
+            address.sin_addr.s_addr = htonl(0xefff0000 | (universe & 0xffff));
+        }
+
+        int size = header + packet_leds(output, p) * 3;
+        if (sendto((SOCKET) output->socket, (const char*) output->buffer + p * stride, size, 0,
+            (const sockaddr*) &address, sizeof(address)) != size)
+            success = false;
+    }
+    return success;
+}
+
+/**
+ * Returns whether the last colors have to be sent again, as the controllers
+ * would otherwise leave realtime mode.
+ */
+bool output_needs_keepalive(const color_output* output)
+{
+    return output->open && output->ledCount > 0
+        && stats_elapsed_ms(output->lastSend, stats_now()) >= OUTPUT_KEEPALIVE_MS;
+}
@@ -0,0 +1,57 @@
+/**
+ * LibAmbient - Streaming of the colors to LED controllers.
+ *
+ * The colors of a frame are framed into packets of the configured protocol
+ * and written to a serial port or a UDP socket. The packets of a frame are
+ * built inside a single buffer, which is allocated whenever the amount of
+ * LEDs changes, and sent back to back.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_OUTPUT_H
+#define LIB_AMBIENT_OUTPUT_H
+
+#include "platform.hpp"
+#include "libambient.hpp"
+
+struct color_output
+{
+    OUTPUT_PROTOCOL protocol;
+    bool            open;
+
+    // Serial port (Adalight) and UDP socket (WLED, E1.31), the address is stored in network byte order
+#ifdef _WIN32
+    HANDLE          serial;
+    bool            winsock;        // Set once Winsock was started
+    UINT_PTR        socket;
+#else
+    int             serial;         // -1 if not open
+    int             socket;
+#endif
+    unsigned int    host;
+    unsigned short  port;
+
+    // Packets of a frame
+    unsigned char*  buffer;
+    size_t          capacity;
+    int             ledCount;       // LEDs the buffer was laid out for
+    int             packetCount;
+    int             packetLeds;     // LEDs of every packet but the last one
+
+    // E1.31
+    int             universe;
+    unsigned char   sequence;
+    unsigned char   cid[16];
+
+    long long       lastSend;       // See stats_now
+};
+
+bool    output_open(color_output* output, const ambient_output_config* config);
+void    output_close(color_output* output);
+bool    output_reserve(color_output* output, int ledCount);
+bool    output_send(color_output* output, const COLOR* colors, int count);
+bool    output_needs_keepalive(const color_output* output);
+
+#endif
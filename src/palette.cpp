@@ -0,0 +1,182 @@
+/**
+ * LibAmbient - Extraction of the dominant colors of a frame.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "palette.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+#define PALETTE_INDEX(p) ((((p) >> 9) & 0x7c00) | (((p) >> 6) & 0x03e0) | (((p) >> 3) & 0x001f))
+
+/**
+ * Allocates the histogram of a palette.
+ */
+bool palette_initialize(color_palette* palette)
+{
+    memset(palette, 0, sizeof(*palette));
+    palette->histogram = (unsigned int*) calloc(PALETTE_BINS, sizeof(unsigned int));
+    return palette->histogram != NULL;
+}
+
+void palette_uninitialize(color_palette* palette)
+{
+    free(palette->histogram);
+    memset(palette, 0, sizeof(*palette));
+}
+
+/**
+ * Removes all pixels from the histogram.
+ */
+void palette_clear(color_palette* palette)
+{
+    memset(palette->histogram, 0, PALETTE_BINS * sizeof(unsigned int));
+}
+
+/**
+ * Adds the specified 32 bit pixels to the histogram.
+ */
+void palette_accumulate(color_palette* palette, const COLOR* pixels, int count)
+{
+    unsigned int* histogram = palette->histogram;
+    int x = 0;
+    for (; x + 4 <= count; x += 4)
+    {
+        histogram[PALETTE_INDEX(pixels[x + 0])]++;
+        histogram[PALETTE_INDEX(pixels[x + 1])]++;
+        histogram[PALETTE_INDEX(pixels[x + 2])]++;
+        histogram[PALETTE_INDEX(pixels[x + 3])]++;
+    }
+    for (; x < count; x++)
+        histogram[PALETTE_INDEX(pixels[x])]++;
+}
+
+/**
+ * Counts the pixels per level of each axis inside a box,
+ * then shrinks the box to the levels which actually hold pixels.
+ */
+static void measure_box(const unsigned int* histogram, palette_box* box)
+{
+    memset(box->marginals, 0, sizeof(box->marginals));
+    box->count = 0;
+    for (int r = box->lo[0]; r <= box->hi[0]; r++)
+    {
+        for (int g = box->lo[1]; g <= box->hi[1]; g++)
+        {
+            // Blue is contiguous inside the histogram
+            const unsigned int* bins = histogram + (r << (2 * PALETTE_BITS)) + (g << PALETTE_BITS);
+            unsigned long long line = 0;
+            for (int b = box->lo[2]; b <= box->hi[2]; b++)
+            {
+                box->marginals[2][b] += bins[b];
+                line += bins[b];
+            }
+            box->marginals[0][r] += line;
+            box->marginals[1][g] += line;
+            box->count += line;
+        }
+    }
+
+    if (box->count == 0)
+        return;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        while (box->marginals[axis][box->lo[axis]] == 0) box->lo[axis]++;
+        while (box->marginals[axis][box->hi[axis]] == 0) box->hi[axis]--;
+    }
+}
+
+/**
+ * Splits a box at the median of its longest axis, the upper half is moved to dest.
+ * Both halves hold pixels, as the bounds of a measured box do.
+ */
+static void split_box(const unsigned int* histogram, palette_box* box, palette_box* dest)
+{
+    int axis = 0;
+    for (int a = 1; a < 3; a++)
+        if (box->hi[a] - box->lo[a] > box->hi[axis] - box->lo[axis])
+            axis = a;
+
+    int split = box->lo[axis];
+    unsigned long long below = box->marginals[axis][split];
+    while (split + 1 < box->hi[axis] && below * 2 < box->count)
+        below += box->marginals[axis][++split];
+
+    *dest = *box;
+    box->hi[axis]   = split;
+    dest->lo[axis]  = split + 1;
+    measure_box(histogram, box);
+    measure_box(histogram, dest);
+}
+
+/**
+ * Returns the average color of a box, with the levels spread over the full range of a channel,
+ * so black and white stay exact.
+ */
+static COLOR box_color(const palette_box* box)
+{
+    const unsigned long long top = PALETTE_LEVELS - 1;
+    COLOR channels[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        unsigned long long weighted = 0;
+        for (int level = box->lo[axis]; level <= box->hi[axis]; level++)
+            weighted += box->marginals[axis][level] * level;
+        channels[axis] = (COLOR) ((weighted * 255 * 2 + box->count * top) / (box->count * top * 2));
+    }
+    return 0xff000000 | (channels[0] << 16) | (channels[1] << 8) | channels[2];
+}
+
+/**
+ * Divides the histogram into the specified amount of colors.
+ * Less colors are returned if the histogram does not hold enough distinct ones.
+ *
+ * @return The amount of colors of the palette
+ */
+int palette_extract(color_palette* palette, int colors)
+{
+    if (colors > PALETTE_MAX_COLORS)
+        colors = PALETTE_MAX_COLORS;
+
+    palette_box* boxes = palette->boxes;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        boxes[0].lo[axis] = 0;
+        boxes[0].hi[axis] = PALETTE_LEVELS - 1;
+    }
+    measure_box(palette->histogram, &boxes[0]);
+
+    int count = boxes[0].count > 0 && colors > 0 ? 1 : 0;
+    while (count < colors)
+    {
+        // Split the most populated box, unless it is a single bin
+        int best = -1;
+        for (int i = 0; i < count; i++)
+        {
+            const palette_box* box = &boxes[i];
+            bool single = box->lo[0] == box->hi[0] && box->lo[1] == box->hi[1] && box->lo[2] == box->hi[2];
+            if (!single && (best < 0 || box->count > boxes[best].count))
+                best = i;
+        }
+        if (best < 0)
+            break;
+        split_box(palette->histogram, &boxes[best], &boxes[count++]);
+    }
+
+    // Most frequent colors first
+    for (int i = 1; i < count; i++)
+    {
+        palette_box box = boxes[i];
+        int j = i;
+        for (; j > 0 && boxes[j - 1].count < box.count; j--)
+            boxes[j] = boxes[j - 1];
+        boxes[j] = box;
+    }
+
+    for (int i = 0; i < count; i++)
+        palette->colors[i] = box_color(&boxes[i]);
+    palette->count = count;
+    return count;
+}
@@ -0,0 +1,50 @@
+/**
+ * LibAmbient - Extraction of the dominant colors of a frame.
+ *
+ * The pixels are counted in a histogram with 5 bits per channel, which is
+ * divided using median cut: the box holding the most pixels is split at the
+ * median of its longest axis, until there is a box for every color.
+ * A split only scans the bins of the box it splits, so the cost of a frame is
+ * bounded by the size of the histogram times the amount of colors,
+ * regardless of the content.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_PALETTE_H
+#define LIB_AMBIENT_PALETTE_H
+
+#include "libambient.hpp"
+
+// Levels per channel of the histogram
+#define PALETTE_BITS        5
+#define PALETTE_LEVELS      (1 << PALETTE_BITS)
+#define PALETTE_BINS        (PALETTE_LEVELS * PALETTE_LEVELS * PALETTE_LEVELS)
+
+// Most colors a palette can consist of
+#define PALETTE_MAX_COLORS  32
+
+// A box of the histogram, the bounds are inclusive levels (red, green, blue)
+struct palette_box
+{
+    int                 lo[3], hi[3];
+    unsigned long long  count;
+    unsigned long long  marginals[3][PALETTE_LEVELS];  // Pixels per level of each axis
+};
+
+struct color_palette
+{
+    unsigned int*   histogram;      // PALETTE_BINS counts, indexed by red << 10 | green << 5 | blue
+    palette_box     boxes[PALETTE_MAX_COLORS];
+    COLOR           colors[PALETTE_MAX_COLORS];    // Most frequent first
+    int             count;
+};
+
+bool    palette_initialize(color_palette* palette);
+void    palette_uninitialize(color_palette* palette);
+void    palette_clear(color_palette* palette);
+void    palette_accumulate(color_palette* palette, const COLOR* pixels, int count);
+int     palette_extract(color_palette* palette, int colors);
+
+#endif
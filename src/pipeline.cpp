@@ -0,0 +1,256 @@
+/**
+ * LibAmbient - Overlapping capture and reduction.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "pipeline.hpp"
+#include "stats.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+static void run_worker(capture_pipeline* pipeline)
+{
+    std::unique_lock<std::mutex> lock(pipeline->lock);
+    while (!pipeline->stop)
+    {
+        frame_slot* slot = NULL;
+        for (int i = 0; i < pipeline->depth && !slot; i++)
+            if (pipeline->slots[i].state == SLOT_FREE)
+                slot = &pipeline->slots[i];
+        if (!slot)
+        {
+            pipeline->signal.wait(lock);
+            continue;
+        }
+
+        slot->state = SLOT_CAPTURING;
+        lock.unlock();
+        capture_timestamps timestamps = { stats_now(), 0, 0, 0 };
+        capture_result result = pipeline->capture(pipeline->user, slot->pixels, slot->dirtyRows, &timestamps);
+        lock.lock();
+
+        slot->timestamps    = timestamps;
+        slot->result        = result;
+        slot->sequence      = pipeline->sequence++;
+        slot->state         = SLOT_READY;
+        pipeline->signal.notify_all();
+    }
+}
+
+/**
+ * Allocates the buffers of a slot, the old ones are not released.
+ */
+static bool allocate_slot(frame_slot* slot, int width, int height)
+{
+    slot->pixels    = (COLORREF*)       calloc(width * height, sizeof(COLORREF));
+    slot->dirtyRows = (unsigned char*)  malloc(height);
+    return slot->pixels && slot->dirtyRows;
+}
+
+static void free_slot(frame_slot* slot)
+{
+    free(slot->pixels);
+    free(slot->dirtyRows);
+    slot->pixels    = NULL;
+    slot->dirtyRows = NULL;
+}
+
+/**
+ * Prepares a pipeline, the worker only starts with the first call to pipeline_next().
+ * 
+ * @param depth The amount of slots, at least 2 (the frame of the caller and one in flight)
+ * @param width The width of a frame in pixels
+ * @param height The height of a frame in pixels
+ * @param capture Called by the worker to capture a frame into a slot
+ * @param user Passed to the capture function
+ */
+bool pipeline_initialize(capture_pipeline* pipeline, int depth, int width, int height,
+                         capture_function capture, void* user)
+{
+    if (depth < 2)                  depth = 2;
+    if (depth > PIPELINE_MAX_DEPTH) depth = PIPELINE_MAX_DEPTH;
+    pipeline->depth         = depth;
+    pipeline->width         = width;
+    pipeline->height        = height;
+    pipeline->pixelCapacity = (size_t) width * height;
+    pipeline->rowCapacity   = height;
+    pipeline->capture   = capture;
+    pipeline->user      = user;
+    pipeline->running   = false;
+    pipeline->stop      = false;
+    pipeline->discarded = false;
+    pipeline->sequence  = 0;
+
+    bool success = true;
+    for (int i = 0; i < depth; i++)
+    {
+        pipeline->slots[i].state = SLOT_FREE;
+        success = allocate_slot(&pipeline->slots[i], width, height) && success;
+    }
+
+    // The caller starts out with an empty frame
+    pipeline->slots[0].state = SLOT_HELD;
+    if (!success)
+        pipeline_uninitialize(pipeline);
+    return success;
+}
+
+/**
+ * Stops the worker and releases all slots.
+ */
+void pipeline_uninitialize(capture_pipeline* pipeline)
+{
+    pipeline_stop(pipeline);
+    for (int i = 0; i < pipeline->depth; i++)
+        free_slot(&pipeline->slots[i]);
+    pipeline->depth = 0;
+}
+
+/**
+ * Changes the size of all slots, which stops the worker.
+ * The slots are only reallocated if they are too small. The frame of the caller is cleared.
+ * 
+ * @return false if the slots could not be allocated, the old ones are kept in that case
+ */
+bool pipeline_resize(capture_pipeline* pipeline, int width, int height)
+{
+    pipeline_stop(pipeline);
+
+    size_t pixels = (size_t) width * height;
+    if (pixels <= pipeline->pixelCapacity && height <= pipeline->rowCapacity)
+    {
+        for (int i = 0; i < pipeline->depth; i++)
+            if (pipeline->slots[i].state == SLOT_HELD)
+                memset(pipeline->slots[i].pixels, 0, pixels * sizeof(COLORREF));
+        pipeline->width     = width;
+        pipeline->height    = height;
+        pipeline->discarded = true;
+        return true;
+    }
+
+    frame_slot slots[PIPELINE_MAX_DEPTH] = { };
+    bool success = true;
+    for (int i = 0; i < pipeline->depth; i++)
+        success = allocate_slot(&slots[i], width, height) && success;
+    if (!success)
+    {
+        for (int i = 0; i < pipeline->depth; i++)
+            free_slot(&slots[i]);
+        return false;
+    }
+
+    for (int i = 0; i < pipeline->depth; i++)
+    {
+        free_slot(&pipeline->slots[i]);
+        pipeline->slots[i].pixels       = slots[i].pixels;
+        pipeline->slots[i].dirtyRows    = slots[i].dirtyRows;
+    }
+    pipeline->width         = width;
+    pipeline->height        = height;
+    pipeline->pixelCapacity = pixels;
+    pipeline->rowCapacity   = height;
+    pipeline->discarded     = true;
+    return true;
+}
+
+/**
+ * Stops the worker and drops all frames which were not reduced yet.
+ * It is started again by the next call to pipeline_next().
+ */
+void pipeline_stop(capture_pipeline* pipeline)
+{
+    std::unique_lock<std::mutex> lock(pipeline->lock);
+    if (!pipeline->running)
+        return;
+
+    pipeline->stop = true;
+    pipeline->signal.notify_all();
+    lock.unlock();
+    pipeline->worker.join();
+    lock.lock();
+
+    // The dirty rows of a dropped frame are lost, so the next frame has to be reduced completely
+    for (int i = 0; i < pipeline->depth; i++)
+    {
+        frame_slot* slot = &pipeline->slots[i];
+        if (slot->state != SLOT_READY)
+            continue;
+        if (slot->result == CAPTURE_OK)
+            pipeline->discarded = true;
+        slot->state = SLOT_FREE;
+    }
+    pipeline->running   = false;
+    pipeline->stop      = false;
+}
+
+/**
+ * Waits for the oldest captured frame and lets the worker capture the next one.
+ * 
+ * @param timestamps Receives the timestamps of the frame
+ * @param pixels Receives the pixels of the frame if it is new,
+ *               which stay valid until the next new frame or pipeline_stop()
+ * @param dirtyRows Receives the dirty rows of the frame if it is new
+ * 
+ * @return The result of capturing the frame
+ */
+capture_result pipeline_next(capture_pipeline* pipeline, capture_timestamps* timestamps,
+                             COLORREF** pixels, unsigned char** dirtyRows)
+{
+    std::unique_lock<std::mutex> lock(pipeline->lock);
+    if (!pipeline->running)
+    {
+        pipeline->running   = true;
+        pipeline->worker    = std::thread(run_worker, pipeline);
+    }
+
+    frame_slot* slot = NULL;
+    while (!slot)
+    {
+        for (int i = 0; i < pipeline->depth; i++)
+        {
+            frame_slot* candidate = &pipeline->slots[i];
+            if (candidate->state == SLOT_READY && (!slot || candidate->sequence < slot->sequence))
+                slot = candidate;
+        }
+        if (!slot)
+            pipeline->signal.wait(lock);
+    }
+
+    *timestamps = slot->timestamps;
+    capture_result result = slot->result;
+    if (result == CAPTURE_OK)
+    {
+        for (int i = 0; i < pipeline->depth; i++)
+            if (pipeline->slots[i].state == SLOT_HELD)
+                pipeline->slots[i].state = SLOT_FREE;
+        slot->state = SLOT_HELD;
+
+        if (pipeline->discarded)
+        {
+            memset(slot->dirtyRows, 1, pipeline->height);
+            pipeline->discarded = false;
+        }
+        *pixels     = slot->pixels;
+        *dirtyRows  = slot->dirtyRows;
+    }
+    else
+    {
+        slot->state = SLOT_FREE;
+    }
+    pipeline->signal.notify_all();
+    return result;
+}
+
+/**
+ * Returns the pixels of the frame held by the caller.
+ */
+COLORREF* pipeline_pixels(capture_pipeline* pipeline)
+{
+    std::lock_guard<std::mutex> lock(pipeline->lock);
+    for (int i = 0; i < pipeline->depth; i++)
+        if (pipeline->slots[i].state == SLOT_HELD)
+            return pipeline->slots[i].pixels;
+    return NULL;
+}
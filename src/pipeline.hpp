@@ -0,0 +1,75 @@
+/**
+ * LibAmbient - Overlapping capture and reduction.
+ *
+ * A worker thread captures frames into a small ring of slots while the
+ * caller reduces the oldest captured one. The caller keeps the slot of the
+ * last new frame until the next new frame arrives, so its pixels can be
+ * reduced at any time. Throughput approaches the slower of capture and
+ * reduction instead of their sum, at the cost of depth - 1 frames of latency.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_PIPELINE_H
+#define LIB_AMBIENT_PIPELINE_H
+
+#include "capture.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define PIPELINE_MAX_DEPTH 3
+
+// Captures a frame into dest (see gdi_capture_frame / dxgi_capture_frame)
+typedef capture_result (*capture_function)(void* user, COLORREF* dest, unsigned char* dirtyRows,
+                                           capture_timestamps* timestamps);
+
+enum slot_state
+{
+    SLOT_FREE,
+    SLOT_CAPTURING,     // Written by the worker
+    SLOT_READY,         // Waiting to be reduced
+    SLOT_HELD           // Pixels of the current frame of the caller
+};
+
+struct frame_slot
+{
+    COLORREF*           pixels;
+    unsigned char*      dirtyRows;
+    capture_timestamps  timestamps;
+    capture_result      result;
+    slot_state          state;
+    unsigned long long  sequence;   // Order in which the slots became ready
+};
+
+struct capture_pipeline
+{
+    frame_slot          slots[PIPELINE_MAX_DEPTH];
+    int                 depth;
+    int                 width, height;
+    size_t              pixelCapacity;  // Pixels and rows the slots can hold, they only grow
+    int                 rowCapacity;
+
+    capture_function    capture;
+    void*               user;
+
+    std::thread             worker;
+    std::mutex              lock;
+    std::condition_variable signal;
+    bool                    running;
+    bool                    stop;
+    bool                    discarded;  // A new frame was dropped, so the next one is completely dirty
+    unsigned long long      sequence;
+};
+
+bool            pipeline_initialize(capture_pipeline* pipeline, int depth, int width, int height,
+                                    capture_function capture, void* user);
+void            pipeline_uninitialize(capture_pipeline* pipeline);
+bool            pipeline_resize(capture_pipeline* pipeline, int width, int height);
+void            pipeline_stop(capture_pipeline* pipeline);
+capture_result  pipeline_next(capture_pipeline* pipeline, capture_timestamps* timestamps,
+                              COLORREF** pixels, unsigned char** dirtyRows);
+COLORREF*       pipeline_pixels(capture_pipeline* pipeline);
+
+#endif
@@ -0,0 +1,22 @@
+/**
+ * LibAmbient - Formats of captured surfaces.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "pixel_format.hpp"
+
+/**
+ * Returns the size of a pixel of the specified format in bytes.
+ */
+int pixel_format_bytes(pixel_format format)
+{
+    switch (format)
+    {
+    case PIXEL_BGR8:        return pixel_traits<PIXEL_BGR8>::BYTES;
+    case PIXEL_RGB565:      return pixel_traits<PIXEL_RGB565>::BYTES;
+    case PIXEL_RGBA16F:     return pixel_traits<PIXEL_RGBA16F>::BYTES;
+    default:                return pixel_traits<PIXEL_BGRA8>::BYTES;
+    }
+}
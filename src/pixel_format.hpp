@@ -0,0 +1,91 @@
+/**
+ * LibAmbient - Formats of captured surfaces.
+ *
+ * Every kernel reading a surface in its native format is a template over
+ * the traits of that format, so each format gets its own instantiation
+ * without any branch per pixel. The instantiation is picked once,
+ * when the capture backend is initialized.
+ *
+ * The 8 bit formats are converted to COLOR while they are read. Half floats
+ * are copied as they are, as they have to be tone mapped (see tonemap_half).
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_PIXEL_FORMAT_H
+#define LIB_AMBIENT_PIXEL_FORMAT_H
+
+#include "libambient.hpp"
+#include <string.h>
+
+enum pixel_format
+{
+    PIXEL_BGRA8,        // 32 bit, blue in the lowest byte (DIB sections, DXGI_FORMAT_B8G8R8A8_UNORM)
+    PIXEL_BGR8,         // 24 bit DIB sections
+    PIXEL_RGB565,       // 16 bit DIB sections with 5-6-5 bit fields
+    PIXEL_RGBA16F,      // Linear half floats (DXGI_FORMAT_R16G16B16A16_FLOAT, scRGB), 1.0 is 80 nits
+    PIXEL_FORMAT_COUNT
+};
+
+// A pixel of PIXEL_RGBA16F, the bits of each half float
+struct rgba_half
+{
+    unsigned short c[4];
+};
+
+// Size of a pixel and the value it is read as, a COLOR (0xAARRGGBB, the alpha channel is not set)
+// for the 8 bit formats
+template<pixel_format Format> struct pixel_traits;
+
+template<> struct pixel_traits<PIXEL_BGRA8>
+{
+    typedef COLOR sample;
+    static const int BYTES = 4;
+    static inline COLOR load(const unsigned char* p)
+    {
+        COLOR color;
+        memcpy(&color, p, sizeof(color));
+        return color;
+    }
+};
+
+template<> struct pixel_traits<PIXEL_BGR8>
+{
+    typedef COLOR sample;
+    static const int BYTES = 3;
+    static inline COLOR load(const unsigned char* p)
+    {
+        return (COLOR) p[0] | ((COLOR) p[1] << 8) | ((COLOR) p[2] << 16);
+    }
+};
+
+template<> struct pixel_traits<PIXEL_RGB565>
+{
+    typedef COLOR sample;
+    static const int BYTES = 2;
+    static inline COLOR load(const unsigned char* p)
+    {
+        COLOR v = (COLOR) p[0] | ((COLOR) p[1] << 8);
+        COLOR r = (v >> 11) & 0x1f, g = (v >> 5) & 0x3f, b = v & 0x1f;
+
+        // Replicate the upper bits, so the full range maps to 0 - 255
+        return ((b << 3) | (b >> 2)) | (((g << 2) | (g >> 4)) << 8) | (((r << 3) | (r >> 2)) << 16);
+    }
+};
+
+template<> struct pixel_traits<PIXEL_RGBA16F>
+{
+    typedef rgba_half sample;
+    static const int BYTES = 8;
+    static inline rgba_half load(const unsigned char* p)
+    {
+        rgba_half pixel;
+        memcpy(&pixel, p, sizeof(pixel));
+        return pixel;
+    }
+};
+
+int     pixel_format_bytes(pixel_format format);
+
+#endif
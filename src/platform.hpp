@@ -0,0 +1,44 @@
+/**
+ * LibAmbient - Definitions of the platform the library is built for.
+ *
+ * The portable modules include this header instead of <Windows.h>.
+ * Elsewhere it provides the few Win32 types and helpers they share,
+ * everything else is implemented per platform where it is used.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_PLATFORM_H
+#define LIB_AMBIENT_PLATFORM_H
+
+#ifdef _WIN32
+    #include <Windows.h>
+#else
+    #include <limits.h>
+    #include <sched.h>
+    #include <time.h>
+
+    // A pixel of a captured frame, the bytes are in the order B, G, R, X like on Windows
+    typedef unsigned int COLORREF;
+
+    #define MAX_PATH PATH_MAX
+
+    #if defined(__x86_64__) || defined(__i386__)
+        #define YieldProcessor() __builtin_ia32_pause()
+    #else
+        #define YieldProcessor() sched_yield()
+    #endif
+
+    /**
+     * Milliseconds since the system was started, like GetTickCount64 on Windows.
+     */
+    static inline unsigned long long GetTickCount64()
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (unsigned long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+    }
+#endif
+
+#endif
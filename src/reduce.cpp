@@ -0,0 +1,339 @@
+/**
+ * LibAmbient - Reduction kernels operating on the captured pixels.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "reduce.hpp"
+#include <string.h>
+
+#ifdef AMBIENT_X86
+    #include <emmintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+#endif
+
+sum_channels_fn     sum_channels            = sum_channels_scalar;
+build_integral_fn   build_integral_image    = build_integral_image_scalar;
+sum_linear_fn       sum_linear              = sum_linear_scalar;
+sum_oklab_fn        sum_oklab               = sum_oklab_scalar;
+tonemap_half_fn     tonemap_half            = tonemap_half_scalar;
+
+static simd_level g_simdLevel = SIMD_SCALAR;
+
+/**
+ * Determines the best instruction set supported by the CPU and the operating system.
+ */
+static simd_level detect_simd_level()
+{
+#if defined(AMBIENT_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    if (!(info[3] & (1 << 26)))
+        return SIMD_SCALAR;
+
+    // AVX requires the OS to save the YMM registers (OSXSAVE + XCR0)
+    bool osxsave    = (info[2] & (1 << 27)) != 0;
+    bool avx        = (info[2] & (1 << 28)) != 0;
+    if (maxLeaf < 7 || !osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        return SIMD_SSE2;
+
+    bool f16c = (info[2] & (1 << 29)) != 0;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) && f16c ? SIMD_AVX2 : SIMD_SSE2;
+#elif defined(AMBIENT_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c"))
+        return SIMD_AVX2;
+    return __builtin_cpu_supports("sse2") ? SIMD_SSE2 : SIMD_SCALAR;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+/**
+ * Selects the kernel variants matching the CPU.
+ * Must be called before any of the kernels is used.
+ */
+void reduce_initialize()
+{
+    g_simdLevel = detect_simd_level();
+    switch (g_simdLevel)
+    {
+#ifdef AMBIENT_X86
+    case SIMD_AVX2:
+        sum_channels            = sum_channels_avx2;
+        build_integral_image    = build_integral_image_sse2;
+        sum_linear              = sum_linear_avx2;
+        sum_oklab               = sum_oklab_avx2;
+        tonemap_half            = tonemap_half_f16c;
+        break;
+    case SIMD_SSE2:
+        sum_channels            = sum_channels_sse2;
+        build_integral_image    = build_integral_image_sse2;
+        sum_linear              = sum_linear_scalar;
+        sum_oklab               = sum_oklab_scalar;
+        tonemap_half            = tonemap_half_scalar;
+        break;
+#endif
+    default:
+        sum_channels            = sum_channels_scalar;
+        build_integral_image    = build_integral_image_scalar;
+        sum_linear              = sum_linear_scalar;
+        sum_oklab               = sum_oklab_scalar;
+        tonemap_half            = tonemap_half_scalar;
+        break;
+    }
+}
+
+/**
+ * Returns the instruction set the selected kernels are using.
+ */
+simd_level reduce_simd_level()
+{
+    return g_simdLevel;
+}
+
+void sum_channels_scalar(const COLOR* pixels, int count, unsigned long long* sums)
+{
+    unsigned long long s0 = 0, s1 = 0, s2 = 0;
+    for (int x = 0; x < count; x++)
+    {
+        COLOR pixel = pixels[x];
+        s0 += (pixel      ) & 0xff;
+        s1 += (pixel >>  8) & 0xff;
+        s2 += (pixel >> 16) & 0xff;
+    }
+    sums[0] += s0;
+    sums[1] += s1;
+    sums[2] += s2;
+}
+
+void build_integral_image_scalar(const COLOR* pixels, int width, int height, unsigned int* table)
+{
+    int stride = (width + 1) * 4;
+    memset(table, 0, stride * sizeof(unsigned int));
+    for (int y = 0; y < height; y++)
+    {
+        const COLOR* src        = pixels + y * width;
+        const unsigned int* up  = table + y * stride;
+        unsigned int* row       = table + (y + 1) * stride;
+
+        unsigned int s0 = 0, s1 = 0, s2 = 0;
+        row[0] = row[1] = row[2] = row[3] = 0;
+        for (int x = 0; x < width; x++)
+        {
+            COLOR pixel = src[x];
+            s0 += (pixel      ) & 0xff;
+            s1 += (pixel >>  8) & 0xff;
+            s2 += (pixel >> 16) & 0xff;
+
+            unsigned int* entry         = row + (x + 1) * 4;
+            const unsigned int* above   = up + (x + 1) * 4;
+            entry[0] = above[0] + s0;
+            entry[1] = above[1] + s1;
+            entry[2] = above[2] + s2;
+            entry[3] = 0;
+        }
+    }
+}
+
+/**
+ * Accumulates into four interleaved histograms, so runs of pixels
+ * hitting the same bin do not stall on the previous increment.
+ */
+void accumulate_hues(const COLOR* pixels, int count, const unsigned short* lut, unsigned int* hues)
+{
+    unsigned int partial[4][HUE_RANGE];
+    memset(partial, 0, sizeof(partial));
+
+    unsigned int* h0 = partial[0];
+    unsigned int* h1 = partial[1];
+    unsigned int* h2 = partial[2];
+    unsigned int* h3 = partial[3];
+
+    #define RGB565_INDEX(p) ((((p) >> 8) & 0xf800) | (((p) >> 5) & 0x07e0) | (((p) >> 3) & 0x001f))
+    int x = 0;
+    for (; x + 4 <= count; x += 4)
+    {
+        unsigned short e0 = lut[RGB565_INDEX(pixels[x + 0])];
+        unsigned short e1 = lut[RGB565_INDEX(pixels[x + 1])];
+        unsigned short e2 = lut[RGB565_INDEX(pixels[x + 2])];
+        unsigned short e3 = lut[RGB565_INDEX(pixels[x + 3])];
+        h0[HUE_LUT_BIN(e0)] += HUE_LUT_WEIGHT(e0);
+        h1[HUE_LUT_BIN(e1)] += HUE_LUT_WEIGHT(e1);
+        h2[HUE_LUT_BIN(e2)] += HUE_LUT_WEIGHT(e2);
+        h3[HUE_LUT_BIN(e3)] += HUE_LUT_WEIGHT(e3);
+    }
+    for (; x < count; x++)
+    {
+        unsigned short e = lut[RGB565_INDEX(pixels[x])];
+        h0[HUE_LUT_BIN(e)] += HUE_LUT_WEIGHT(e);
+    }
+    #undef RGB565_INDEX
+
+    for (int bin = 0; bin < HUE_RANGE; bin++)
+        hues[bin] += h0[bin] + h1[bin] + h2[bin] + h3[bin];
+}
+
+void sum_linear_scalar(const COLOR* pixels, int count, const unsigned int* lut, unsigned long long* sums)
+{
+    unsigned long long s0 = 0, s1 = 0, s2 = 0;
+    for (int x = 0; x < count; x++)
+    {
+        COLOR pixel = pixels[x];
+        s0 += lut[(pixel      ) & 0xff];
+        s1 += lut[(pixel >>  8) & 0xff];
+        s2 += lut[(pixel >> 16) & 0xff];
+    }
+    sums[0] += s0;
+    sums[1] += s1;
+    sums[2] += s2;
+}
+
+void sum_oklab_scalar(const COLOR* pixels, int count, const unsigned short* lut, unsigned long long* sums)
+{
+    unsigned long long sL = 0, sA = 0, sB = 0;
+    #define RGB565_INDEX(p) ((((p) >> 8) & 0xf800) | (((p) >> 5) & 0x07e0) | (((p) >> 3) & 0x001f))
+    for (int x = 0; x < count; x++)
+    {
+        const unsigned short* entry = lut + 4 * RGB565_INDEX(pixels[x]);
+        sL += entry[0];
+        sA += entry[1];
+        sB += entry[2];
+    }
+    #undef RGB565_INDEX
+    sums[0] += sL;
+    sums[1] += sA;
+    sums[2] += sB;
+}
+
+/**
+ * Converts a half float to a float, including subnormals.
+ * Infinity and NaN keep their meaning.
+ */
+static inline float half_to_float(unsigned short half)
+{
+    union { unsigned int u; float f; } value, subnormal;
+    value.u = (unsigned int) (half & 0x7fff) << 13;
+    unsigned int exponent = value.u & (0x1f << 23);
+    value.u += (127 - 15) << 23;
+    if (exponent == (0x1f << 23))
+    {
+        value.u += (128 - 16) << 23;
+    }
+    else if (exponent == 0)
+    {
+        // Renormalized by the float unit, as 2^-14 * 0.m == (2^-14 + 2^-14 * 0.m) - 2^-14
+        subnormal.u = 113 << 23;
+        value.u    += 1 << 23;
+        value.f    -= subnormal.f;
+    }
+    value.u |= (unsigned int) (half & 0x8000) << 16;
+    return value.f;
+}
+
+/**
+ * Returns the exposed intensity of a channel, limited to the range of half floats.
+ */
+static inline float expose(unsigned short half, float exposure)
+{
+    float x = half_to_float(half) * exposure;
+    x = x > 0 ? x : 0;
+    return x < 65504.0f ? x : 65504.0f;
+}
+
+void tonemap_half_scalar(const unsigned short* pixels, int count, const tone_curve* curve,
+                         const unsigned char* lut, COLOR* dest)
+{
+    for (int x = 0; x < count; x++)
+    {
+        const unsigned short* p = pixels + 4 * x;
+        float c[3] = { expose(p[2], curve->exposure), expose(p[1], curve->exposure), expose(p[0], curve->exposure) };
+        float m = c[0] > c[1] ? c[0] : c[1];
+        m = m > c[2] ? m : c[2];
+        float scale = (curve->a * m + curve->b) / ((curve->c * m + curve->d) * m + curve->e);
+
+        COLOR color = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            float v = c[i] * scale;
+            v = v < 1.0f ? v : 1.0f;
+            color |= (COLOR) lut[(int) (v * (SRGB_LUT_SIZE - 1) + 0.5f)] << (8 * i);
+        }
+        dest[x] = color;
+    }
+}
+
+#ifdef AMBIENT_X86
+
+static inline unsigned long long horizontal_sum(__m128i v)
+{
+    unsigned long long result;
+    v = _mm_add_epi64(v, _mm_unpackhi_epi64(v, v));
+    _mm_storel_epi64((__m128i*) &result, v);
+    return result;
+}
+
+/**
+ * Masks out one channel of four pixels at a time and adds up its bytes using PSADBW,
+ * which accumulates into two 64 bit lanes.
+ */
+void sum_channels_sse2(const COLOR* pixels, int count, unsigned long long* sums)
+{
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i mask0 = _mm_set1_epi32(0x000000ff);
+    const __m128i mask1 = _mm_set1_epi32(0x0000ff00);
+    const __m128i mask2 = _mm_set1_epi32(0x00ff0000);
+
+    __m128i acc0 = zero, acc1 = zero, acc2 = zero;
+    int x = 0;
+    for (; x + 4 <= count; x += 4)
+    {
+        __m128i p = _mm_loadu_si128((const __m128i*) (pixels + x));
+        acc0 = _mm_add_epi64(acc0, _mm_sad_epu8(_mm_and_si128(p, mask0), zero));
+        acc1 = _mm_add_epi64(acc1, _mm_sad_epu8(_mm_and_si128(p, mask1), zero));
+        acc2 = _mm_add_epi64(acc2, _mm_sad_epu8(_mm_and_si128(p, mask2), zero));
+    }
+
+    sums[0] += horizontal_sum(acc0);
+    sums[1] += horizontal_sum(acc1);
+    sums[2] += horizontal_sum(acc2);
+    sum_channels_scalar(pixels + x, count - x, sums);
+}
+
+/**
+ * Widens each pixel to four 32 bit lanes, so an entry of the table
+ * is a single vector add of the running row sum and the entry above.
+ */
+void build_integral_image_sse2(const COLOR* pixels, int width, int height, unsigned int* table)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int stride = (width + 1) * 4;
+    memset(table, 0, stride * sizeof(unsigned int));
+    for (int y = 0; y < height; y++)
+    {
+        const COLOR* src        = pixels + y * width;
+        const unsigned int* up  = table + y * stride;
+        unsigned int* row       = table + (y + 1) * stride;
+
+        __m128i acc = zero;
+        _mm_storeu_si128((__m128i*) row, zero);
+        for (int x = 0; x < width; x++)
+        {
+            __m128i p = _mm_cvtsi32_si128((int) (src[x] & 0x00ffffff));
+            p   = _mm_unpacklo_epi16(_mm_unpacklo_epi8(p, zero), zero);
+            acc = _mm_add_epi32(acc, p);
+
+            __m128i above = _mm_loadu_si128((const __m128i*) (up + (x + 1) * 4));
+            _mm_storeu_si128((__m128i*) (row + (x + 1) * 4), _mm_add_epi32(acc, above));
+        }
+    }
+}
+
+#endif
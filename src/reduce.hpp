@@ -0,0 +1,148 @@
+/**
+ * LibAmbient - Reduction kernels operating on the captured pixels.
+ *
+ * All kernels are available as scalar, SSE2 and AVX2 variants.
+ * The lookup table kernels rely on gathers, so they have no SSE2 variant.
+ * The AVX2 variants may use F16C as well, which every CPU supporting AVX2 has.
+ * The fastest variant supported by the CPU is selected at runtime.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_REDUCE_H
+#define LIB_AMBIENT_REDUCE_H
+
+#include "libambient.hpp"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #define AMBIENT_X86
+#endif
+
+// Instruction sets a kernel can be implemented with
+enum simd_level
+{
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2
+};
+
+/**
+ * Sums the three color channels of the specified 32 bit pixels.
+ * The sums are added to the specified accumulators in the byte order of the pixels,
+ * 64 bit accumulators make sure they can not overflow for any realistic pixel count.
+ */
+typedef void (*sum_channels_fn)(const COLOR* pixels, int count, unsigned long long* sums);
+
+extern sum_channels_fn sum_channels;
+
+/**
+ * Builds a summed-area table of the three color channels of the specified 32 bit pixels.
+ * 
+ * The table has (width + 1) * (height + 1) entries of 4 unsigned ints
+ * (channels in byte order of the pixels, the 4th is unused), where the entry (x, y)
+ * holds the sums of all pixels above and left of it. The first row and column are zero.
+ * The sums wrap around, which still yields the correct sum of any region
+ * with less than 2^32 / 255 pixels, as unsigned subtraction is modular.
+ */
+typedef void (*build_integral_fn)(const COLOR* pixels, int width, int height, unsigned int* table);
+
+extern build_integral_fn build_integral_image;
+
+// Amount of bins of a hue histogram (1 for each degree)
+#define HUE_RANGE 360
+
+// Size of the lookup table used by accumulate_hues, indexed by the RGB565 value of a pixel
+#define HUE_LUT_SIZE    65536
+
+// An entry of the hue lookup table consists of the hue bin (upper 9 bits)
+// and the weight of the color (lower 7 bits).
+#define HUE_LUT_ENTRY(bin, weight)  ((unsigned short) (((bin) << 7) | (weight)))
+#define HUE_LUT_BIN(entry)          ((entry) >> 7)
+#define HUE_LUT_WEIGHT(entry)       ((entry) & 0x7f)
+#define HUE_LUT_MAX_WEIGHT          0x7f
+
+/**
+ * Adds the weight of each of the specified 32 bit pixels to its hue bin
+ * inside the specified histogram, using a lookup table built with HUE_LUT_ENTRY.
+ */
+void accumulate_hues(const COLOR* pixels, int count, const unsigned short* lut, unsigned int* hues);
+
+// Size of the lookup table used by sum_linear, indexed by the value of a channel
+#define LINEAR_LUT_SIZE     256
+
+// Linear intensity of a channel at full brightness inside the linear lookup table
+#define LINEAR_LUT_SCALE    65535
+
+/**
+ * Sums the linear intensities of the three color channels of the specified 32 bit pixels,
+ * looked up for each channel in a table of LINEAR_LUT_SIZE entries.
+ * The sums are added in the byte order of the pixels, like sum_channels.
+ */
+typedef void (*sum_linear_fn)(const COLOR* pixels, int count, const unsigned int* lut, unsigned long long* sums);
+
+extern sum_linear_fn sum_linear;
+
+// Size of the lookup table used by sum_oklab, indexed by the RGB565 value of a pixel
+#define OKLAB_LUT_SIZE      65536
+
+// An entry of the OKLab lookup table consists of 4 unsigned shorts: L, a, b and an unused one.
+// L is scaled by OKLAB_LUT_SCALE, a and b are offset by OKLAB_LUT_BIAS so they are never negative.
+#define OKLAB_LUT_SCALE     32768
+#define OKLAB_LUT_BIAS      16384
+
+/**
+ * Sums the L, a and b components of the specified 32 bit pixels,
+ * looked up in a table of OKLAB_LUT_SIZE entries (see OKLAB_LUT_SCALE).
+ */
+typedef void (*sum_oklab_fn)(const COLOR* pixels, int count, const unsigned short* lut, unsigned long long* sums);
+
+extern sum_oklab_fn sum_oklab;
+
+/**
+ * Maps linear light above SDR white into the SDR range, as the rational function
+ * (a * x^2 + b * x) / (c * x^2 + d * x + e) of the brightest channel x of a pixel.
+ * All channels of a pixel are scaled by the same factor, which keeps its hue,
+ * and clipped to SDR white if the curve exceeds it.
+ */
+struct tone_curve
+{
+    float exposure;     // Scales the intensities, so 1.0 is SDR white
+    float a, b, c, d, e;
+};
+
+// Size of the lookup table used by tonemap_half, indexed by the linear intensity of a channel.
+// It is followed by 3 unused bytes, so every entry can be gathered as 32 bits.
+#define SRGB_LUT_SIZE       4096
+
+/**
+ * Tone maps the specified RGBA half float pixels (DXGI_FORMAT_R16G16B16A16_FLOAT) into 32 bit pixels,
+ * using a table of the sRGB encoded value of SRGB_LUT_SIZE linear intensities from 0 to 1.
+ * Negative and NaN intensities count as black.
+ */
+typedef void (*tonemap_half_fn)(const unsigned short* pixels, int count, const tone_curve* curve,
+                                const unsigned char* lut, COLOR* dest);
+
+extern tonemap_half_fn tonemap_half;
+
+void        reduce_initialize();
+simd_level  reduce_simd_level();
+
+// Kernel variants, exposed for testing and benchmarking
+void        sum_channels_scalar(const COLOR* pixels, int count, unsigned long long* sums);
+void        build_integral_image_scalar(const COLOR* pixels, int width, int height, unsigned int* table);
+void        sum_linear_scalar(const COLOR* pixels, int count, const unsigned int* lut, unsigned long long* sums);
+void        sum_oklab_scalar(const COLOR* pixels, int count, const unsigned short* lut, unsigned long long* sums);
+void        tonemap_half_scalar(const unsigned short* pixels, int count, const tone_curve* curve,
+                                const unsigned char* lut, COLOR* dest);
+#ifdef AMBIENT_X86
+void        sum_channels_sse2(const COLOR* pixels, int count, unsigned long long* sums);
+void        build_integral_image_sse2(const COLOR* pixels, int width, int height, unsigned int* table);
+void        sum_channels_avx2(const COLOR* pixels, int count, unsigned long long* sums);
+void        sum_linear_avx2(const COLOR* pixels, int count, const unsigned int* lut, unsigned long long* sums);
+void        sum_oklab_avx2(const COLOR* pixels, int count, const unsigned short* lut, unsigned long long* sums);
+void        tonemap_half_f16c(const unsigned short* pixels, int count, const tone_curve* curve,
+                              const unsigned char* lut, COLOR* dest);
+#endif
+
+#endif
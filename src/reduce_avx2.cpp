@@ -0,0 +1,202 @@
+/**
+ * LibAmbient - AVX2 variants of the reduction kernels.
+ *
+ * This file is compiled with AVX2 code generation enabled,
+ * its kernels may only be called if the CPU supports AVX2.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "reduce.hpp"
+
+#ifdef AMBIENT_X86
+
+#include <immintrin.h>
+
+static inline unsigned long long horizontal_sum(__m256i v)
+{
+    unsigned long long result;
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    half = _mm_add_epi64(half, _mm_unpackhi_epi64(half, half));
+    _mm_storel_epi64((__m128i*) &result, half);
+    return result;
+}
+
+/**
+ * Adds up the unsigned 32 bit lanes of a vector into four 64 bit lanes.
+ */
+static inline __m256i widen_lanes(__m256i v)
+{
+    return _mm256_add_epi64(_mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)),
+                            _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1)));
+}
+
+/**
+ * Same as sum_channels_sse2, processing eight pixels at a time.
+ */
+void sum_channels_avx2(const COLOR* pixels, int count, unsigned long long* sums)
+{
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i mask0 = _mm256_set1_epi32(0x000000ff);
+    const __m256i mask1 = _mm256_set1_epi32(0x0000ff00);
+    const __m256i mask2 = _mm256_set1_epi32(0x00ff0000);
+
+    __m256i acc0 = zero, acc1 = zero, acc2 = zero;
+    int x = 0;
+    for (; x + 8 <= count; x += 8)
+    {
+        __m256i p = _mm256_loadu_si256((const __m256i*) (pixels + x));
+        acc0 = _mm256_add_epi64(acc0, _mm256_sad_epu8(_mm256_and_si256(p, mask0), zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_sad_epu8(_mm256_and_si256(p, mask1), zero));
+        acc2 = _mm256_add_epi64(acc2, _mm256_sad_epu8(_mm256_and_si256(p, mask2), zero));
+    }
+
+    sums[0] += horizontal_sum(acc0);
+    sums[1] += horizontal_sum(acc1);
+    sums[2] += horizontal_sum(acc2);
+    sum_channels_sse2(pixels + x, count - x, sums);
+}
+
+/**
+ * Gathers the intensity of each channel of eight pixels at a time.
+ * The 32 bit lanes are widened into 64 bit accumulators before they could overflow.
+ */
+void sum_linear_avx2(const COLOR* pixels, int count, const unsigned int* lut, unsigned long long* sums)
+{
+    // Every lane adds at most LINEAR_LUT_SCALE per iteration
+    const int blockPixels = 8 * (int) (0xffffffffULL / LINEAR_LUT_SCALE);
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i mask  = _mm256_set1_epi32(0xff);
+    const int* table    = (const int*) lut;
+
+    __m256i wide0 = zero, wide1 = zero, wide2 = zero;
+    int x = 0;
+    while (x + 8 <= count)
+    {
+        int end = count - x > blockPixels ? x + blockPixels : count;
+        __m256i acc0 = zero, acc1 = zero, acc2 = zero;
+        for (; x + 8 <= end; x += 8)
+        {
+            __m256i p = _mm256_loadu_si256((const __m256i*) (pixels + x));
+            acc0 = _mm256_add_epi32(acc0, _mm256_i32gather_epi32(table, _mm256_and_si256(p, mask), 4));
+            acc1 = _mm256_add_epi32(acc1, _mm256_i32gather_epi32(table,
+                _mm256_and_si256(_mm256_srli_epi32(p, 8), mask), 4));
+            acc2 = _mm256_add_epi32(acc2, _mm256_i32gather_epi32(table,
+                _mm256_and_si256(_mm256_srli_epi32(p, 16), mask), 4));
+        }
+        wide0 = _mm256_add_epi64(wide0, widen_lanes(acc0));
+        wide1 = _mm256_add_epi64(wide1, widen_lanes(acc1));
+        wide2 = _mm256_add_epi64(wide2, widen_lanes(acc2));
+    }
+
+    sums[0] += horizontal_sum(wide0);
+    sums[1] += horizontal_sum(wide1);
+    sums[2] += horizontal_sum(wide2);
+    sum_linear_scalar(pixels + x, count - x, lut, sums);
+}
+
+/**
+ * Gathers the 64 bit entries of eight pixels at a time and widens their components,
+ * so the accumulator holds the L, a and b sums of two pixels per iteration in its lanes 0-2 and 4-6.
+ */
+void sum_oklab_avx2(const COLOR* pixels, int count, const unsigned short* lut, unsigned long long* sums)
+{
+    // Every lane adds at most four components below 2^15 per iteration
+    const int blockPixels = 8 * 32767;
+    const __m256i zero      = _mm256_setzero_si256();
+    const __m256i maskR     = _mm256_set1_epi32(0xf800);
+    const __m256i maskG     = _mm256_set1_epi32(0x07e0);
+    const __m256i maskB     = _mm256_set1_epi32(0x001f);
+    const long long* table  = (const long long*) lut;
+
+    __m256i wide = zero;
+    int x = 0;
+    while (x + 8 <= count)
+    {
+        int end = count - x > blockPixels ? x + blockPixels : count;
+        __m256i acc = zero;
+        for (; x + 8 <= end; x += 8)
+        {
+            __m256i p = _mm256_loadu_si256((const __m256i*) (pixels + x));
+            __m256i index = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(p, 8), maskR),
+                _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(p, 5), maskG),
+                                _mm256_and_si256(_mm256_srli_epi32(p, 3), maskB)));
+
+            __m256i e0 = _mm256_i32gather_epi64(table, _mm256_castsi256_si128(index), 8);
+            __m256i e1 = _mm256_i32gather_epi64(table, _mm256_extracti128_si256(index, 1), 8);
+            acc = _mm256_add_epi32(acc, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(e0)));
+            acc = _mm256_add_epi32(acc, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(e0, 1)));
+            acc = _mm256_add_epi32(acc, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(e1)));
+            acc = _mm256_add_epi32(acc, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(e1, 1)));
+        }
+        wide = _mm256_add_epi64(wide, widen_lanes(acc));
+    }
+
+    unsigned long long lanes[4];
+    _mm256_storeu_si256((__m256i*) lanes, wide);
+    sums[0] += lanes[0];
+    sums[1] += lanes[1];
+    sums[2] += lanes[2];
+    sum_oklab_scalar(pixels + x, count - x, lut, sums);
+}
+
+/**
+ * Same as tonemap_half_scalar, converting eight pixels at a time with F16C.
+ */
+void tonemap_half_f16c(const unsigned short* pixels, int count, const tone_curve* curve,
+                       const unsigned char* lut, COLOR* dest)
+{
+    const __m256 zero       = _mm256_setzero_ps();
+    const __m256 one        = _mm256_set1_ps(1.0f);
+    const __m256 halfMax    = _mm256_set1_ps(65504.0f);
+    const __m256 lutScale   = _mm256_set1_ps((float) (SRGB_LUT_SIZE - 1));
+    const __m256 round      = _mm256_set1_ps(0.5f);
+    const __m256 exposure   = _mm256_set1_ps(curve->exposure);
+    const __m256 a = _mm256_set1_ps(curve->a), b = _mm256_set1_ps(curve->b);
+    const __m256 c = _mm256_set1_ps(curve->c), d = _mm256_set1_ps(curve->d), e = _mm256_set1_ps(curve->e);
+    const __m256i byteMask  = _mm256_set1_epi32(0xff);
+
+    // The transpose leaves the pixels in the order 0 2 4 6 1 3 5 7
+    const __m256i order     = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    int x = 0;
+    for (; x + 8 <= count; x += 8)
+    {
+        // Two pixels (RGBA RGBA) per vector
+        const __m128i* src = (const __m128i*) (pixels + 4 * x);
+        __m256 v0 = _mm256_cvtph_ps(_mm_loadu_si128(src + 0));
+        __m256 v1 = _mm256_cvtph_ps(_mm_loadu_si128(src + 1));
+        __m256 v2 = _mm256_cvtph_ps(_mm_loadu_si128(src + 2));
+        __m256 v3 = _mm256_cvtph_ps(_mm_loadu_si128(src + 3));
+
+        __m256 rg01 = _mm256_unpacklo_ps(v0, v1), ba01 = _mm256_unpackhi_ps(v0, v1);
+        __m256 rg23 = _mm256_unpacklo_ps(v2, v3), ba23 = _mm256_unpackhi_ps(v2, v3);
+        __m256 ch[3] =
+        {
+            _mm256_shuffle_ps(ba01, ba23, _MM_SHUFFLE(1, 0, 1, 0)),
+            _mm256_shuffle_ps(rg01, rg23, _MM_SHUFFLE(3, 2, 3, 2)),
+            _mm256_shuffle_ps(rg01, rg23, _MM_SHUFFLE(1, 0, 1, 0))
+        };
+
+        // max returns its second operand for NaN, which makes it black
+        for (int i = 0; i < 3; i++)
+            ch[i] = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(ch[i], exposure), zero), halfMax);
+        __m256 m = _mm256_max_ps(_mm256_max_ps(ch[0], ch[1]), ch[2]);
+        __m256 scale = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(a, m), b),
+            _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(c, m), d), m), e));
+
+        __m256i color = _mm256_setzero_si256();
+        for (int i = 0; i < 3; i++)
+        {
+            __m256 v = _mm256_min_ps(_mm256_mul_ps(ch[i], scale), one);
+            __m256i index = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, lutScale), round));
+            __m256i value = _mm256_and_si256(_mm256_i32gather_epi32((const int*) lut, index, 1), byteMask);
+            color = _mm256_or_si256(color, _mm256_slli_epi32(value, 8 * i));
+        }
+        _mm256_storeu_si256((__m256i*) (dest + x), _mm256_permutevar8x32_epi32(color, order));
+    }
+    tonemap_half_scalar(pixels + 4 * x, count - x, curve, lut, dest + x);
+}
+
+#endif
@@ -0,0 +1,298 @@
+/**
+ * LibAmbient - Reduction of captured frames on the GPU.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "libambient.hpp"
+#include "reduce_gpu.hpp"
+#include "reduce.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <d3dcompiler.h>
+
+#define SAFE_RELEASE(p) if (p) { (p)->Release(); (p) = NULL; }
+
+#define STRINGIFY_VALUE(x)  #x
+#define STRINGIFY(x)        STRINGIFY_VALUE(x)
+
+// Amount of thread groups working on each rectangle and the threads per group.
+// The threads of all groups of a rectangle are interleaved over its pixels.
+#define GPU_GROUP_SIZE  256
+#define GPU_GROUPS      64
+
+// Size of the histogram at the start of the result buffer in bytes
+#define GPU_HUES_SIZE   (HUE_RANGE * 8)
+
+// The pixels are read as unorm values and converted back to bytes, so the sums
+// equal the ones calculated on the CPU. Group results are added to 64 bit
+// counters (two 32 bit words), carrying into the upper word on overflow.
+static const char g_reduceShader[] =
+    "Texture2D<float4>         g_frame   : register(t0);                        \n"
+    "StructuredBuffer<uint4>   g_rects   : register(t1);                        \n"
+    "RWByteAddressBuffer       g_results : register(u0);                        \n"
+    "groupshared uint3         gs_sums[GROUP_SIZE];                             \n"
+    "groupshared uint          gs_hues[HUE_RANGE];                              \n"
+    "void add64(uint address, uint value)                                       \n"
+    "{                                                                          \n"
+    "    uint original;                                                         \n"
+    "    g_results.InterlockedAdd(address, value, original);                    \n"
+    "    if (original + value < original)                                       \n"
+    "        g_results.InterlockedAdd(address + 4, 1);                          \n"
+    "}                                                                          \n"
+    "uint3 load_pixel(uint4 rect, uint i)                                       \n"
+    "{                                                                          \n"
+    "    uint width = rect.z - rect.x;                                          \n"
+    "    int3 pos = int3(rect.x + i % width, rect.y + i / width, 0);            \n"
+    "    return (uint3) (g_frame.Load(pos).bgr * 255.0 + 0.5);                  \n"
+    "}                                                                          \n"
+    "[numthreads(GROUP_SIZE, 1, 1)]                                             \n"
+    "void cs_sums(uint3 group : SV_GroupID, uint index : SV_GroupIndex)         \n"
+    "{                                                                          \n"
+    "    uint4 rect  = g_rects[group.z];                                        \n"
+    "    uint  count = (rect.z - rect.x) * (rect.w - rect.y);                   \n"
+    "    uint3 sum   = 0;                                                       \n"
+    "    for (uint i = group.x * GROUP_SIZE + index; i < count;                 \n"
+    "         i += GROUPS * GROUP_SIZE)                                         \n"
+    "        sum += load_pixel(rect, i);                                        \n"
+    "    gs_sums[index] = sum;                                                  \n"
+    "    GroupMemoryBarrierWithGroupSync();                                     \n"
+    "    for (uint s = GROUP_SIZE / 2; s > 0; s >>= 1)                          \n"
+    "    {                                                                      \n"
+    "        if (index < s)                                                     \n"
+    "            gs_sums[index] += gs_sums[index + s];                          \n"
+    "        GroupMemoryBarrierWithGroupSync();                                 \n"
+    "    }                                                                      \n"
+    "    if (index == 0)                                                        \n"
+    "    {                                                                      \n"
+    "        uint address = HUE_RANGE * 8 + group.z * 24;                       \n"
+    "        add64(address + 0,  gs_sums[0].x);                                 \n"
+    "        add64(address + 8,  gs_sums[0].y);                                 \n"
+    "        add64(address + 16, gs_sums[0].z);                                 \n"
+    "    }                                                                      \n"
+    "}                                                                          \n"
+    "[numthreads(GROUP_SIZE, 1, 1)]                                             \n"
+    "void cs_hues(uint3 group : SV_GroupID, uint index : SV_GroupIndex)         \n"
+    "{                                                                          \n"
+    "    for (uint b = index; b < HUE_RANGE; b += GROUP_SIZE)                   \n"
+    "        gs_hues[b] = 0;                                                    \n"
+    "    GroupMemoryBarrierWithGroupSync();                                     \n"
+    "    uint4 rect  = g_rects[0];                                              \n"
+    "    uint  count = (rect.z - rect.x) * (rect.w - rect.y);                   \n"
+    "    for (uint i = group.x * GROUP_SIZE + index; i < count;                 \n"
+    "         i += GROUPS * GROUP_SIZE)                                         \n"
+    "    {                                                                      \n"
+    "        // Quantize to RGB565 like the lookup table used on the CPU        \n"
+    "        uint3 q = load_pixel(rect, i).zyx >> uint3(3, 2, 3);               \n"
+    "        float3 c = (float3) ((q << uint3(3, 2, 3)) | (q >> uint3(2, 4, 2)));\n"
+    "        float cmax  = max(c.r, max(c.g, c.b));                             \n"
+    "        float delta = cmax - min(c.r, min(c.g, c.b));                      \n"
+    "        if (delta <= 0)                                                    \n"
+    "            continue;                                                      \n"
+    "        float h = c.r == cmax ? (c.g - c.b) / delta                        \n"
+    "                : c.g == cmax ? 2.0 + (c.b - c.r) / delta                  \n"
+    "                :               4.0 + (c.r - c.g) / delta;                 \n"
+    "        h /= 6.0;                                                          \n"
+    "        if (h < 0) h += 1.0;                                               \n"
+    "        // Saturation times brightness                                     \n"
+    "        uint weight = (uint) (delta / 255.0 * HUE_MAX_WEIGHT + 0.5);       \n"
+    "        InterlockedAdd(gs_hues[(uint) (h * HUE_RANGE) % HUE_RANGE], weight);\n"
+    "    }                                                                      \n"
+    "    GroupMemoryBarrierWithGroupSync();                                     \n"
+    "    for (uint bin = index; bin < HUE_RANGE; bin += GROUP_SIZE)             \n"
+    "        if (gs_hues[bin])                                                  \n"
+    "            add64(bin * 8, gs_hues[bin]);                                  \n"
+    "}                                                                          \n";
+
+static ID3D11ComputeShader* create_shader(ID3D11Device* device, const char* entryPoint)
+{
+    const D3D_SHADER_MACRO defines[] =
+    {
+        { "GROUP_SIZE",     STRINGIFY(GPU_GROUP_SIZE) },
+        { "GROUPS",         STRINGIFY(GPU_GROUPS) },
+        { "HUE_RANGE",      STRINGIFY(HUE_RANGE) },
+        { "HUE_MAX_WEIGHT", "127" },
+        { NULL, NULL }
+    };
+
+    ID3DBlob* code   = NULL;
+    ID3DBlob* errors = NULL;
+    HRESULT hr = D3DCompile(g_reduceShader, sizeof(g_reduceShader) - 1, NULL, defines, NULL,
+        entryPoint, "cs_5_0", D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &code, &errors);
+    if (FAILED(hr))
+    {
+        dbgErr(errors ? (const char*) errors->GetBufferPointer() : "Failed to compile shader");
+    }
+    SAFE_RELEASE(errors);
+
+    ID3D11ComputeShader* shader = NULL;
+    if (code)
+        device->CreateComputeShader(code->GetBufferPointer(), code->GetBufferSize(), NULL, &shader);
+    SAFE_RELEASE(code);
+    return shader;
+}
+
+static void release_buffers(gpu_reduction* gpu)
+{
+    SAFE_RELEASE(gpu->resultStaging);
+    SAFE_RELEASE(gpu->resultView);
+    SAFE_RELEASE(gpu->results);
+    SAFE_RELEASE(gpu->rectView);
+    SAFE_RELEASE(gpu->rects);
+    gpu->capacity = 0;
+}
+
+/**
+ * (Re-)creates the buffers, so they hold at least the specified amount of rectangles.
+ */
+static bool reserve_buffers(gpu_reduction* gpu, int count)
+{
+    if (count <= gpu->capacity)
+        return true;
+    release_buffers(gpu);
+
+    D3D11_BUFFER_DESC desc = { 0 };
+    desc.ByteWidth              = count * 4 * sizeof(UINT);
+    desc.Usage                  = D3D11_USAGE_DEFAULT;
+    desc.BindFlags              = D3D11_BIND_SHADER_RESOURCE;
+    desc.MiscFlags              = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    desc.StructureByteStride    = 4 * sizeof(UINT);
+    if (FAILED(gpu->device->CreateBuffer(&desc, NULL, &gpu->rects))
+        || FAILED(gpu->device->CreateShaderResourceView(gpu->rects, NULL, &gpu->rectView)))
+    {
+        release_buffers(gpu);
+        return false;
+    }
+
+    desc.ByteWidth              = GPU_HUES_SIZE + count * 3 * sizeof(unsigned long long);
+    desc.BindFlags              = D3D11_BIND_UNORDERED_ACCESS;
+    desc.MiscFlags              = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+    desc.StructureByteStride    = 0;
+    if (FAILED(gpu->device->CreateBuffer(&desc, NULL, &gpu->results)))
+    {
+        release_buffers(gpu);
+        return false;
+    }
+
+    D3D11_UNORDERED_ACCESS_VIEW_DESC viewDesc = { };
+    viewDesc.Format                 = DXGI_FORMAT_R32_TYPELESS;
+    viewDesc.ViewDimension          = D3D11_UAV_DIMENSION_BUFFER;
+    viewDesc.Buffer.NumElements     = desc.ByteWidth / 4;
+    viewDesc.Buffer.Flags           = D3D11_BUFFER_UAV_FLAG_RAW;
+    if (FAILED(gpu->device->CreateUnorderedAccessView(gpu->results, &viewDesc, &gpu->resultView)))
+    {
+        release_buffers(gpu);
+        return false;
+    }
+
+    desc.Usage          = D3D11_USAGE_STAGING;
+    desc.BindFlags      = 0;
+    desc.MiscFlags      = 0;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    if (FAILED(gpu->device->CreateBuffer(&desc, NULL, &gpu->resultStaging)))
+    {
+        release_buffers(gpu);
+        return false;
+    }
+
+    gpu->capacity = count;
+    return true;
+}
+
+/**
+ * Compiles the reduction shaders for the specified device.
+ *
+ * @return false if compute shaders are not supported. The state is released in that case.
+ */
+bool gpu_reduction_initialize(gpu_reduction* gpu, ID3D11Device* device, ID3D11DeviceContext* context)
+{
+    memset(gpu, 0, sizeof(*gpu));
+    gpu->device     = device;
+    gpu->context    = context;
+    gpu->sumShader  = create_shader(device, "cs_sums");
+    gpu->hueShader  = create_shader(device, "cs_hues");
+    if (!gpu->sumShader || !gpu->hueShader || !reserve_buffers(gpu, 1))
+    {
+        dbgErr("==> GPU reduction not available");
+        gpu_reduction_uninitialize(gpu);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Releases all resources of the specified reduction state.
+ */
+void gpu_reduction_uninitialize(gpu_reduction* gpu)
+{
+    release_buffers(gpu);
+    SAFE_RELEASE(gpu->hueShader);
+    SAFE_RELEASE(gpu->sumShader);
+    gpu->device     = NULL;
+    gpu->context    = NULL;
+}
+
+/**
+ * Sums the channels of the active area and of each zone and builds the hue histogram of the area.
+ *
+ * @param frame The frame to reduce
+ * @param area The part of the frame the hue is calculated from, usually the whole frame
+ * @param zones The zones in frame coordinates
+ * @param sums Receives 3 channel sums (in byte order of the pixels) for the area,
+ *             followed by 3 sums for each zone
+ * @param hues Receives HUE_RANGE bins, weighted like the CPU histogram (see accumulate_hues)
+ *
+ * @return false if the buffers could not be allocated or read back
+ */
+bool gpu_reduce(gpu_reduction* gpu, ID3D11ShaderResourceView* frame, const zone_rect* area,
+                const zone_rect* zones, int zoneCount, unsigned long long* sums, unsigned int* hues)
+{
+    int count = zoneCount + 1;
+    if (!reserve_buffers(gpu, count))
+        return false;
+
+    // The layout of zone_rect matches the uint4 of the shader
+    D3D11_BOX box = { 0, 0, 0, sizeof(zone_rect), 1, 1 };
+    gpu->context->UpdateSubresource(gpu->rects, 0, &box, area, 0, 0);
+    if (zoneCount > 0)
+    {
+        box.left    = sizeof(zone_rect);
+        box.right   = count * sizeof(zone_rect);
+        gpu->context->UpdateSubresource(gpu->rects, 0, &box, zones, 0, 0);
+    }
+
+    const UINT zero[4] = { 0, 0, 0, 0 };
+    gpu->context->ClearUnorderedAccessViewUint(gpu->resultView, zero);
+
+    ID3D11ShaderResourceView* views[2] = { frame, gpu->rectView };
+    gpu->context->CSSetShaderResources(0, 2, views);
+    gpu->context->CSSetUnorderedAccessViews(0, 1, &gpu->resultView, NULL);
+    gpu->context->CSSetShader(gpu->sumShader, NULL, 0);
+    gpu->context->Dispatch(GPU_GROUPS, 1, count);
+    gpu->context->CSSetShader(gpu->hueShader, NULL, 0);
+    gpu->context->Dispatch(GPU_GROUPS, 1, 1);
+
+    ID3D11ShaderResourceView*  nullViews[2] = { NULL, NULL };
+    ID3D11UnorderedAccessView* nullUav      = NULL;
+    gpu->context->CSSetShaderResources(0, 2, nullViews);
+    gpu->context->CSSetUnorderedAccessViews(0, 1, &nullUav, NULL);
+    gpu->context->CSSetShader(NULL, NULL, 0);
+
+    // Only read back the part of the buffer which is in use
+    UINT size = GPU_HUES_SIZE + count * 3 * sizeof(unsigned long long);
+    D3D11_BOX resultBox = { 0, 0, 0, size, 1, 1 };
+    gpu->context->CopySubresourceRegion(gpu->resultStaging, 0, 0, 0, 0, gpu->results, 0, &resultBox);
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (FAILED(gpu->context->Map(gpu->resultStaging, 0, D3D11_MAP_READ, 0, &mapped)))
+        return false;
+
+    const unsigned long long* results = (const unsigned long long*) mapped.pData;
+    for (int i = 0; i < HUE_RANGE; i++)
+        hues[i] = results[i] > 0xffffffffULL ? 0xffffffffU : (unsigned int) results[i];
+    memcpy(sums, results + HUE_RANGE, count * 3 * sizeof(unsigned long long));
+
+    gpu->context->Unmap(gpu->resultStaging, 0);
+    return true;
+}
@@ -0,0 +1,46 @@
+/**
+ * LibAmbient - Reduction of captured frames on the GPU.
+ *
+ * A compute shader sums the channels of every zone (and the whole screen)
+ * and builds the hue histogram straight from the full resolution frame.
+ * Only the sums and the histogram are read back, i.e. a few hundred bytes
+ * instead of the pixels.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_REDUCE_GPU_H
+#define LIB_AMBIENT_REDUCE_GPU_H
+
+#include <Windows.h>
+#include <d3d11.h>
+#include "zones.hpp"
+
+struct gpu_reduction
+{
+    // Borrowed from the capture backend
+    ID3D11Device*               device;
+    ID3D11DeviceContext*        context;
+
+    ID3D11ComputeShader*        sumShader;
+    ID3D11ComputeShader*        hueShader;
+
+    // Rectangles to sum, the first one is the area the hue is calculated from
+    ID3D11Buffer*               rects;
+    ID3D11ShaderResourceView*   rectView;
+
+    // Histogram followed by the sums of each rectangle, as 64 bit values
+    ID3D11Buffer*               results;
+    ID3D11UnorderedAccessView*  resultView;
+    ID3D11Buffer*               resultStaging;
+
+    int                         capacity;   // Amount of rectangles the buffers can hold
+};
+
+bool    gpu_reduction_initialize(gpu_reduction* gpu, ID3D11Device* device, ID3D11DeviceContext* context);
+void    gpu_reduction_uninitialize(gpu_reduction* gpu);
+bool    gpu_reduce(gpu_reduction* gpu, ID3D11ShaderResourceView* frame, const zone_rect* area,
+                   const zone_rect* zones, int zoneCount, unsigned long long* sums, unsigned int* hues);
+
+#endif
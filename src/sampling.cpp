@@ -0,0 +1,238 @@
+/**
+ * LibAmbient - Sampling of native resolution surfaces.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "sampling.hpp"
+#include "reduce.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+// Plastic constant based R2 sequence, used to derive the offset of a sample inside its cell.
+// Neighbouring cells get offsets far apart, similar to a blue noise mask.
+#define R2_A1 0.7548776662466927
+#define R2_A2 0.5698402909980532
+
+static double fraction(double value)
+{
+    return value - (double) (long long) value;
+}
+
+/**
+ * Prepares sampling a surface of the specified size.
+ *
+ * @param mode SAMPLING_STRIDE or SAMPLING_PATTERN
+ * @param strideX The horizontal distance between two samples in pixels
+ * @param strideY The vertical distance between two samples in pixels
+ *
+ * @return false if the sample positions could not be allocated. The grid is released in that case.
+ */
+bool sample_grid_initialize(sample_grid* grid, SAMPLING_MODE mode, int strideX, int strideY,
+                        int surfaceWidth, int surfaceHeight)
+{
+    memset(grid, 0, sizeof(*grid));
+    grid->mode           = mode;
+    grid->strideX        = strideX > 0 ? strideX : 1;
+    grid->strideY        = strideY > 0 ? strideY : 1;
+    grid->surfaceWidth   = surfaceWidth;
+    grid->surfaceHeight  = surfaceHeight;
+    grid->width          = (surfaceWidth  + grid->strideX - 1) / grid->strideX;
+    grid->height         = (surfaceHeight + grid->strideY - 1) / grid->strideY;
+
+    if (mode != SAMPLING_PATTERN)
+        return true;
+
+    int count = grid->width * grid->height;
+    grid->sampleX = (int*) malloc(count * sizeof(int));
+    grid->sampleY = (int*) malloc(count * sizeof(int));
+    if (!grid->sampleX || !grid->sampleY)
+    {
+        sample_grid_uninitialize(grid);
+        return false;
+    }
+
+    for (int cy = 0; cy < grid->height; cy++)
+    {
+        for (int cx = 0; cx < grid->width; cx++)
+        {
+            int x = cx * grid->strideX + (int) (fraction(0.5 + cx * R2_A1 + cy * R2_A2) * grid->strideX);
+            int y = cy * grid->strideY + (int) (fraction(0.5 + cx * R2_A2 + cy * R2_A1) * grid->strideY);
+            if (x >= surfaceWidth)  x = surfaceWidth - 1;
+            if (y >= surfaceHeight) y = surfaceHeight - 1;
+            grid->sampleX[cy * grid->width + cx] = x;
+            grid->sampleY[cy * grid->width + cx] = y;
+        }
+    }
+    return true;
+}
+
+/**
+ * Releases the sample positions of the specified grid.
+ */
+void sample_grid_uninitialize(sample_grid* grid)
+{
+    free(grid->sampleX);
+    free(grid->sampleY);
+    grid->sampleX = NULL;
+    grid->sampleY = NULL;
+}
+
+/**
+ * Reads the top left pixel of every cell.
+ */
+template<pixel_format Format>
+static void gather_stride(const sample_grid* grid, const unsigned char* surface, int pitch,
+                          typename pixel_traits<Format>::sample* dest)
+{
+    typedef pixel_traits<Format> traits;
+    const size_t step = (size_t) grid->strideX * traits::BYTES;
+    for (int cy = 0; cy < grid->height; cy++)
+    {
+        const unsigned char* row = surface + (size_t) cy * grid->strideY * pitch;
+        typename traits::sample* out = dest + cy * grid->width;
+        for (int cx = 0; cx < grid->width; cx++)
+            out[cx] = traits::load(row + cx * step);
+    }
+}
+
+/**
+ * Reads the pixel at the precomputed position inside every cell.
+ */
+template<pixel_format Format>
+static void gather_pattern(const sample_grid* grid, const unsigned char* surface, int pitch,
+                           typename pixel_traits<Format>::sample* dest)
+{
+    typedef pixel_traits<Format> traits;
+    int count = grid->width * grid->height;
+    for (int i = 0; i < count; i++)
+        dest[i] = traits::load(surface + (size_t) grid->sampleY[i] * pitch + (size_t) grid->sampleX[i] * traits::BYTES);
+}
+
+// Indexed by the 8 bit formats, which precede PIXEL_RGBA16F
+static const sample_gather_fn g_gatherKernels[PIXEL_RGBA16F][2] =
+{
+    { gather_stride<PIXEL_BGRA8>,   gather_pattern<PIXEL_BGRA8>   },
+    { gather_stride<PIXEL_BGR8>,    gather_pattern<PIXEL_BGR8>    },
+    { gather_stride<PIXEL_RGB565>,  gather_pattern<PIXEL_RGB565>  }
+};
+
+/**
+ * Returns the gather kernel for the sampling mode of the grid and the specified 8 bit surface format.
+ */
+sample_gather_fn sample_grid_kernel(const sample_grid* grid, pixel_format format)
+{
+    return g_gatherKernels[format][grid->mode == SAMPLING_PATTERN ? 1 : 0];
+}
+
+/**
+ * Copies the samples of a grid from a PIXEL_RGBA16F surface into the specified buffer,
+ * which must hold width * height pixels.
+ */
+void sample_grid_gather_half(const sample_grid* grid, const unsigned char* surface, int pitch, rgba_half* dest)
+{
+    if (grid->mode == SAMPLING_PATTERN)
+        gather_pattern<PIXEL_RGBA16F>(grid, surface, pitch, dest);
+    else
+        gather_stride<PIXEL_RGBA16F>(grid, surface, pitch, dest);
+}
+
+/**
+ * Splits a source extent into the specified amount of boxes, each covering at least one pixel.
+ */
+static void map_spans(int* spans, int count, int extent)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int begin   = (int) ((long long) i * extent / count);
+        int end     = (int) ((long long) (i + 1) * extent / count);
+        spans[2 * i]        = begin;
+        spans[2 * i + 1]    = end > begin ? end : begin + 1;
+    }
+}
+
+/**
+ * Lays out the boxes for downscaling a surface of the specified size.
+ * The buffers only grow, so reconfiguring to a smaller size allocates nothing.
+ *
+ * @return false if the buffers could not be grown, the previous layout is kept in that case
+ */
+bool box_filter_configure(box_filter* filter, int surfaceWidth, int surfaceHeight, int width, int height)
+{
+    // The new buffers replace the old ones only once all of them were allocated
+    bool growColumns = width > filter->columnCapacity, growRows = height > filter->rowCapacity;
+    int* columnSpans            = growColumns ? (int*) malloc(width * 2 * sizeof(int)) : NULL;
+    unsigned long long* sums    = growColumns ? (unsigned long long*) malloc(width * 3 * sizeof(unsigned long long)) : NULL;
+    int* rowSpans               = growRows ? (int*) malloc(height * 2 * sizeof(int)) : NULL;
+    if ((growColumns && (!columnSpans || !sums)) || (growRows && !rowSpans))
+    {
+        free(columnSpans);
+        free(sums);
+        free(rowSpans);
+        return false;
+    }
+
+    if (growColumns)
+    {
+        free(filter->columnSpans);
+        free(filter->sums);
+        filter->columnSpans     = columnSpans;
+        filter->sums            = sums;
+        filter->columnCapacity  = width;
+    }
+    if (growRows)
+    {
+        free(filter->rowSpans);
+        filter->rowSpans    = rowSpans;
+        filter->rowCapacity = height;
+    }
+
+    filter->width   = width;
+    filter->height  = height;
+    map_spans(filter->columnSpans, width, surfaceWidth);
+    map_spans(filter->rowSpans, height, surfaceHeight);
+    return true;
+}
+
+void box_filter_uninitialize(box_filter* filter)
+{
+    free(filter->columnSpans);
+    free(filter->rowSpans);
+    free(filter->sums);
+    memset(filter, 0, sizeof(*filter));
+}
+
+/**
+ * Averages each box of a 32 bit surface (BGRA or BGRX) into the specified buffer,
+ * which must hold width * height pixels.
+ *
+ * @param pitch The distance between two rows of the surface in bytes
+ */
+void box_filter_apply(const box_filter* filter, const unsigned char* surface, int pitch, COLOR* dest)
+{
+    int width = filter->width;
+    const int* columns = filter->columnSpans;
+    unsigned long long* sums = filter->sums;
+    for (int ty = 0; ty < filter->height; ty++)
+    {
+        int y0 = filter->rowSpans[2 * ty], y1 = filter->rowSpans[2 * ty + 1];
+        memset(sums, 0, width * 3 * sizeof(unsigned long long));
+        for (int y = y0; y < y1; y++)
+        {
+            const COLOR* row = (const COLOR*) (surface + (size_t) y * pitch);
+            for (int tx = 0; tx < width; tx++)
+                sum_channels(row + columns[2 * tx], columns[2 * tx + 1] - columns[2 * tx], sums + 3 * tx);
+        }
+
+        COLOR* out = dest + ty * width;
+        for (int tx = 0; tx < width; tx++)
+        {
+            unsigned long long count = (unsigned long long) (columns[2 * tx + 1] - columns[2 * tx]) * (y1 - y0);
+            const unsigned long long* s = sums + 3 * tx;
+            out[tx] = (COLOR) ((s[0] + count / 2) / count)
+                   | ((COLOR) ((s[1] + count / 2) / count) << 8)
+                   | ((COLOR) ((s[2] + count / 2) / count) << 16);
+        }
+    }
+}
@@ -0,0 +1,61 @@
+/**
+ * LibAmbient - Sampling of native resolution surfaces.
+ *
+ * Instead of downscaling the screen, a grid of samples is read directly from
+ * the captured surface. Each sample is either the top left pixel of its cell
+ * (stride) or a pixel at a fixed, well distributed offset inside its cell (pattern).
+ * Backends which can not downscale the surface themselves average it with a box filter.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_SAMPLING_H
+#define LIB_AMBIENT_SAMPLING_H
+
+#include "libambient.hpp"
+#include "pixel_format.hpp"
+
+struct sample_grid
+{
+    SAMPLING_MODE   mode;
+    int             strideX, strideY;
+    int             width, height;      // Size of the sample grid
+    int             surfaceWidth, surfaceHeight;
+
+    // Position of each sample on the surface, only used with SAMPLING_PATTERN
+    int*            sampleX;
+    int*            sampleY;
+};
+
+bool    sample_grid_initialize(sample_grid* grid, SAMPLING_MODE mode, int strideX, int strideY,
+                           int surfaceWidth, int surfaceHeight);
+void    sample_grid_uninitialize(sample_grid* grid);
+/**
+ * Reads the samples of a grid from a surface into the specified buffer, which must hold width * height pixels.
+ * There is an instantiation per 8 bit surface format and sampling mode (see sample_grid_kernel).
+ *
+ * @param pitch The distance between two rows of the surface in bytes
+ */
+typedef void (*sample_gather_fn)(const sample_grid* grid, const unsigned char* surface, int pitch, COLOR* dest);
+
+sample_gather_fn    sample_grid_kernel(const sample_grid* grid, pixel_format format);
+void                sample_grid_gather_half(const sample_grid* grid, const unsigned char* surface, int pitch,
+                                            rgba_half* dest);
+
+// Averages each box of a 32 bit surface into a pixel of the downscaled image
+struct box_filter
+{
+    // First and last + 1 source column (and row) of each pixel of the downscaled image
+    int*                columnSpans;
+    int*                rowSpans;
+    int                 columnCapacity, rowCapacity;
+    unsigned long long* sums;           // Channel sums of a row of the downscaled image
+    int                 width, height;  // Size of the downscaled image
+};
+
+bool    box_filter_configure(box_filter* filter, int surfaceWidth, int surfaceHeight, int width, int height);
+void    box_filter_uninitialize(box_filter* filter);
+void    box_filter_apply(const box_filter* filter, const unsigned char* surface, int pitch, COLOR* dest);
+
+#endif
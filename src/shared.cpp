@@ -0,0 +1,257 @@
+/**
+ * LibAmbient - Publication of the results to other processes.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "shared.hpp"
+#include "stats.hpp"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Time between two publications of the statistics, which are too expensive to summarize every frame
+#define SHARED_STATS_INTERVAL_MS    250
+
+// Time a reader retries while a publication is in progress, publishing takes microseconds,
+// so a sequence which stays odd for longer belongs to a publisher which died while writing
+#define SHARED_READ_TIMEOUT_MS      10
+
+// Prefix of the name of the file mapping, which keeps it inside the session of the user.
+// POSIX shared memory objects have a single namespace, see shared_publish_open.
+#ifdef _WIN32
+    #define SHARED_NAME_PREFIX      "Local\\LibAmbient_"
+#else
+    #define SHARED_NAME_PREFIX      "/LibAmbient_"
+#endif
+
+static bool mapping_name(const char* name, char* dest, size_t size)
+{
+    return name && *name && snprintf(dest, size, SHARED_NAME_PREFIX "%s", name) < (int) size;
+}
+
+#ifndef _WIN32
+/**
+ * Maps the shared memory object of the specified name, which is created if it does not exist.
+ * The object is only accessible by the user, like a mapping in the local namespace on Windows.
+ */
+static void* map_object(const char* path, bool create)
+{
+    int file = shm_open(path, create ? O_RDWR | O_CREAT : O_RDONLY, 0600);
+    if (file < 0)
+        return NULL;
+
+    // A reader never grows the object, a segment which was not sized yet is not published
+    struct stat info;
+    bool sized = create ? ftruncate(file, sizeof(shared_segment)) == 0
+        : fstat(file, &info) == 0 && info.st_size >= (off_t) sizeof(shared_segment);
+    void* view = sized ? mmap(NULL, sizeof(shared_segment), create ? PROT_READ | PROT_WRITE : PROT_READ,
+        MAP_SHARED, file, 0) : MAP_FAILED;
+
+    // The mapping keeps the object alive on its own
+    close(file);
+    return view != MAP_FAILED ? view : NULL;
+}
+#endif
+
+/**
+ * Creates (or takes over) the shared memory segment of the specified name.
+ * 
+ * @return false if the segment could not be created, the publisher is closed in that case
+ */
+bool shared_publish_open(shared_publisher* publisher, const char* name)
+{
+    memset(publisher, 0, sizeof(*publisher));
+    char mappingName[MAX_PATH];
+    if (!mapping_name(name, mappingName, sizeof(mappingName)))
+        return false;
+
+#ifdef _WIN32
+    publisher->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+        sizeof(shared_segment), mappingName);
+    if (!publisher->mapping)
+        return false;
+
+    publisher->segment = (shared_segment*) MapViewOfFile(publisher->mapping, FILE_MAP_ALL_ACCESS, 0, 0,
+        sizeof(shared_segment));
+#else
+    memcpy(publisher->path, mappingName, sizeof(mappingName));
+    publisher->segment = (shared_segment*) map_object(mappingName, true);
+#endif
+    if (!publisher->segment)
+    {
+        shared_publish_close(publisher);
+        return false;
+    }
+
+    // A segment left by a previous publisher is kept alive by its readers and reused.
+    // The sequence is made even, so the readers do not wait for a write which never finishes.
+    shared_segment* segment = publisher->segment;
+    unsigned int sequence = segment->sequence.load(std::memory_order_relaxed);
+    segment->sequence.store((sequence + 1) & ~1u, std::memory_order_relaxed);
+    segment->version = SHARED_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    segment->magic = SHARED_MAGIC;
+    return true;
+}
+
+/**
+ * Unmaps the segment, which stays readable as long as readers have it opened.
+ * Outside of Windows the name is removed, so readers opening it later find nothing.
+ */
+void shared_publish_close(shared_publisher* publisher)
+{
+#ifdef _WIN32
+    if (publisher->segment)
+        UnmapViewOfFile(publisher->segment);
+    if (publisher->mapping)
+        CloseHandle(publisher->mapping);
+    publisher->mapping = NULL;
+#else
+    if (publisher->segment)
+    {
+        munmap(publisher->segment, sizeof(shared_segment));
+        shm_unlink(publisher->path);
+    }
+#endif
+    publisher->segment = NULL;
+}
+
+/**
+ * Returns whether the statistics should be included in the next publication.
+ */
+bool shared_publish_stats_due(shared_publisher* publisher)
+{
+    long long now = stats_now();
+    if (publisher->lastStats && stats_elapsed_ms(publisher->lastStats, now) < SHARED_STATS_INTERVAL_MS)
+        return false;
+    publisher->lastStats = now;
+    return true;
+}
+
+/**
+ * Writes the results of a frame into the segment.
+ * 
+ * @param zones The colors of the zones, only the first SHARED_MAX_ZONES are published
+ * @param stats Optional, keeps the statistics of the previous publication if NULL
+ */
+void shared_publish(shared_publisher* publisher, unsigned int frameId, HUE hue,
+                    const COLOR* zones, int zoneCount, const ambient_stats* stats)
+{
+    shared_segment* segment = publisher->segment;
+    if (zoneCount > SHARED_MAX_ZONES)
+        zoneCount = SHARED_MAX_ZONES;
+
+    // Odd while writing, the fence keeps the data from being written before the sequence
+    unsigned int sequence = segment->sequence.load(std::memory_order_relaxed);
+    segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    segment->frameId        = frameId;
+    segment->hue            = hue;
+    segment->zoneCount      = zoneCount;
+    segment->publishedMs    = GetTickCount64();
+    if (stats)
+        segment->stats = *stats;
+    if (zoneCount > 0)
+        memcpy(segment->zones, zones, zoneCount * sizeof(COLOR));
+
+    segment->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+/**
+ * Opens the segment published under the specified name.
+ * 
+ * @return false if nothing is published under that name
+ */
+bool shared_reader_open(ambient_reader* reader, const char* name)
+{
+    memset(reader, 0, sizeof(*reader));
+    char mappingName[MAX_PATH];
+    if (!mapping_name(name, mappingName, sizeof(mappingName)))
+        return false;
+
+#ifdef _WIN32
+    reader->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, mappingName);
+    if (!reader->mapping)
+        return false;
+
+    reader->segment = (const shared_segment*) MapViewOfFile(reader->mapping, FILE_MAP_READ, 0, 0,
+        sizeof(shared_segment));
+#else
+    reader->segment = (const shared_segment*) map_object(mappingName, false);
+#endif
+    if (!reader->segment)
+    {
+        shared_reader_close(reader);
+        return false;
+    }
+    return true;
+}
+
+void shared_reader_close(ambient_reader* reader)
+{
+#ifdef _WIN32
+    if (reader->segment)
+        UnmapViewOfFile(reader->segment);
+    if (reader->mapping)
+        CloseHandle(reader->mapping);
+    reader->mapping = NULL;
+#else
+    if (reader->segment)
+        munmap((void*) reader->segment, sizeof(shared_segment));
+#endif
+    reader->segment = NULL;
+}
+
+/**
+ * Copies a consistent snapshot of the segment, retrying while the publisher writes.
+ * 
+ * @param zones Receives up to zoneCapacity zone colors
+ * 
+ * @return false if the segment was not published yet, by an incompatible version,
+ *         or if no consistent snapshot could be copied within SHARED_READ_TIMEOUT_MS
+ */
+bool shared_read(const ambient_reader* reader, ambient_snapshot* dest, COLOR* zones, int zoneCapacity)
+{
+    const shared_segment* segment = reader->segment;
+    if (segment->magic != SHARED_MAGIC || segment->version != SHARED_VERSION)
+        return false;
+
+    unsigned long long deadline = GetTickCount64() + SHARED_READ_TIMEOUT_MS;
+    for (;;)
+    {
+        unsigned int sequence = segment->sequence.load(std::memory_order_acquire);
+        if (sequence & 1)
+        {
+            if (GetTickCount64() > deadline)
+                return false;
+            YieldProcessor();
+            continue;
+        }
+
+        dest->frameId       = segment->frameId;
+        dest->hue           = segment->hue;
+        dest->zoneCount     = segment->zoneCount;
+        dest->publishedMs   = segment->publishedMs;
+        dest->stats         = segment->stats;
+
+        int count = dest->zoneCount < zoneCapacity ? dest->zoneCount : zoneCapacity;
+        if (zones && count > 0 && count <= SHARED_MAX_ZONES)
+            memcpy(zones, segment->zones, count * sizeof(COLOR));
+
+        // The copy is only consistent if nothing was written in the meantime
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (segment->sequence.load(std::memory_order_relaxed) == sequence)
+            return true;
+        if (GetTickCount64() > deadline)
+            return false;
+    }
+}
@@ -0,0 +1,70 @@
+/**
+ * LibAmbient - Publication of the results to other processes.
+ *
+ * A capturing process writes the hue, the zone colors and the statistics
+ * into a named shared memory segment, which any number of processes can read
+ * without capturing the screen themselves. The segment is guarded by a
+ * seqlock: the sequence is odd while the publisher writes, and a reader
+ * retries whenever the sequence changed while it copied the data.
+ * The segment is a file mapping on Windows and a POSIX shared memory object elsewhere.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_SHARED_H
+#define LIB_AMBIENT_SHARED_H
+
+#include "platform.hpp"
+#include "libambient.hpp"
+#include <atomic>
+
+#define SHARED_MAGIC        0x31424d41  // "AMB1"
+#define SHARED_VERSION      2
+#define SHARED_MAX_ZONES    1024
+
+// Layout of the shared memory segment, which must not change without incrementing SHARED_VERSION
+struct shared_segment
+{
+    unsigned int                magic;
+    unsigned int                version;
+    std::atomic<unsigned int>   sequence;
+
+    unsigned int                frameId;
+    HUE                         hue;
+    int                         zoneCount;
+    unsigned long long          publishedMs;    // GetTickCount64() at the time of publication
+    ambient_stats               stats;
+    COLOR                       zones[SHARED_MAX_ZONES];
+};
+
+struct shared_publisher
+{
+#ifdef _WIN32
+    HANDLE          mapping;
+#else
+    char            path[MAX_PATH];     // Name of the shared memory object, unlinked when the publisher closes
+#endif
+    shared_segment* segment;
+    long long       lastStats;      // See stats_now
+};
+
+struct ambient_reader
+{
+#ifdef _WIN32
+    HANDLE                  mapping;
+#endif
+    const shared_segment*   segment;
+};
+
+bool    shared_publish_open(shared_publisher* publisher, const char* name);
+void    shared_publish_close(shared_publisher* publisher);
+bool    shared_publish_stats_due(shared_publisher* publisher);
+void    shared_publish(shared_publisher* publisher, unsigned int frameId, HUE hue,
+                       const COLOR* zones, int zoneCount, const ambient_stats* stats);
+
+bool    shared_reader_open(ambient_reader* reader, const char* name);
+void    shared_reader_close(ambient_reader* reader);
+bool    shared_read(const ambient_reader* reader, ambient_snapshot* dest, COLOR* zones, int zoneCapacity);
+
+#endif
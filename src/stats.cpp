@@ -0,0 +1,112 @@
+/**
+ * LibAmbient - Timing of the capture pipeline.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "stats.hpp"
+#include <string.h>
+#include <algorithm>
+#include "platform.hpp"
+
+/**
+ * Returns the current value of the performance counter (nanoseconds of the monotonic clock outside of Windows).
+ */
+long long stats_now()
+{
+#ifdef _WIN32
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+static double ticks_per_ms()
+{
+#ifdef _WIN32
+    // The frequency is fixed at boot, so it is only queried once
+    static const double ticksPerMs = []
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        return frequency.QuadPart / 1000.0;
+    }();
+    return ticksPerMs;
+#else
+    return 1000000.0;
+#endif
+}
+
+/**
+ * Converts the difference of two performance counter values to milliseconds.
+ */
+float stats_elapsed_ms(long long start, long long end)
+{
+    return (float) ((end - start) / ticks_per_ms());
+}
+
+/**
+ * Converts milliseconds to performance counter ticks, e.g. to time recorded frames on the same clock.
+ */
+long long stats_ticks(double ms)
+{
+    return (long long) (ms * ticks_per_ms());
+}
+
+/**
+ * Adds the duration of a stage, replacing the oldest one once the window is full.
+ */
+void stats_record(frame_stats* stats, stats_stage stage, float ms)
+{
+    stage_samples* samples = &stats->stages[stage];
+    samples->ms[samples->next] = ms;
+    samples->next = (samples->next + 1) % STATS_WINDOW;
+    if (samples->count < STATS_WINDOW)
+        samples->count++;
+}
+
+static void summarize_stage(const stage_samples* samples, ambient_timing* dest)
+{
+    memset(dest, 0, sizeof(*dest));
+    if (samples->count == 0)
+        return;
+
+    // The window is small, so sorting a copy is cheap enough for a query
+    float sorted[STATS_WINDOW];
+    memcpy(sorted, samples->ms, samples->count * sizeof(float));
+    std::sort(sorted, sorted + samples->count);
+
+    double sum = 0;
+    for (int i = 0; i < samples->count; i++)
+        sum += sorted[i];
+
+    dest->minMs = sorted[0];
+    dest->maxMs = sorted[samples->count - 1];
+    dest->avgMs = (float) (sum / samples->count);
+    dest->p99Ms = sorted[(samples->count - 1) * 99 / 100];
+}
+
+/**
+ * Calculates the rolling statistics of all stages and copies the frame counters.
+ */
+void stats_summarize(const frame_stats* stats, ambient_stats* dest)
+{
+    summarize_stage(&stats->stages[STAGE_CAPTURE],  &dest->capture);
+    summarize_stage(&stats->stages[STAGE_READBACK], &dest->readback);
+    summarize_stage(&stats->stages[STAGE_REDUCE],   &dest->reduce);
+    summarize_stage(&stats->stages[STAGE_TOTAL],    &dest->total);
+    dest->frames    = stats->frames;
+    dest->changed   = stats->changed;
+    dest->unchanged = stats->unchanged;
+    dest->dropped   = stats->dropped;
+
+    dest->throttleReasons   = stats->throttleReasons;
+    dest->throttleFactor    = stats->throttleFactor > 0 ? stats->throttleFactor : 1;
+    dest->throttleChanges   = stats->throttleChanges;
+    dest->throttledFrames   = stats->throttledFrames;
+}
@@ -0,0 +1,58 @@
+/**
+ * LibAmbient - Timing of the capture pipeline.
+ *
+ * Each stage of a frame is timed using the performance counter.
+ * The durations of the last STATS_WINDOW frames are kept per stage,
+ * so the statistics follow the current load of the machine.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_STATS_H
+#define LIB_AMBIENT_STATS_H
+
+#include "libambient.hpp"
+
+// Amount of frames the rolling statistics are calculated from
+#define STATS_WINDOW 256
+
+enum stats_stage
+{
+    STAGE_CAPTURE,
+    STAGE_READBACK,
+    STAGE_REDUCE,
+    STAGE_TOTAL,
+    STAGE_COUNT
+};
+
+// Ring buffer of the most recent durations of a stage in milliseconds
+struct stage_samples
+{
+    float   ms[STATS_WINDOW];
+    int     count;
+    int     next;
+};
+
+struct frame_stats
+{
+    stage_samples       stages[STAGE_COUNT];
+    unsigned long long  frames;
+    unsigned long long  changed;
+    unsigned long long  unchanged;
+    unsigned long long  dropped;
+
+    // Throttling of the capture thread, the current decision survives a reset of the counters
+    int                 throttleReasons;
+    float               throttleFactor;
+    unsigned long long  throttleChanges;
+    unsigned long long  throttledFrames;
+};
+
+long long   stats_now();
+float       stats_elapsed_ms(long long start, long long end);
+long long   stats_ticks(double ms);
+void        stats_record(frame_stats* stats, stats_stage stage, float ms);
+void        stats_summarize(const frame_stats* stats, ambient_stats* dest);
+
+#endif
@@ -0,0 +1,195 @@
+/**
+ * LibAmbient - Throttling of the capture thread.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "throttle.hpp"
+#include <stdio.h>
+#include <string.h>
+#ifdef __linux__
+    #include <dirent.h>
+#endif
+
+// Defaults of the configuration
+#define THROTTLE_BATTERY_FACTOR     2.0f
+#define THROTTLE_CONTENTION_FACTOR  4.0f
+#define THROTTLE_LATENCY_THRESHOLD  3.0f
+
+// Time between two probes of the power state and the foreground, which are too expensive for every frame
+#define THROTTLE_PROBE_INTERVAL_MS  1000
+
+// Frames measured before the baseline is trusted
+#define THROTTLE_WARMUP_FRAMES      60
+
+// Weights of a new frame in the moving averages. The baseline follows contended frames
+// a lot slower, so a lasting change of the load (e.g. a larger bitmap) is eventually accepted.
+#define THROTTLE_RECENT_SMOOTHING   0.25f
+#define THROTTLE_BASELINE_SMOOTHING 0.02f
+#define THROTTLE_CONTENDED_SMOOTHING 0.002f
+
+// Spikes of less than this are noise, however large they are compared to a fast baseline
+#define THROTTLE_MIN_SPIKE_MS       2.0f
+
+// Consecutive slow frames needed for contention, so a single hiccup (e.g. paging) does not throttle
+#define THROTTLE_SPIKE_FRAMES       8
+
+/**
+ * Sets the reasons to throttle for and the factors of the interval, NULL disables the throttle.
+ * The measurements start over and the capture runs at full rate until the next decision.
+ */
+void throttle_configure(capture_throttle* throttle, const ambient_throttle_config* config)
+{
+    throttle->enabled = config ? config->reasons & (THROTTLE_BATTERY | THROTTLE_LATENCY | THROTTLE_FULLSCREEN) : 0;
+    if (config)
+    {
+        throttle->batteryFactor     = config->batteryFactor    >= 1 ? config->batteryFactor    : THROTTLE_BATTERY_FACTOR;
+        throttle->contentionFactor  = config->contentionFactor >= 1 ? config->contentionFactor : THROTTLE_CONTENTION_FACTOR;
+        throttle->latencyThreshold  = config->latencyThreshold >  1 ? config->latencyThreshold : THROTTLE_LATENCY_THRESHOLD;
+    }
+    throttle_reset(throttle);
+}
+
+/**
+ * Discards all measurements and decisions, e.g. when the capture thread starts.
+ * The configuration is kept.
+ */
+void throttle_reset(capture_throttle* throttle)
+{
+    throttle->baselineMs    = 0;
+    throttle->recentMs      = 0;
+    throttle->frames        = 0;
+    throttle->spikes        = 0;
+    throttle->probed        = 0;
+    throttle->nextProbeMs   = 0;
+    throttle->reasons       = 0;
+    throttle->factor        = 1;
+}
+
+#ifdef __linux__
+/**
+ * Reads the first line of a small file (e.g. an attribute in sysfs) without its line break.
+ */
+static bool read_line(const char* path, char* dest, int size)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return false;
+    bool success = fgets(dest, size, file) != NULL;
+    fclose(file);
+    if (success)
+        dest[strcspn(dest, "\n")] = '\0';
+    return success;
+}
+#endif
+
+/**
+ * Determines whether the machine runs on battery.
+ * Battery saver counts as running on battery as well, even while charging.
+ */
+static bool on_battery()
+{
+#ifdef _WIN32
+    SYSTEM_POWER_STATUS status;
+    if (!GetSystemPowerStatus(&status))
+        return false;
+    return status.ACLineStatus == 0 || status.SystemStatusFlag != 0;
+#elif defined(__linux__)
+    // Desktops have no battery at all, laptops on AC have an online mains supply
+    DIR* supplies = opendir("/sys/class/power_supply");
+    if (!supplies)
+        return false;
+
+    bool mains = false, discharging = false;
+    char path[MAX_PATH], value[64];
+    while (dirent* entry = readdir(supplies))
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "/sys/class/power_supply/%s/type", entry->d_name);
+        if (!read_line(path, value, sizeof(value)))
+            continue;
+
+        if (strcmp(value, "Mains") == 0)
+        {
+            snprintf(path, sizeof(path), "/sys/class/power_supply/%s/online", entry->d_name);
+            mains |= read_line(path, value, sizeof(value)) && strcmp(value, "1") == 0;
+        }
+        else if (strcmp(value, "Battery") == 0)
+        {
+            snprintf(path, sizeof(path), "/sys/class/power_supply/%s/status", entry->d_name);
+            discharging |= read_line(path, value, sizeof(value)) && strcmp(value, "Discharging") == 0;
+        }
+    }
+    closedir(supplies);
+    return discharging && !mains;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Adds the latency of a frame and probes the power state and the foreground if they are due,
+ * then decides which reasons slow down the capture thread.
+ *
+ * @param monitor The captured monitor, NULL if there is none (e.g. a replay)
+ * @param frameMs The time spent capturing and reducing the frame, 0 if nothing was captured
+ *
+ * @return true if the reasons changed, the new factor of the interval is in throttle->factor
+ */
+bool throttle_update(capture_throttle* throttle, const monitor_info* monitor, float frameMs)
+{
+    if (!throttle->enabled)
+        return false;
+
+    int reasons = throttle->reasons;
+    if (frameMs > 0 && (throttle->enabled & THROTTLE_LATENCY))
+    {
+        bool contended = (reasons & THROTTLE_LATENCY) != 0;
+        float weight = contended ? THROTTLE_CONTENDED_SMOOTHING : THROTTLE_BASELINE_SMOOTHING;
+        if (throttle->frames++ == 0)
+        {
+            throttle->baselineMs    = frameMs;
+            throttle->recentMs      = frameMs;
+        }
+        bool spike = frameMs > throttle->baselineMs * throttle->latencyThreshold
+            && frameMs - throttle->baselineMs > THROTTLE_MIN_SPIKE_MS;
+        throttle->spikes        = spike ? throttle->spikes + 1 : 0;
+        throttle->recentMs      += (frameMs - throttle->recentMs)   * THROTTLE_RECENT_SMOOTHING;
+        throttle->baselineMs    += (frameMs - throttle->baselineMs) * weight;
+
+        // Contention ends halfway between the threshold and the baseline, so it does not flip with every frame
+        float excess = throttle->recentMs - throttle->baselineMs;
+        if (!contended && throttle->frames >= THROTTLE_WARMUP_FRAMES && throttle->spikes >= THROTTLE_SPIKE_FRAMES)
+            reasons |= THROTTLE_LATENCY;
+        else if (contended && (excess <= THROTTLE_MIN_SPIKE_MS / 2
+            || throttle->recentMs < throttle->baselineMs * (1 + throttle->latencyThreshold) / 2))
+            reasons &= ~THROTTLE_LATENCY;
+    }
+
+    unsigned long long now = GetTickCount64();
+    if (now >= throttle->nextProbeMs)
+    {
+        throttle->probed        = 0;
+        throttle->nextProbeMs   = now + THROTTLE_PROBE_INTERVAL_MS;
+        if ((throttle->enabled & THROTTLE_BATTERY) && on_battery())
+            throttle->probed |= THROTTLE_BATTERY;
+        if ((throttle->enabled & THROTTLE_FULLSCREEN) && monitor && monitor_fullscreen(monitor))
+            throttle->probed |= THROTTLE_FULLSCREEN;
+    }
+    reasons = (reasons & THROTTLE_LATENCY) | throttle->probed;
+    if (reasons == throttle->reasons)
+        return false;
+
+    // Several reasons do not add up, the strongest one applies
+    float factor = 1;
+    if ((reasons & THROTTLE_BATTERY) && throttle->batteryFactor > factor)
+        factor = throttle->batteryFactor;
+    if ((reasons & (THROTTLE_LATENCY | THROTTLE_FULLSCREEN)) && throttle->contentionFactor > factor)
+        factor = throttle->contentionFactor;
+
+    throttle->reasons   = reasons;
+    throttle->factor    = factor;
+    return true;
+}
@@ -0,0 +1,46 @@
+/**
+ * LibAmbient - Throttling of the capture thread.
+ *
+ * The capture thread slows down while the machine runs on battery, while a
+ * fullscreen exclusive application is in the foreground of the captured
+ * monitor, and while captures take much longer than usual, which happens
+ * when a game competes with the capture for the GPU. The power state and the
+ * foreground are probed about once per second, the latency of every frame
+ * is compared to a slowly moving baseline of the uncontended frames.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_THROTTLE_H
+#define LIB_AMBIENT_THROTTLE_H
+
+#include "libambient.hpp"
+#include "capture.hpp"
+
+struct capture_throttle
+{
+    int     enabled;            // THROTTLE_REASON flags which are followed, 0 disables the throttle
+    float   batteryFactor;
+    float   contentionFactor;
+    float   latencyThreshold;
+
+    // Latency of the frames, the baseline only follows slowly while they are contended
+    float   baselineMs;
+    float   recentMs;
+    int     frames;             // Frames measured since the throttle was configured
+    int     spikes;             // Consecutive frames above the threshold
+
+    // Results of the last probe of the power state and the foreground
+    int                 probed;
+    unsigned long long  nextProbeMs;    // GetTickCount64() at which they are probed again
+
+    int     reasons;            // THROTTLE_REASON flags which are in effect
+    float   factor;             // Factor the capture interval is stretched by, 1 if not throttled
+};
+
+void    throttle_configure(capture_throttle* throttle, const ambient_throttle_config* config);
+void    throttle_reset(capture_throttle* throttle);
+bool    throttle_update(capture_throttle* throttle, const monitor_info* monitor, float frameMs);
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * LibAmbient - Tone mapping of HDR frames.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "tonemap.hpp"
+#include <math.h>
+
+// Built once by tonemap_initialize() and shared by all contexts, padded for 32 bit gathers
+static unsigned char g_srgbLut[SRGB_LUT_SIZE + 3];
+
+/**
+ * Builds the table encoding linear intensities as sRGB.
+ * Must be called before any frame is tone mapped.
+ */
+void tonemap_initialize()
+{
+    for (int i = 0; i < SRGB_LUT_SIZE; i++)
+    {
+        double c = (double) i / (SRGB_LUT_SIZE - 1);
+        c = c <= 0.0031308 ? c * 12.92 : 1.055 * pow(c, 1.0 / 2.4) - 0.055;
+        g_srgbLut[i] = (unsigned char) (c * 255.0 + 0.5);
+    }
+}
+
+/**
+ * Sets up a tone curve for the specified display.
+ *
+ * @param paperWhiteNits The brightness of SDR white on the display, which becomes 1.0
+ * @param peakNits The peak brightness of the display, which TONE_MAP_REINHARD maps to SDR white
+ */
+void tone_curve_configure(tone_curve* curve, TONE_MAP mode, float paperWhiteNits, float peakNits)
+{
+    curve->exposure = SCRGB_WHITE_NITS / paperWhiteNits;
+
+    // The curves are written as (a * x^2 + b * x) / (c * x^2 + d * x + e)
+    switch (mode)
+    {
+    case TONE_MAP_REINHARD:
+    {
+        // Extended Reinhard, x * (1 + x / w^2) / (1 + x) reaches 1 at the white point w
+        float white = peakNits > paperWhiteNits ? peakNits / paperWhiteNits : 1.0f;
+        curve->a = 1.0f / (white * white);
+        curve->b = 1.0f;
+        curve->c = 0.0f;
+        curve->d = 1.0f;
+        curve->e = 1.0f;
+        break;
+    }
+    case TONE_MAP_ACES:
+        // Fit of the ACES reference rendering transform by Krzysztof Narkowicz
+        curve->a = 2.51f;
+        curve->b = 0.03f;
+        curve->c = 2.43f;
+        curve->d = 0.59f;
+        curve->e = 0.14f;
+        break;
+    default:
+        curve->a = 0.0f;
+        curve->b = 1.0f;
+        curve->c = 0.0f;
+        curve->d = 0.0f;
+        curve->e = 1.0f;
+        break;
+    }
+}
+
+/**
+ * Tone maps a PIXEL_RGBA16F surface into the specified buffer of width * height pixels.
+ *
+ * @param pitch The distance between two rows of the surface in bytes
+ */
+void tonemap_surface(const tone_curve* curve, const unsigned char* surface, int pitch,
+                     int width, int height, COLOR* dest)
+{
+    for (int y = 0; y < height; y++)
+    {
+        tonemap_half((const unsigned short*) (surface + (size_t) y * pitch), width, curve, g_srgbLut,
+            dest + (size_t) y * width);
+    }
+}
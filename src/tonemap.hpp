@@ -0,0 +1,27 @@
+/**
+ * LibAmbient - Tone mapping of HDR frames.
+ *
+ * HDR displays are duplicated as linear scRGB half floats, where 1.0 is 80 nits.
+ * The frames are exposed so SDR white becomes 1.0, tone mapped into the SDR range
+ * and encoded as sRGB right after the readback, so every reduction works
+ * on 32 bit pixels just as it does for SDR displays.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_TONEMAP_H
+#define LIB_AMBIENT_TONEMAP_H
+
+#include "libambient.hpp"
+#include "reduce.hpp"
+
+// Brightness of 1.0 in scRGB
+#define SCRGB_WHITE_NITS 80.0f
+
+void    tonemap_initialize();
+void    tone_curve_configure(tone_curve* curve, TONE_MAP mode, float paperWhiteNits, float peakNits);
+void    tonemap_surface(const tone_curve* curve, const unsigned char* surface, int pitch,
+                        int width, int height, COLOR* dest);
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * LibAmbient - Persistent worker threads for tiled reductions.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "workers.hpp"
+#include "platform.hpp"
+#include <new>
+
+#ifdef __linux__
+    #include <pthread.h>
+#endif
+
+static void run_tiles(worker_pool* pool, int thread)
+{
+    for (;;)
+    {
+        int begin = pool->next.fetch_add(pool->tileSize, std::memory_order_relaxed);
+        if (begin >= pool->count)
+            return;
+        int end = begin + pool->tileSize < pool->count ? begin + pool->tileSize : pool->count;
+        pool->function(pool->user, begin, end, thread);
+    }
+}
+
+static void run_worker(worker_pool* pool, int thread)
+{
+    unsigned long long generation = 0;
+    std::unique_lock<std::mutex> lock(pool->lock);
+    for (;;)
+    {
+        pool->wake.wait(lock, [&]() { return pool->stop || pool->generation != generation; });
+        if (pool->stop)
+            return;
+        generation = pool->generation;
+
+        lock.unlock();
+        run_tiles(pool, thread);
+        lock.lock();
+
+        if (--pool->busy == 0)
+            pool->finished.notify_one();
+    }
+}
+
+/**
+ * Restricts a worker to the processors of the specified mask.
+ * Platforms without thread affinity (e.g. macOS) ignore the mask.
+ */
+static void set_affinity(std::thread& thread, unsigned long long affinityMask)
+{
+#if defined(_WIN32)
+    SetThreadAffinityMask((HANDLE) thread.native_handle(), (DWORD_PTR) affinityMask);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; cpu++)
+    {
+        if (affinityMask & (1ULL << cpu))
+            CPU_SET(cpu, &set);
+    }
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+    (void) thread;
+    (void) affinityMask;
+#endif
+}
+
+/**
+ * Starts the worker threads of a pool.
+ * 
+ * @param threadCount The amount of threads processing a job, including the calling thread
+ * @param affinityMask The processors the workers may run on, 0 for any.
+ *                     The calling thread is not affected.
+ * 
+ * @return false if the threads could not be started
+ */
+bool worker_pool_initialize(worker_pool* pool, int threadCount, unsigned long long affinityMask)
+{
+    pool->threadCount   = threadCount > 1 ? threadCount - 1 : 0;
+    pool->threads       = NULL;
+    pool->generation    = 0;
+    pool->busy          = 0;
+    pool->stop          = false;
+    if (pool->threadCount == 0)
+        return true;
+
+    pool->threads = new (std::nothrow) std::thread[pool->threadCount];
+    if (!pool->threads)
+    {
+        pool->threadCount = 0;
+        return false;
+    }
+
+    for (int i = 0; i < pool->threadCount; i++)
+    {
+        pool->threads[i] = std::thread(run_worker, pool, i + 1);
+        if (affinityMask)
+            set_affinity(pool->threads[i], affinityMask);
+    }
+    return true;
+}
+
+/**
+ * Stops and joins all workers of the pool.
+ */
+void worker_pool_uninitialize(worker_pool* pool)
+{
+    {
+        std::lock_guard<std::mutex> lock(pool->lock);
+        pool->stop = true;
+    }
+    pool->wake.notify_all();
+
+    for (int i = 0; i < pool->threadCount; i++)
+        pool->threads[i].join();
+    delete[] pool->threads;
+    pool->threads       = NULL;
+    pool->threadCount   = 0;
+    pool->stop          = false;
+}
+
+/**
+ * Runs a job on all threads of the pool and returns once every tile was processed.
+ * 
+ * @param count The amount of rows to process
+ * @param tileSize The amount of rows of a tile
+ * @param function Called for each tile
+ * @param user Passed to the function
+ */
+void worker_pool_run(worker_pool* pool, int count, int tileSize, tile_function function, void* user)
+{
+    if (pool->threadCount == 0)
+    {
+        function(user, 0, count, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool->lock);
+        pool->function  = function;
+        pool->user      = user;
+        pool->count     = count;
+        pool->tileSize  = tileSize > 0 ? tileSize : 1;
+        pool->next.store(0, std::memory_order_relaxed);
+        pool->busy      = pool->threadCount;
+        pool->generation++;
+    }
+    pool->wake.notify_all();
+
+    run_tiles(pool, 0);
+
+    std::unique_lock<std::mutex> lock(pool->lock);
+    pool->finished.wait(lock, [&]() { return pool->busy == 0; });
+}
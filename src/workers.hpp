@@ -0,0 +1,49 @@
+/**
+ * LibAmbient - Persistent worker threads for tiled reductions.
+ *
+ * A job splits a range of rows into tiles, which the workers (and the
+ * calling thread) claim one after another using an atomic counter.
+ * Each tile knows the index of the thread running it, so partial results
+ * can be kept per thread and merged once all tiles are done, without
+ * any locks while the tiles are processed.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_WORKERS_H
+#define LIB_AMBIENT_WORKERS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Processes the rows [begin, end), thread is 0 for the caller and 1 to threadCount for the workers
+typedef void (*tile_function)(void* user, int begin, int end, int thread);
+
+struct worker_pool
+{
+    std::thread*            threads;
+    int                     threadCount;    // Workers besides the calling thread
+
+    std::mutex              lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    unsigned long long      generation;     // Incremented for every job
+    int                     busy;           // Workers which did not finish the current job yet
+    bool                    stop;
+
+    // The current job
+    tile_function           function;
+    void*                   user;
+    int                     count;
+    int                     tileSize;
+    std::atomic<int>        next;
+};
+
+bool    worker_pool_initialize(worker_pool* pool, int threadCount, unsigned long long affinityMask);
+void    worker_pool_uninitialize(worker_pool* pool);
+void    worker_pool_run(worker_pool* pool, int count, int tileSize, tile_function function, void* user);
+
+#endif
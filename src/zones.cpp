@@ -0,0 +1,392 @@
+/**
+ * LibAmbient - Reduction of rectangular screen zones, e.g. for LED strips.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#include "zones.hpp"
+#include "colorspace.hpp"
+#include "reduce.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+static int compare_ints(const void* a, const void* b)
+{
+    int x = *(const int*) a, y = *(const int*) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Sorts the zones of a band by their left edge, so a row is read from left to right.
+ * Bands only contain a few zones, an insertion sort is fine.
+ */
+static void sort_zones_by_x(const zone_rect* rects, int* zones, int count)
+{
+    for (int i = 1; i < count; i++)
+    {
+        int zone = zones[i], j = i;
+        for (; j > 0 && rects[zones[j - 1]].x0 > rects[zone].x0; j--)
+            zones[j] = zones[j - 1];
+        zones[j] = zone;
+    }
+}
+
+/**
+ * Maps a range of screen coordinates onto the pixel buffer,
+ * making sure the result covers at least a single pixel.
+ */
+static void map_range(int start, int length, int screenSize, int bitmapSize, int* dest0, int* dest1)
+{
+    long long from  = (long long) start * bitmapSize / screenSize;
+    long long to    = ((long long) (start + length) * bitmapSize + screenSize - 1) / screenSize;
+    if (from < 0)               from = 0;
+    if (from > bitmapSize - 1)  from = bitmapSize - 1;
+    if (to > bitmapSize)        to = bitmapSize;
+    if (to <= from)             to = from + 1;
+    *dest0 = (int) from;
+    *dest1 = (int) to;
+}
+
+/**
+ * Splits the rows of the pixel buffer into bands covered by the same zones.
+ * The bands are only reallocated if they outgrow the previous ones.
+ */
+static bool build_bands(zone_layout* layout)
+{
+    int* edges = layout->edges;
+    for (int z = 0; z < layout->count; z++)
+    {
+        edges[z * 2 + 0] = layout->rects[z].y0;
+        edges[z * 2 + 1] = layout->rects[z].y1;
+    }
+    qsort(edges, layout->count * 2, sizeof(int), compare_ints);
+
+    int edgeCount = 0;
+    for (int i = 0; i < layout->count * 2; i++)
+        if (edgeCount == 0 || edges[edgeCount - 1] != edges[i])
+            edges[edgeCount++] = edges[i];
+
+    // First pass counts the zones of all bands, second pass fills them in
+    int bandZoneCount = 0;
+    for (int b = 0; b + 1 < edgeCount; b++)
+        for (int z = 0; z < layout->count; z++)
+            if (layout->rects[z].y0 <= edges[b] && layout->rects[z].y1 >= edges[b + 1])
+                bandZoneCount++;
+
+    int bandCount = edgeCount > 1 ? edgeCount - 1 : 1;
+    if (bandZoneCount < 1)
+        bandZoneCount = 1;
+    if (bandCount > layout->bandCapacity || bandZoneCount > layout->bandZoneCapacity)
+    {
+        zone_band*  bands       = (zone_band*)  malloc(bandCount * sizeof(zone_band));
+        int*        bandZones   = (int*)        malloc(bandZoneCount * sizeof(int));
+        if (!bands || !bandZones)
+        {
+            free(bands);
+            free(bandZones);
+            return false;
+        }
+        free(layout->bands);
+        free(layout->bandZones);
+        layout->bands               = bands;
+        layout->bandZones           = bandZones;
+        layout->bandCapacity        = bandCount;
+        layout->bandZoneCapacity    = bandZoneCount;
+    }
+
+    layout->bandCount = 0;
+    int next = 0;
+    for (int b = 0; b + 1 < edgeCount; b++)
+    {
+        zone_band* band = &layout->bands[layout->bandCount];
+        band->y0        = edges[b];
+        band->y1        = edges[b + 1];
+        band->firstZone = next;
+        for (int z = 0; z < layout->count; z++)
+            if (layout->rects[z].y0 <= band->y0 && layout->rects[z].y1 >= band->y1)
+                layout->bandZones[next++] = z;
+        band->zoneCount = next - band->firstZone;
+
+        // Rows without any zone are skipped entirely
+        if (band->zoneCount == 0)
+            continue;
+
+        sort_zones_by_x(layout->rects, layout->bandZones + band->firstZone, band->zoneCount);
+        layout->bandCount++;
+    }
+    return true;
+}
+
+/**
+ * Maps the zones onto the pixel buffer using the sizes stored in the layout.
+ */
+static void map_zones(zone_layout* layout)
+{
+    layout->area = 0;
+    for (int z = 0; z < layout->count; z++)
+    {
+        const ZONE* zone = &layout->zones[z];
+        zone_rect* rect = &layout->rects[z];
+        map_range(zone->x, zone->width,  layout->screenWidth,  layout->bitmapWidth,  &rect->x0, &rect->x1);
+        map_range(zone->y, zone->height, layout->screenHeight, layout->bitmapHeight, &rect->y0, &rect->y1);
+        layout->area += (unsigned long long) (rect->x1 - rect->x0) * (rect->y1 - rect->y0);
+    }
+}
+
+/**
+ * Prepares the specified zones for reduction.
+ *
+ * @param zones The zones in screen coordinates
+ * @param count The amount of zones
+ *
+ * @return false if the zones could not be allocated. The layout is released in that case.
+ */
+bool zones_initialize(zone_layout* layout, const ZONE* zones, int count,
+                      int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight)
+{
+    memset(layout, 0, sizeof(*layout));
+    layout->screenWidth     = screenWidth;
+    layout->screenHeight    = screenHeight;
+    layout->bitmapWidth     = bitmapWidth;
+    layout->bitmapHeight    = bitmapHeight;
+    if (count <= 0)
+        return true;
+
+    layout->count   = count;
+    layout->zones   = (ZONE*)               malloc(count * sizeof(ZONE));
+    layout->rects   = (zone_rect*)          malloc(count * sizeof(zone_rect));
+    layout->sums    = (unsigned long long*) malloc(count * 3 * sizeof(unsigned long long));
+    layout->colors  = (COLOR*)              malloc(count * sizeof(COLOR));
+    layout->edges   = (int*)                malloc(count * 2 * sizeof(int));
+    if (!layout->zones || !layout->rects || !layout->sums || !layout->colors || !layout->edges)
+    {
+        zones_uninitialize(layout);
+        return false;
+    }
+
+    memcpy(layout->zones, zones, count * sizeof(ZONE));
+    memset(layout->colors, 0, count * sizeof(COLOR));
+    map_zones(layout);
+
+    if (!build_bands(layout))
+    {
+        zones_uninitialize(layout);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Maps the zones of a layout onto a different screen or pixel buffer size, keeping their colors.
+ * Nothing is allocated unless the rows split into more bands than before.
+ *
+ * @return false if the bands could not be allocated, the previous mapping is kept in that case
+ */
+bool zones_remap(zone_layout* layout, int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight)
+{
+    int oldSizes[4] = { layout->screenWidth, layout->screenHeight, layout->bitmapWidth, layout->bitmapHeight };
+    layout->screenWidth     = screenWidth;
+    layout->screenHeight    = screenHeight;
+    layout->bitmapWidth     = bitmapWidth;
+    layout->bitmapHeight    = bitmapHeight;
+    map_zones(layout);
+    if (layout->count == 0 || build_bands(layout))
+        return true;
+
+    // The old bands fit into the arrays they were built in
+    layout->screenWidth     = oldSizes[0];
+    layout->screenHeight    = oldSizes[1];
+    layout->bitmapWidth     = oldSizes[2];
+    layout->bitmapHeight    = oldSizes[3];
+    map_zones(layout);
+    build_bands(layout);
+    return false;
+}
+
+/**
+ * Releases all resources of the specified zone layout.
+ */
+void zones_uninitialize(zone_layout* layout)
+{
+    free(layout->zones);
+    free(layout->rects);
+    free(layout->bands);
+    free(layout->bandZones);
+    free(layout->edges);
+    free(layout->sums);
+    free(layout->colors);
+    memset(layout, 0, sizeof(*layout));
+}
+
+/**
+ * Sums all zones in a single pass over the rows.
+ */
+static void reduce_spans(zone_layout* layout, const COLOR* pixels, int bitmapWidth, COLOR_SPACE space)
+{
+    memset(layout->sums, 0, layout->count * 3 * sizeof(unsigned long long));
+
+    for (int b = 0; b < layout->bandCount; b++)
+    {
+        const zone_band* band   = &layout->bands[b];
+        const int* bandZones    = layout->bandZones + band->firstZone;
+        for (int y = band->y0; y < band->y1; y++)
+        {
+            const COLOR* row = pixels + y * bitmapWidth;
+            for (int i = 0; i < band->zoneCount; i++)
+            {
+                const zone_rect* rect = &layout->rects[bandZones[i]];
+                colorspace_sum(space, row + rect->x0, rect->x1 - rect->x0, layout->sums + bandZones[i] * 3);
+            }
+        }
+    }
+}
+
+/**
+ * Sums all zones using four lookups into the summed-area table each.
+ */
+static bool reduce_integral(zone_layout* layout, const COLOR* pixels, int bitmapWidth, int bitmapHeight,
+                            integral_image* integral)
+{
+    size_t entries = (size_t) (bitmapWidth + 1) * (bitmapHeight + 1);
+    if (integral->capacity < entries)
+    {
+        unsigned int* table = (unsigned int*) realloc(integral->table, entries * 4 * sizeof(unsigned int));
+        if (!table)
+            return false;
+        integral->table     = table;
+        integral->capacity  = entries;
+    }
+    build_integral_image(pixels, bitmapWidth, bitmapHeight, integral->table);
+
+    int stride = (bitmapWidth + 1) * 4;
+    for (int z = 0; z < layout->count; z++)
+    {
+        const zone_rect* rect = &layout->rects[z];
+        const unsigned int* topLeft     = integral->table + rect->y0 * stride + rect->x0 * 4;
+        const unsigned int* topRight    = integral->table + rect->y0 * stride + rect->x1 * 4;
+        const unsigned int* bottomLeft  = integral->table + rect->y1 * stride + rect->x0 * 4;
+        const unsigned int* bottomRight = integral->table + rect->y1 * stride + rect->x1 * 4;
+
+        unsigned long long* sums = layout->sums + z * 3;
+        for (int c = 0; c < 3; c++)
+            sums[c] = (unsigned int) (bottomRight[c] - bottomLeft[c] - topRight[c] + topLeft[c]);
+    }
+    return true;
+}
+
+/**
+ * Calculates the average color of every zone.
+ *
+ * @param reduction How to sum the zones. ZONE_REDUCTION_AUTO uses the summed-area table
+ *                  once the zones cover the buffer more than twice, as building the table
+ *                  costs about two plain passes over the buffer.
+ * @param space The color space to average in. The summed-area table only holds sRGB sums,
+ *              so the other color spaces always sum the zones directly.
+ * @param integral The summed-area table to use, kept by the caller across frames
+ */
+void zones_reduce(zone_layout* layout, const COLOR* pixels, int bitmapWidth, int bitmapHeight,
+                  ZONE_REDUCTION reduction, COLOR_SPACE space, integral_image* integral)
+{
+    if (layout->count == 0)
+        return;
+
+    bool useIntegral = reduction == ZONE_REDUCTION_INTEGRAL
+        || (reduction == ZONE_REDUCTION_AUTO && layout->area > 2ULL * bitmapWidth * bitmapHeight);
+    if (space != COLOR_SPACE_SRGB)
+        useIntegral = false;
+    if (!useIntegral || !reduce_integral(layout, pixels, bitmapWidth, bitmapHeight, integral))
+        reduce_spans(layout, pixels, bitmapWidth, space);
+
+    zones_average(layout->rects, layout->sums, layout->count, space, layout->colors);
+}
+
+/**
+ * Turns the channel sums of each zone into its average color.
+ *
+ * @param rects The zones the sums were calculated from
+ * @param sums 3 sums per zone, as calculated by colorspace_sum
+ */
+void zones_average(const zone_rect* rects, const unsigned long long* sums, int count, COLOR_SPACE space,
+                   COLOR* colors)
+{
+    for (int z = 0; z < count; z++)
+    {
+        const zone_rect* rect = &rects[z];
+        unsigned long long pixelCount = (unsigned long long) (rect->x1 - rect->x0) * (rect->y1 - rect->y0);
+        colors[z] = colorspace_average(space, sums + z * 3, pixelCount);
+    }
+}
+
+/**
+ * Maps the zones of the specified layout onto an image of a different size,
+ * e.g. the full resolution frame on the GPU.
+ */
+void zones_map(const zone_layout* layout, int screenWidth, int screenHeight, int width, int height,
+               zone_rect* dest)
+{
+    for (int z = 0; z < layout->count; z++)
+        zones_map_rect(&layout->zones[z], screenWidth, screenHeight, width, height, &dest[z]);
+}
+
+/**
+ * Maps a single rectangle from screen coordinates onto a surface of the specified size.
+ * The result covers at least a single pixel of the surface.
+ */
+void zones_map_rect(const ZONE* zone, int screenWidth, int screenHeight, int width, int height,
+                    zone_rect* dest)
+{
+    map_range(zone->x, zone->width,  screenWidth,  width,  &dest->x0, &dest->x1);
+    map_range(zone->y, zone->height, screenHeight, height, &dest->y0, &dest->y1);
+}
+
+/**
+ * Releases the summed-area table.
+ */
+void zones_release_integral(integral_image* integral)
+{
+    free(integral->table);
+    integral->table     = NULL;
+    integral->capacity  = 0;
+}
+
+/**
+ * Creates zones along the edges of the screen, in clockwise order starting at the
+ * top left corner: top (left to right), right (top to bottom),
+ * bottom (right to left) and left (bottom to top).
+ *
+ * @param dest Receives the zones, must hold top + bottom + left + right zones
+ * @param depth The distance in pixels each zone reaches into the screen
+ *
+ * @return The amount of zones written
+ */
+int zones_edge_layout(ZONE* dest, int top, int bottom, int left, int right, int depth,
+                      int screenWidth, int screenHeight)
+{
+    int count = 0;
+    for (int i = 0; i < top; i++)
+    {
+        int x0 = i * screenWidth / top, x1 = (i + 1) * screenWidth / top;
+        ZONE zone = { x0, 0, x1 - x0, depth };
+        dest[count++] = zone;
+    }
+    for (int i = 0; i < right; i++)
+    {
+        int y0 = i * screenHeight / right, y1 = (i + 1) * screenHeight / right;
+        ZONE zone = { screenWidth - depth, y0, depth, y1 - y0 };
+        dest[count++] = zone;
+    }
+    for (int i = 0; i < bottom; i++)
+    {
+        int x0 = (bottom - 1 - i) * screenWidth / bottom, x1 = (bottom - i) * screenWidth / bottom;
+        ZONE zone = { x0, screenHeight - depth, x1 - x0, depth };
+        dest[count++] = zone;
+    }
+    for (int i = 0; i < left; i++)
+    {
+        int y0 = (left - 1 - i) * screenHeight / left, y1 = (left - i) * screenHeight / left;
+        ZONE zone = { 0, y0, depth, y1 - y0 };
+        dest[count++] = zone;
+    }
+    return count;
+}
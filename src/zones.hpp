@@ -0,0 +1,82 @@
+/**
+ * LibAmbient - Reduction of rectangular screen zones, e.g. for LED strips.
+ *
+ * All zones are calculated from the same capture in a single pass over
+ * the rows of the pixel buffer. The rows are split into bands in which the
+ * set of overlapping zones does not change, so each row only visits the
+ * zones it actually belongs to.
+ *
+ * With many (overlapping) zones, a summed-area table can be built instead,
+ * which turns each zone into four lookups regardless of its size.
+ *
+ * (c) 2020 Kraus David. All rights reserved.
+ *
+ */
+
+#ifndef LIB_AMBIENT_ZONES_H
+#define LIB_AMBIENT_ZONES_H
+
+#include "libambient.hpp"
+#include <stddef.h>
+
+// A zone in the coordinates of the pixel buffer (x1 and y1 are exclusive)
+struct zone_rect
+{
+    int x0, y0, x1, y1;
+};
+
+// A range of rows which is covered by the same zones
+struct zone_band
+{
+    int y0, y1;
+    int firstZone, zoneCount;   // Range inside zone_layout::bandZones
+};
+
+struct zone_layout
+{
+    ZONE*               zones;      // Screen coordinates, as specified by the caller
+    zone_rect*          rects;      // Pixel buffer coordinates
+    int                 count;
+
+    zone_band*          bands;
+    int*                bandZones;  // Zones of all bands, sorted by x inside a band
+    int                 bandCount;
+    int                 bandCapacity, bandZoneCapacity;
+    int*                edges;      // Scratch space for building the bands, 2 per zone
+
+    // Sizes the rects were mapped for (see zones_remap)
+    int                 screenWidth, screenHeight;
+    int                 bitmapWidth, bitmapHeight;
+
+    unsigned long long* sums;       // 3 sums per zone (see colorspace_sum)
+    COLOR*              colors;     // Average color per zone
+
+    unsigned long long  area;       // Sum of the areas of all zones, in pixels
+};
+
+// A summed-area table of the pixel buffer (see build_integral_image),
+// which is kept across frames and only grows if the buffer does.
+struct integral_image
+{
+    unsigned int*   table;
+    size_t          capacity;   // In entries of 4 unsigned ints
+};
+
+bool    zones_initialize(zone_layout* layout, const ZONE* zones, int count,
+                         int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight);
+void    zones_uninitialize(zone_layout* layout);
+bool    zones_remap(zone_layout* layout, int screenWidth, int screenHeight, int bitmapWidth, int bitmapHeight);
+void    zones_reduce(zone_layout* layout, const COLOR* pixels, int bitmapWidth, int bitmapHeight,
+                     ZONE_REDUCTION reduction, COLOR_SPACE space, integral_image* integral);
+void    zones_release_integral(integral_image* integral);
+void    zones_average(const zone_rect* rects, const unsigned long long* sums, int count, COLOR_SPACE space,
+                      COLOR* colors);
+void    zones_map(const zone_layout* layout, int screenWidth, int screenHeight, int width, int height,
+                  zone_rect* dest);
+void    zones_map_rect(const ZONE* zone, int screenWidth, int screenHeight, int width, int height,
+                       zone_rect* dest);
+
+int     zones_edge_layout(ZONE* dest, int top, int bottom, int left, int right, int depth,
+                          int screenWidth, int screenHeight);
+
+#endif